@@ -2,19 +2,25 @@
 
 #include "Shared.hlsli"
 
-struct PushConstants
-{
-    int step;
-};
-
-NRI_ROOT_CONSTANTS( PushConstants, g_PushConstants, 1, SET_ROOT );
-
 // Inputs
 NRI_RESOURCE( Texture2D<float4>, gIn_Gradient, t, 0, SET_OTHER );
 
 // Outputs
 NRI_FORMAT("unknown") NRI_RESOURCE( RWTexture2D<float4>, gOut_Gradient, u, 0, SET_OTHER );
 
+// All blur passes ( 5x5 taps with steps 1-5 ) are fused into one dispatch: a tile with a halo is filtered in shared memory.
+// The exact footprint is "2 * ( 1 + 2 + 3 + 4 + 5 ) = 30" pixels, but the halo is limited to "BLUR_HALO" ( taps are clamped to the region ),
+// because far taps have negligible weights ( < 0.3% )
+#define BLUR_GROUP_SIZE                     16
+#define BLUR_PASS_NUM                       5
+#define BLUR_HALO                           16
+#define BLUR_REGION_SIZE                    ( BLUR_GROUP_SIZE + BLUR_HALO * 2 )
+#define BLUR_REGION_NUM                     ( BLUR_REGION_SIZE * BLUR_REGION_SIZE )
+
+groupshared float16_t2 s_Normal[ BLUR_REGION_NUM ]; // encoded
+groupshared float s_ViewZ[ BLUR_REGION_NUM ];
+groupshared float16_t s_Gradient[ 2 ][ BLUR_REGION_NUM ]; // ping-pong, FP16 as in textures
+
 float2 GetGeometryWeightParams( float3 Nv, float3 Xv )
 {
     const float planeDistSensitivity = 0.02;
@@ -30,25 +36,24 @@ float2 GetGeometryWeightParams( float3 Nv, float3 Xv )
 #define ComputeNonExponentialWeight( x, px, py ) \
     Math::SmoothStep( 1.0, 0.0, abs( ( x ) * px + py ) )
 
-[numthreads( 16, 16, 1 )]
-void main( uint2 pixelPos : SV_DispatchThreadID )
+uint GetRegionIndex( int2 regionPos )
 {
-    float2 pixelUv = ( pixelPos + 0.5 ) * gInvSharcRenderSize;
+    return regionPos.y * BLUR_REGION_SIZE + regionPos.x;
+}
 
-    float4 data0 = gIn_Gradient[ pixelPos ];
-    float z0 = data0.w / FP16_VIEWZ_SCALE;
-    bool isLastPass = g_PushConstants.step == 5;
+float Blur( int2 pixelPos, int2 regionOrigin, int2 tapMin, int2 tapMax, int step, uint src )
+{
+    uint index0 = GetRegionIndex( pixelPos - regionOrigin );
+    float z0 = s_ViewZ[ index0 ];
 
     if( abs( z0 ) > INF )
-    {
-        gOut_Gradient[ pixelPos ] = float4( isLastPass, data0.yzw );
-        return;
-    }
+        return 0.0;
 
+    float2 pixelUv = ( pixelPos + 0.5 ) * gInvSharcRenderSize;
     float3 Xv0 = Geometry::ReconstructViewPosition( pixelUv, gCameraFrustum, z0, gOrthoMode );
-    float3 Nv0 = Packing::DecodeUnitVector( data0.yz );
+    float3 Nv0 = Packing::DecodeUnitVector( s_Normal[ index0 ] );
     float2 geometryWeightParams = GetGeometryWeightParams( Nv0, Xv0 );
-    float gradient = data0.x;
+    float gradient = s_Gradient[ src ][ index0 ];
     float sum = 1.0;
 
     [unroll]
@@ -60,47 +65,100 @@ void main( uint2 pixelPos : SV_DispatchThreadID )
             if( i == 0 && j == 0 )
                 continue;
 
-            int2 pos = pixelPos + int2( i, j ) * g_PushConstants.step;
+            int2 pos = pixelPos + int2( i, j ) * step;
             float2 uv = ( pos + 0.5 ) * gInvSharcRenderSize;
 
-            float4 data = gIn_Gradient.SampleLevel( gNearestClamp, uv, 0 );
+            // Clamping to the texture matches "gNearestClamp", clamping to the region is the approximation
+            uint index = GetRegionIndex( clamp( pos, tapMin, tapMax ) - regionOrigin );
 
             // Gaussian weight
             float d = length( int2( i, j ) ) / 2.0;
             float w = exp( -2.0 * d * d );
 
             // Plane distance weight
-            float z = data.w / FP16_VIEWZ_SCALE;
+            float z = s_ViewZ[ index ];
             float3 Xv = Geometry::ReconstructViewPosition( uv, gCameraFrustum, z, gOrthoMode );
             float NoX = dot( Nv0, Xv );
             w *= ComputeNonExponentialWeight( NoX, geometryWeightParams.x, geometryWeightParams.y );
 
             // Normal weight
-            float3 Nv = Packing::DecodeUnitVector( data.yz );
+            float3 Nv = Packing::DecodeUnitVector( s_Normal[ index ] );
             float NoN = saturate( dot( Nv0, Nv ) );
             w *= NoN * NoN;
 
             // Accumulate
-            gradient += data.x * w;
+            gradient += s_Gradient[ src ][ index ] * w;
             sum += w;
         }
     }
 
-    gradient /= sum;
+    return saturate( gradient / sum );
+}
+
+[numthreads( BLUR_GROUP_SIZE, BLUR_GROUP_SIZE, 1 )]
+void main( uint2 pixelPos : SV_DispatchThreadID, uint2 groupId : SV_GroupID, uint threadIndex : SV_GroupIndex )
+{
+    uint2 textureSize;
+    gIn_Gradient.GetDimensions( textureSize.x, textureSize.y );
+
+    int2 regionOrigin = int2( groupId * BLUR_GROUP_SIZE ) - BLUR_HALO;
+    int2 tapMin = max( regionOrigin, 0 );
+    int2 tapMax = min( regionOrigin + BLUR_REGION_SIZE, int2( textureSize ) ) - 1;
 
-    if( isLastPass )
+    // Preload
+    for( uint i = threadIndex; i < BLUR_REGION_NUM; i += BLUR_GROUP_SIZE * BLUR_GROUP_SIZE )
     {
-        // Last pass converts "gradient" to "history confidence"
-        gradient = Color::HdrToLinear_Uncharted( gradient ).x; // or normalize to the blurred final image or SHARC cache
-        gradient = 1.0 - Color::ToSrgb( saturate( gradient ) ).x;
+        int2 pos = clamp( regionOrigin + int2( i % BLUR_REGION_SIZE, i / BLUR_REGION_SIZE ), tapMin, tapMax );
+        float4 data = gIn_Gradient[ pos ];
+
+        s_Normal[ i ] = ( float16_t2 )data.yz;
+        s_ViewZ[ i ] = data.w / FP16_VIEWZ_SCALE;
+        s_Gradient[ 0 ][ i ] = ( float16_t )data.x;
+    }
 
-        if( gDenoiserType == DENOISER_RELAX )
-            gradient *= gradient; // TODO: RELAX uses "history confidence" differently...
+    GroupMemoryBarrierWithGroupSync( );
 
-        // ( Optional ) dithering
-        float dither = Sequence::Bayer4x4( pixelPos, gFrameIndex );
-        gradient += ( dither - 0.5 ) / float( gMaxAccumulatedFrameNum );
+    // All passes but the last one, each pass filters only the part needed by the remaining passes
+    [unroll]
+    for( uint pass = 0; pass < BLUR_PASS_NUM - 1; pass++ )
+    {
+        int step = pass + 1;
+        int margin = min( BLUR_PASS_NUM * ( BLUR_PASS_NUM + 1 ) - step * ( step + 1 ), BLUR_HALO );
+        int size = BLUR_GROUP_SIZE + margin * 2;
+
+        for( uint i = threadIndex; i < uint( size * size ); i += BLUR_GROUP_SIZE * BLUR_GROUP_SIZE )
+        {
+            int2 regionPos = BLUR_HALO - margin + int2( i % size, i / size );
+            int2 pos = regionOrigin + regionPos;
+
+            if( all( pos >= tapMin ) && all( pos <= tapMax ) ) // outside of the texture, never fetched
+                s_Gradient[ step & 0x1 ][ GetRegionIndex( regionPos ) ] = ( float16_t )Blur( pos, regionOrigin, tapMin, tapMax, step, pass & 0x1 );
+        }
+
+        GroupMemoryBarrierWithGroupSync( );
     }
 
+    // Last pass converts "gradient" to "history confidence"
+    float4 data0 = gIn_Gradient[ pixelPos ];
+    float z0 = data0.w / FP16_VIEWZ_SCALE;
+
+    if( abs( z0 ) > INF )
+    {
+        gOut_Gradient[ pixelPos ] = float4( 1.0, data0.yzw );
+        return;
+    }
+
+    float gradient = Blur( pixelPos, regionOrigin, tapMin, tapMax, BLUR_PASS_NUM, ( BLUR_PASS_NUM - 1 ) & 0x1 );
+
+    gradient = Color::HdrToLinear_Uncharted( gradient ).x; // or normalize to the blurred final image or SHARC cache
+    gradient = 1.0 - Color::ToSrgb( saturate( gradient ) ).x;
+
+    if( gDenoiserType == DENOISER_RELAX )
+        gradient *= gradient; // TODO: RELAX uses "history confidence" differently...
+
+    // ( Optional ) dithering
+    float dither = Sequence::Bayer4x4( pixelPos, gFrameIndex );
+    gradient += ( dither - 0.5 ) / float( gMaxAccumulatedFrameNum );
+
     gOut_Gradient[ pixelPos ] = float4( saturate( gradient ), data0.yzw );
 }
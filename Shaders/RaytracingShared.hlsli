@@ -14,6 +14,9 @@ NRI_RESOURCE( Texture2D<float4>, gIn_Textures[], t, 4, SET_RAY_TRACING );
 NRI_RESOURCE( RWStructuredBuffer<uint64_t>, gInOut_SharcHashEntriesBuffer, u, 0, SET_SHARC );
 NRI_RESOURCE( RWStructuredBuffer<SharcAccumulationData>, gInOut_SharcAccumulated, u, 1, SET_SHARC );
 NRI_RESOURCE( RWStructuredBuffer<SharcPackedData>, gInOut_SharcResolved, u, 2, SET_SHARC );
+NRI_RESOURCE( RWStructuredBuffer<uint>, gOut_SharcStats, u, 3, SET_SHARC );
+NRI_RESOURCE( RWStructuredBuffer<uint>, gInOut_SharcActiveEntries, u, 4, SET_SHARC );
+NRI_RESOURCE( RWStructuredBuffer<uint>, gInOut_SharcActiveArgs, u, 5, SET_SHARC );
 
 #if( USE_STOCHASTIC_SAMPLING == 1 )
     #define TEX_SAMPLER gNearestMipmapNearestSampler
@@ -936,6 +939,33 @@ void GetMaterialFactors( float3 N, float3 V, float3 albedo, float3 Rf0, float ro
     }
 }
 
+// Appends an entry to the SHARC active list of the given frame ( once per frame )
+void SharcActivateEntry( uint entryIndex, uint frameIndex )
+{
+    uint stamp = frameIndex + 1; // 0 - never activated
+    uint prevStamp;
+    InterlockedExchange( gInOut_SharcActiveEntries[ entryIndex ], stamp, prevStamp );
+
+    if( prevStamp == stamp )
+        return;
+
+    uint list = frameIndex & 0x1;
+    uint args = list * SHARC_ACTIVE_ARGS_STRIDE;
+
+    uint listIndex;
+    InterlockedAdd( gInOut_SharcActiveArgs[ args + SHARC_ACTIVE_ARGS_ENTRY_NUM ], 1, listIndex );
+
+    gInOut_SharcActiveEntries[ gSharcCapacity * ( 1 + list ) + listIndex ] = entryIndex;
+
+    // Indirect dispatch arguments for "SharcResolve"
+    if( listIndex % LINEAR_BLOCK_SIZE == 0 )
+    {
+        InterlockedAdd( gInOut_SharcActiveArgs[ args ], 1 );
+        gInOut_SharcActiveArgs[ args + 1 ] = 1;
+        gInOut_SharcActiveArgs[ args + 2 ] = 1;
+    }
+}
+
 // Material de-modulation for SHARC
 float3 GetMaterialFactor( GeometryProps geometryProps, MaterialProps materialProps )
 {
@@ -6,6 +6,13 @@
 [numthreads( LINEAR_BLOCK_SIZE, 1, 1 )]
 void main( uint threadIndex : SV_DispatchThreadID )
 {
+    // Indirect dispatch over the active list of the current frame
+    uint list = gFrameIndex & 0x1;
+    if( threadIndex >= gInOut_SharcActiveArgs[ list * SHARC_ACTIVE_ARGS_STRIDE + SHARC_ACTIVE_ARGS_ENTRY_NUM ] )
+        return;
+
+    uint entryIndex = gInOut_SharcActiveEntries[ gSharcCapacity * ( 1 + list ) + threadIndex ];
+
     HashGridParameters hashGridParameters;
     hashGridParameters.cameraPosition = gCameraGlobalPos.xyz;
     hashGridParameters.sceneScale = SHARC_SCENE_SCALE;
@@ -13,7 +20,7 @@ void main( uint threadIndex : SV_DispatchThreadID )
     hashGridParameters.levelBias = SHARC_GRID_LEVEL_BIAS;
 
     HashGridData hashGridData;
-    hashGridData.capacity = SHARC_CAPACITY;
+    hashGridData.capacity = gSharcCapacity;
     hashGridData.hashEntriesBuffer = gInOut_SharcHashEntriesBuffer;
 
     SharcParameters sharcParams;
@@ -27,8 +34,12 @@ void main( uint threadIndex : SV_DispatchThreadID )
     sharcResolveParameters.cameraPositionPrev = gCameraGlobalPosPrev.xyz;
     sharcResolveParameters.accumulationFrameNum = gMaxAccumulatedFrameNum;
     sharcResolveParameters.responsiveFrameNum = SHARC_RESPONSIVE_FRAME_NUM;
-    sharcResolveParameters.staleFrameNumMax = SHARC_STALE_FRAME_NUM_MIN;
+    sharcResolveParameters.staleFrameNumMax = SHARC_STALE_FRAME_NUM_MIN * gSharcUpdatePeriod; // amortized updates revisit entries less often
     sharcResolveParameters.frameIndex = gFrameIndex;
 
-    SharcResolveEntry( threadIndex, sharcParams, sharcResolveParameters );
+    SharcResolveEntry( entryIndex, sharcParams, sharcResolveParameters );
+
+    // Not evicted entries must keep aging even if not updated
+    if( gInOut_SharcHashEntriesBuffer[ entryIndex ] != HASH_GRID_INVALID_HASH_KEY )
+        SharcActivateEntry( entryIndex, gFrameIndex + 1 );
 }
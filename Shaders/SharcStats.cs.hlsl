@@ -0,0 +1,69 @@
+// © 2024 NVIDIA Corporation
+
+#include "Shared.hlsli"
+#include "RaytracingShared.hlsli"
+
+// Home slot of a key, as "HashGridInsert" computes it
+uint SharcGetHomeSlot( uint64_t hashKey )
+{
+    uint slot = HashGridHash32( hashKey ) % gSharcCapacity;
+
+    return HashGridGetBaseSlot( slot, gSharcCapacity );
+}
+
+// Telemetry: must be dispatched after "SharcUpdate" and before "SharcResolve", which consumes accumulated data
+[numthreads( LINEAR_BLOCK_SIZE, 1, 1 )]
+void main( uint threadIndex : SV_DispatchThreadID )
+{
+    if( threadIndex >= gSharcCapacity )
+        return;
+
+    uint64_t hashKey = gInOut_SharcHashEntriesBuffer[ threadIndex ];
+
+    bool isOccupied = hashKey != HASH_GRID_INVALID_HASH_KEY;
+    bool isUpdated = isOccupied && any( gInOut_SharcAccumulated[ threadIndex ].data != 0 );
+    bool isInserted = isUpdated && all( gInOut_SharcResolved[ threadIndex ].data == 0 ); // never resolved
+
+    // Linear probing places colliding entries after the home slot, which is computed exactly as in "HashGridInsert"
+    bool isDisplaced = false;
+    bool isMisplaced = false;
+    if( isOccupied )
+    {
+        uint homeSlot = SharcGetHomeSlot( hashKey );
+        isDisplaced = homeSlot != threadIndex;
+
+        // Debug: entries must land in the probed range of their home slot, otherwise "SharcGetHomeSlot" is out of sync with SHARC
+        isMisplaced = threadIndex < homeSlot || threadIndex >= homeSlot + HASH_GRID_HASH_MAP_BUCKET_SIZE;
+    }
+
+    // Buckets: a bucket is the probed range of a home slot, counted by the thread owning its first slot
+    bool isBucket = HashGridGetBaseSlot( threadIndex, gSharcCapacity ) == threadIndex;
+    bool isFullBucket = isBucket;
+
+    if( isBucket )
+    {
+        [loop]
+        for( uint i = 0; i < HASH_GRID_HASH_MAP_BUCKET_SIZE && isFullBucket; i++ )
+            isFullBucket = threadIndex + i < gSharcCapacity && gInOut_SharcHashEntriesBuffer[ threadIndex + i ] != HASH_GRID_INVALID_HASH_KEY;
+    }
+
+    // Wave reduction, a single atomic per counter per wave
+    uint occupiedNum = WaveActiveCountBits( isOccupied );
+    uint updatedNum = WaveActiveCountBits( isUpdated );
+    uint insertedNum = WaveActiveCountBits( isInserted );
+    uint displacedNum = WaveActiveCountBits( isDisplaced );
+    uint misplacedNum = WaveActiveCountBits( isMisplaced );
+    uint fullBucketNum = WaveActiveCountBits( isFullBucket );
+    uint bucketNum = WaveActiveCountBits( isBucket );
+
+    if( WaveIsFirstLane( ) )
+    {
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_OCCUPIED ], occupiedNum );
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_UPDATED ], updatedNum );
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_INSERTED ], insertedNum );
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_DISPLACED ], displacedNum );
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_MISPLACED ], misplacedNum );
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_FULL_BUCKETS ], fullBucketNum );
+        InterlockedAdd( gOut_SharcStats[ SHARC_STAT_BUCKETS ], bucketNum );
+    }
+}
@@ -17,7 +17,33 @@ NRI_FORMAT("unknown") NRI_RESOURCE( RWTexture2D<float4>, gOut_Gradient, u, 1, SE
 #define PREV 1
 #define FULL 2
 
-float4 Trace( uint2 pixelPos, compiletime int mode )
+// Amortization: a rotating subset of 16x16 tiles updates SHARC. "1/2" - checkerboard, "1/4" - checkerboard split by "x" parity
+bool IsSharcUpdateTile( uint2 tile )
+{
+    uint checkerboard = ( tile.x + tile.y ) & 0x1;
+
+    if( gSharcUpdatePeriod == 2 )
+        return checkerboard == ( gFrameIndex & 0x1 );
+
+    if( gSharcUpdatePeriod == 4 )
+        return checkerboard == ( ( gFrameIndex >> 1 ) & 0x1 ) && ( tile.x & 0x1 ) == ( gFrameIndex & 0x1 );
+
+    return true;
+}
+
+// Feeds the active list, i.e. only touched entries get resolved
+bool SharcUpdateHitAndActivate( SharcParameters sharcParams, inout SharcState sharcState, SharcHitData sharcHitData, float3 L, float random )
+{
+    bool continueTracing = SharcUpdateHit( sharcParams, sharcState, sharcHitData, L, random );
+
+    HashGridIndex entryIndex = HashGridFindEntry( sharcHitData.positionWorld, sharcHitData.normalWorld, sharcParams.hashGridParameters, sharcParams.hashGridData );
+    if( entryIndex != HASH_GRID_INVALID_CACHE_INDEX )
+        SharcActivateEntry( entryIndex, gFrameIndex );
+
+    return continueTracing;
+}
+
+float4 Trace( uint2 pixelPos, compiletime int mode, bool isSharcUpdate )
 {
     // Sample position
     float2 jitter = mode == PREV ? ( gJitterPrev * gRectSizePrev ) : ( gJitter * gRectSize ); // it works well for 1 path per pixel, better use "Rng::Hash::GetFloat2( )" in other cases
@@ -80,7 +106,7 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
     hashGridParameters.levelBias = SHARC_GRID_LEVEL_BIAS;
 
     HashGridData hashGridData;
-    hashGridData.capacity = SHARC_CAPACITY;
+    hashGridData.capacity = gSharcCapacity;
     hashGridData.hashEntriesBuffer = gInOut_SharcHashEntriesBuffer;
 
     SharcParameters sharcParams;
@@ -106,7 +132,7 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
     gradientData.yz = Packing::EncodeUnitVector( Geometry::RotateVector( gWorldToViewPrev, geometryProps.N ) );
     gradientData.w = Geometry::AffineTransform( gWorldToViewPrev, geometryProps.X ).z * FP16_VIEWZ_SCALE;
 
-    if( mode != PREV )
+    if( isSharcUpdate )
     {
         SharcHitData sharcHitData;
         sharcHitData.positionWorld = GetGlobalPos( geometryProps.X );
@@ -115,7 +141,7 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
         sharcHitData.emissive = materialProps.Lemi;
 
         SharcSetThroughput( sharcState, 1.0 );
-        SharcUpdateHit( sharcParams, sharcState, sharcHitData, L, 1.0 ); // 0 bounce => no cache resampling => always returns "true"
+        SharcUpdateHitAndActivate( sharcParams, sharcState, sharcHitData, L, 1.0 ); // 0 bounce => no cache resampling => always returns "true"
     }
 
     // Secondary
@@ -163,12 +189,12 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
         }
 
         // Update
-        if( mode != PREV )
+        if( isSharcUpdate )
             SharcSetThroughput( sharcState, throughput );
 
         if( geometryProps.IsMiss( ) )
         {
-            if( mode != PREV )
+            if( isSharcUpdate )
                 SharcUpdateMiss( sharcParams, sharcState, materialProps.Lemi );
 
             bounceNum = 1; // aka "break"
@@ -192,7 +218,7 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
                 gradientData.x += l * pathThroughput;
             }
 
-            if( mode != PREV )
+            if( isSharcUpdate )
             {
                 SharcHitData sharcHitData;
                 sharcHitData.positionWorld = GetGlobalPos( geometryProps.X );
@@ -201,7 +227,7 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
                 sharcHitData.emissive = materialProps.Lemi;
 
                 // This introduces discrepancies with "PREV" if output radiance includes more than 1 bounce lighting
-                bool continueTracing = SharcUpdateHit( sharcParams, sharcState, sharcHitData, L, Rng::Hash::GetFloat( ) );
+                bool continueTracing = SharcUpdateHitAndActivate( sharcParams, sharcState, sharcHitData, L, Rng::Hash::GetFloat( ) );
                 if( !continueTracing )
                     bounceNum = 1; // aka "break"
             }
@@ -220,22 +246,36 @@ float4 Trace( uint2 pixelPos, compiletime int mode )
 }
 
 [numthreads( 16, 16, 1 )]
-void main( uint2 pixelPos : SV_DispatchThreadID )
+void main( uint2 pixelPos : SV_DispatchThreadID, uint2 groupId : SV_GroupID )
 {
+    // Reset the active list of the next frame ( consumed by the previous "SharcResolve" ), the current "SharcResolve" carries alive entries into it
+    if( all( pixelPos == 0 ) )
+    {
+        uint args = ( ( gFrameIndex + 1 ) & 0x1 ) * SHARC_ACTIVE_ARGS_STRIDE;
+
+        [unroll]
+        for( uint i = 0; i < SHARC_ACTIVE_ARGS_STRIDE; i++ )
+            gInOut_SharcActiveArgs[ args + i ] = 0;
+    }
+
     // Current gradient data
     Rng::Hash::Initialize( pixelPos, gFrameIndex );
 
-    float16_t4 gradientCurr = ( float16_t4 )Trace( pixelPos, CURR );
+    // Gradients are traced every frame ( history confidence doesn't depend on amortization ), SHARC is updated only in selected tiles
+    bool isSharcUpdate = IsSharcUpdateTile( groupId );
+
+    float16_t4 gradientCurr = ( float16_t4 )Trace( pixelPos, CURR, isSharcUpdate );
     gOut_CurrGradient[ pixelPos ] = gradientCurr; // will be "gIn_PrevGradient" in the next frame
 
     // ( Optional ) "Reach" potentially new areas visible through glass
-    Trace( pixelPos, FULL );
+    if( isSharcUpdate )
+        Trace( pixelPos, FULL, true );
 
     // Previous gradient data
     // It's important to use FP16 for calculations to avoid imprecision issues, because "stored" data comes from an FP16 texture
     Rng::Hash::Initialize( pixelPos, gFrameIndex - 1 );
 
-    float16_t4 prevGradient = ( float16_t4 )Trace( pixelPos, PREV ); // no SHARC update
+    float16_t4 prevGradient = ( float16_t4 )Trace( pixelPos, PREV, false ); // no SHARC update
     float16_t4 prevGradientStored = ( float16_t4 )gIn_PrevGradient[ pixelPos ];
 
     // Irradiance gradient: it includes materials, i.e can be normalized to the blurred final HDR image
@@ -120,7 +120,7 @@
 #define PT_RAY_FLAGS                        0
 
 // Spatial HAsh-based Radiance Cache ( SHARC )
-#define SHARC_CAPACITY                      ( 1 << 22 )
+#define SHARC_CAPACITY                      ( 1 << 22 ) // max, the actual capacity is "gSharcCapacity"
 #define SHARC_SCENE_SCALE                   45.0
 #define SHARC_DOWNSCALE                     5
 #define SHARC_RESPONSIVE_FRAME_NUM          32
@@ -133,6 +133,22 @@
 #define SHARC_PROPAGATION_DEPTH             4 // new version use 2, it looks worse
 #define SHARC_ENABLE_RESPONSIVE_LIGHTING    0 // TODO: hook up
 
+// SHARC telemetry counters ( "SharcStats" )
+#define SHARC_STAT_OCCUPIED                 0
+#define SHARC_STAT_UPDATED                  1 // in the current frame
+#define SHARC_STAT_INSERTED                 2 // in the current frame
+#define SHARC_STAT_DISPLACED                3 // not in the home slot ( hash collision )
+#define SHARC_STAT_FULL_BUCKETS             4 // no free slots, insertions fail
+#define SHARC_STAT_BUCKETS                  5
+#define SHARC_STAT_MISPLACED                6 // debug: outside of the probed range of the home slot, must be 0
+#define SHARC_STAT_NUM                      7
+
+// SHARC active list: "SharcResolve" only processes entries touched by "SharcUpdate" or still alive after the previous resolve
+// "SharcActiveEntries" = per entry frame stamps, then 2 lists ( ping-pong by frame parity ) of entry indices, "gSharcCapacity" each
+// "SharcActiveArgs" = per list { dispatch group num ( x, y, z ), entry num }
+#define SHARC_ACTIVE_ARGS_STRIDE            4
+#define SHARC_ACTIVE_ARGS_ENTRY_NUM         3
+
 // Blue noise
 #define BLUE_NOISE_SPATIAL_DIM              128 // see StaticTexture::ScramblingRanking
 
@@ -277,11 +293,25 @@ NRI_RESOURCE( cbuffer, GlobalConstants, b, 0, SET_ROOT )
     uint32_t gPSR;
     uint32_t gSHARC;
     uint32_t gTrimLobe;
+    uint32_t gSharcCapacity;
+    uint32_t gSharcUpdatePeriod; // frames, 1 - no amortization
     float gMinProbability;
 };
 
 #if( !defined( __cplusplus ) )
 
+// Tracing settings baked into hot permutations ( see "TraceOpaque*.cs.hlsl" ). The host must pick
+// a specialized pipeline only if the values in "GlobalConstants" match
+#if( defined( SPECIALIZED_TRACING_MODE ) )
+    #define gTracingMode                                SPECIALIZED_TRACING_MODE
+    #define gSampleNum                                  SPECIALIZED_SAMPLE_NUM
+    #define gBounceNum                                  SPECIALIZED_BOUNCE_NUM
+    #define gPSR                                        SPECIALIZED_PSR
+    #define gSHARC                                      SPECIALIZED_SHARC
+    #define gTrimLobe                                   SPECIALIZED_TRIM_LOBE
+    #define gDisableShadowsAndEnableImportanceSampling  SPECIALIZED_IMPORTANCE_SAMPLING
+#endif
+
 #include "ml.hlsli"
 #include "NRD.hlsli"
 
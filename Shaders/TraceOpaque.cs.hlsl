@@ -128,7 +128,7 @@ TraceOpaqueResult TraceOpaque( GeometryProps geometryProps0, MaterialProps mater
     sharcHitData.emissive = materialProps.Lemi;
 
     HashGridData hashGridData;
-    hashGridData.capacity = SHARC_CAPACITY;
+    hashGridData.capacity = gSharcCapacity;
     hashGridData.hashEntriesBuffer = gInOut_SharcHashEntriesBuffer;
 
     SharcParameters sharcParams;
@@ -323,7 +323,7 @@ for( uint path = 0; path < pathNum; path++ )
                 sharcHitData.emissive = materialProps.Lemi;
 
                 HashGridData hashGridData;
-                hashGridData.capacity = SHARC_CAPACITY;
+                hashGridData.capacity = gSharcCapacity;
                 hashGridData.hashEntriesBuffer = gInOut_SharcHashEntriesBuffer;
 
                 SharcParameters sharcParams;
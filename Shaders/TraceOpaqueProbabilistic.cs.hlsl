@@ -0,0 +1,12 @@
+// © 2022 NVIDIA Corporation
+
+// "TraceOpaque" specialized for: probabilistic, 1 rpp, 1 bounce, SHARC, no PSR, trimmed lobe, no IS ( the default for RR )
+#define SPECIALIZED_TRACING_MODE            RESOLUTION_FULL_PROBABILISTIC
+#define SPECIALIZED_SAMPLE_NUM              1
+#define SPECIALIZED_BOUNCE_NUM              1
+#define SPECIALIZED_PSR                     0
+#define SPECIALIZED_SHARC                   1
+#define SPECIALIZED_TRIM_LOBE               1
+#define SPECIALIZED_IMPORTANCE_SAMPLING     0
+
+#include "TraceOpaque.cs.hlsl"
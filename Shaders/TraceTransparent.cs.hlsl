@@ -124,7 +124,7 @@ float3 TraceTransparent( TraceTransparentDesc desc )
         sharcHitData.emissive = materialProps.Lemi;
 
         HashGridData hashGridData;
-        hashGridData.capacity = SHARC_CAPACITY;
+        hashGridData.capacity = gSharcCapacity;
         hashGridData.hashEntriesBuffer = gInOut_SharcHashEntriesBuffer;
 
         SharcParameters sharcParams;
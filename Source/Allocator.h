@@ -0,0 +1,229 @@
+// © 2022 NVIDIA Corporation
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "NRI.h"
+
+// Tracking allocator behind "nri::AllocationCallbacks" (NRD callbacks have the same layout). Each tag has its own callbacks
+// ("userArg" points to the tag context), statistics are gathered per tag. Blocks up to "MAX_POOLED_SIZE" come from per size
+// class free lists: freed blocks are reused and return to the upstream allocator only in the destructor, i.e. a client freeing
+// and allocating similar sizes every frame doesn't reach the upstream allocator after warm-up. Bigger blocks go straight to
+// the upstream allocator ("malloc", if not provided). Thread safe
+
+enum class AllocationTag : uint8_t {
+    NRI,
+    NRD,
+
+    MAX_NUM
+};
+
+constexpr const char* g_AllocationTagNames[] = {
+    "NRI",
+    "NRD",
+};
+static_assert(sizeof(g_AllocationTagNames) / sizeof(g_AllocationTagNames[0]) == (size_t)AllocationTag::MAX_NUM, "Outdated allocation tag names");
+
+struct AllocationStats {
+    uint64_t liveBytes;
+    uint64_t peakBytes;
+    uint64_t allocationNum;              // in total
+    uint32_t frameAllocationNum;         // in the previous frame
+    uint32_t frameUpstreamAllocationNum; // in the previous frame, not served by the pools
+};
+
+class TrackingAllocator {
+public:
+    static constexpr size_t MIN_POOLED_SIZE = 64;
+    static constexpr uint8_t SIZE_CLASS_NUM = 8;
+    static constexpr size_t MAX_POOLED_SIZE = MIN_POOLED_SIZE << (SIZE_CLASS_NUM - 1); // 8 Kb
+    static constexpr size_t UPSTREAM_ALIGNMENT = 16;
+
+    TrackingAllocator() {
+        for (size_t i = 0; i < m_Contexts.size(); i++)
+            m_Contexts[i] = {this, (AllocationTag)i};
+    }
+
+    ~TrackingAllocator() {
+        for (void*& block : m_FreeLists) {
+            while (block) {
+                void* next = *(void**)block;
+                m_Upstream.Free(m_Upstream.userArg, block);
+                block = next;
+            }
+        }
+    }
+
+    TrackingAllocator(const TrackingAllocator&) = delete;
+    TrackingAllocator& operator=(const TrackingAllocator&) = delete;
+
+    // Must be called before the first allocation
+    void SetUpstream(const nri::AllocationCallbacks& upstream) {
+        if (upstream.Allocate) {
+            m_Upstream.Allocate = upstream.Allocate;
+            m_Upstream.Free = upstream.Free;
+            m_Upstream.userArg = upstream.userArg;
+        }
+    }
+
+    nri::AllocationCallbacks GetCallbacks(AllocationTag tag) {
+        nri::AllocationCallbacks callbacks = {};
+        callbacks.Allocate = Allocate;
+        callbacks.Reallocate = Reallocate;
+        callbacks.Free = Free;
+        callbacks.userArg = &m_Contexts[(size_t)tag];
+
+        return callbacks;
+    }
+
+    // Closes the current frame for "frameAllocationNum" and "frameUpstreamAllocationNum"
+    void BeginFrame() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        for (size_t i = 0; i < m_Stats.size(); i++) {
+            m_Stats[i].frameAllocationNum = m_FrameAllocationNums[i];
+            m_Stats[i].frameUpstreamAllocationNum = m_FrameUpstreamAllocationNums[i];
+            m_FrameAllocationNums[i] = 0;
+            m_FrameUpstreamAllocationNums[i] = 0;
+        }
+    }
+
+    AllocationStats GetStats(AllocationTag tag) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        return m_Stats[(size_t)tag];
+    }
+
+private:
+    struct Context {
+        TrackingAllocator* allocator;
+        AllocationTag tag;
+    };
+
+    struct Header {
+        uint64_t size;     // requested
+        uint32_t offset;   // from the beginning of the block
+        uint8_t sizeClass; // "SIZE_CLASS_NUM" if not pooled
+        AllocationTag tag;
+    };
+
+    static void* Allocate(void* userArg, size_t size, size_t alignment) {
+        const Context* context = (Context*)userArg;
+
+        return context->allocator->AllocateTagged(size, alignment, context->tag);
+    }
+
+    static void* Reallocate(void* userArg, void* memory, size_t size, size_t alignment) {
+        const Context* context = (Context*)userArg;
+        if (!memory)
+            return context->allocator->AllocateTagged(size, alignment, context->tag);
+
+        void* newMemory = context->allocator->AllocateTagged(size, alignment, context->tag);
+        if (newMemory) {
+            const Header* header = (Header*)memory - 1;
+            memcpy(newMemory, memory, std::min(size, (size_t)header->size));
+
+            context->allocator->FreeTagged(memory);
+        }
+
+        return newMemory;
+    }
+
+    static void Free(void*, void* memory) {
+        if (!memory)
+            return;
+
+        const Header* header = (Header*)memory - 1;
+        TrackingAllocator* allocator = nullptr;
+        memcpy(&allocator, (uint8_t*)header - header->offset, sizeof(allocator));
+
+        allocator->FreeTagged(memory);
+    }
+
+    static void* DefaultAllocate(void*, size_t size, size_t) {
+        return malloc(size);
+    }
+
+    static void DefaultFree(void*, void* memory) {
+        free(memory);
+    }
+
+    void* AllocateTagged(size_t size, size_t alignment, AllocationTag tag) {
+        // Block: owner, padding, header, memory
+        alignment = std::max(alignment, alignof(Header));
+        size_t blockSize = sizeof(TrackingAllocator*) + sizeof(Header) + alignment - 1 + size;
+
+        uint8_t sizeClass = 0;
+        while (sizeClass < SIZE_CLASS_NUM && (MIN_POOLED_SIZE << sizeClass) < blockSize)
+            sizeClass++;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        uint8_t* block = nullptr;
+        if (sizeClass < SIZE_CLASS_NUM && m_FreeLists[sizeClass]) {
+            block = (uint8_t*)m_FreeLists[sizeClass];
+            m_FreeLists[sizeClass] = *(void**)block;
+        } else {
+            block = (uint8_t*)m_Upstream.Allocate(m_Upstream.userArg, sizeClass < SIZE_CLASS_NUM ? MIN_POOLED_SIZE << sizeClass : blockSize, UPSTREAM_ALIGNMENT);
+            if (!block)
+                return nullptr;
+
+            m_FrameUpstreamAllocationNums[(size_t)tag]++;
+        }
+
+        TrackingAllocator* self = this;
+        memcpy(block, &self, sizeof(self));
+
+        uintptr_t memory = ((uintptr_t)block + sizeof(TrackingAllocator*) + sizeof(Header) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+        Header* header = (Header*)memory - 1;
+        header->size = size;
+        header->offset = (uint32_t)((uintptr_t)header - (uintptr_t)block);
+        header->sizeClass = sizeClass;
+        header->tag = tag;
+
+        AllocationStats& stats = m_Stats[(size_t)tag];
+        stats.liveBytes += size;
+        stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+        stats.allocationNum++;
+        m_FrameAllocationNums[(size_t)tag]++;
+
+        return (void*)memory;
+    }
+
+    void FreeTagged(void* memory) {
+        const Header* header = (Header*)memory - 1;
+        uint8_t* block = (uint8_t*)header - header->offset;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        m_Stats[(size_t)header->tag].liveBytes -= header->size;
+
+        if (header->sizeClass < SIZE_CLASS_NUM) {
+            *(void**)block = m_FreeLists[header->sizeClass];
+            m_FreeLists[header->sizeClass] = block;
+        } else
+            m_Upstream.Free(m_Upstream.userArg, block);
+    }
+
+private:
+    struct Upstream {
+        void* (*Allocate)(void* userArg, size_t size, size_t alignment);
+        void (*Free)(void* userArg, void* memory);
+        void* userArg;
+    };
+
+    Upstream m_Upstream = {DefaultAllocate, DefaultFree, nullptr};
+    std::mutex m_Mutex;
+    std::array<Context, (size_t)AllocationTag::MAX_NUM> m_Contexts = {};
+    std::array<AllocationStats, (size_t)AllocationTag::MAX_NUM> m_Stats = {};
+    std::array<uint32_t, (size_t)AllocationTag::MAX_NUM> m_FrameAllocationNums = {};
+    std::array<uint32_t, (size_t)AllocationTag::MAX_NUM> m_FrameUpstreamAllocationNums = {};
+    std::array<void*, SIZE_CLASS_NUM> m_FreeLists = {};
+};
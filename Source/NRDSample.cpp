@@ -9,9 +9,22 @@
 #include "NRD.h"
 #include "NRDIntegration.hpp"
 
+#include "Allocator.h"
+#include "RenderGraph.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <thread>
+
 #ifdef _WIN32
 #    undef APIENTRY
 #    include <windows.h> // SetForegroundWindow, GetConsoleWindow
+#    include <timeapi.h> // timeBeginPeriod, timeEndPeriod
 #endif
 
 //=================================================================================
@@ -37,13 +50,13 @@ constexpr uint8_t DLSS_PRESET = 13; // preset M(13) (expensive, correct specular
 constexpr nri::UpscalerType upscalerType = nri::UpscalerType::DLSR;
 constexpr int32_t MAX_HISTORY_FRAME_NUM = (int32_t)std::min(60u, std::min(nrd::REBLUR_MAX_HISTORY_FRAME_NUM, nrd::RELAX_MAX_HISTORY_FRAME_NUM));
 constexpr uint32_t TEXTURES_PER_MATERIAL = 4;
-constexpr uint32_t MAX_TEXTURE_TRANSITIONS_NUM = 32;
 constexpr uint32_t DYNAMIC_CONSTANT_BUFFER_SIZE = 1024 * 1024; // 1MB
 constexpr bool NRD_ENABLE_WHOLE_LIFETIME_DESCRIPTOR_CACHING = true;
 constexpr bool NRD_RESTORE_INITIAL_STATE = false;
 constexpr bool NRD_USE_AUTO_WRAPPER = false;
 constexpr bool NRD_PROMOTE_FLOAT16_TO_32 = false;
 constexpr bool NRD_DEMOTE_FLOAT32_TO_16 = false;
+constexpr uint32_t ALLOCATION_WARMUP_FRAME_NUM = 64; // frames after a workload change, which are allowed to allocate
 
 #if (SIGMA_TRANSLUCENCY == 1)
 #    define SIGMA_VARIANT nrd::Denoiser::SIGMA_SHADOW_TRANSLUCENCY
@@ -109,6 +122,10 @@ enum class Buffer : uint32_t {
     SharcHashEntries,
     SharcAccumulated,
     SharcResolved,
+    SharcStats,
+    SharcActiveEntries,
+    SharcActiveArgs,
+    SharcResolveArgs,
     WorldScratch,
     LightScratch,
 
@@ -184,9 +201,12 @@ enum class Descriptor : uint32_t {
 
 enum class Pipeline : uint32_t {
     SharcUpdate,
+    SharcStats,
     SharcResolve,
     ConfidenceBlur,
     TraceOpaque,
+    TraceOpaqueProbabilistic,
+    TraceOpaqueHalf,
     Composition,
     TraceTransparent,
     Taa,
@@ -201,8 +221,7 @@ enum class DescriptorSet : uint32_t {
     // SET_OTHER
     SharcUpdatePing,
     SharcUpdatePong,
-    ConfidenceBlurPing,
-    ConfidenceBlurPong,
+    ConfidenceBlur,
     TraceOpaque,
     Composition,
     TraceTransparent,
@@ -221,13 +240,575 @@ enum class DescriptorSet : uint32_t {
     MAX_NUM
 };
 
+// Passes in "RenderFrame" order
+enum class Pass : uint32_t {
+    SharcUpdate,
+    SharcStats,
+    SharcResolve,
+    ConfidenceBlur,
+    TraceOpaque,
+    ShadowDenoising,
+    OpaqueDenoising,
+    Composition,
+    TraceTransparent,
+    ReferenceAccumulation,
+    DlssBefore,
+    Dlss,
+    DlssAfter,
+    Taa,
+    Nis,
+    Final,
+    CopyToBackBuffer,
+
+    MAX_NUM
+};
+
+constexpr const char* g_PassNames[] = {
+    "SHARC - Update",
+    "SHARC - Stats",
+    "SHARC - Resolve",
+    "Confidence - Blur",
+    "Trace opaque",
+    "Shadow denoising",
+    "Opaque denoising",
+    "Composition",
+    "Trace transparent",
+    "Reference accumulation",
+    "Before DLSS",
+    "DLSS",
+    "After DLSS",
+    "TAA",
+    "NIS",
+    "Final",
+    "Copy to back buffer",
+};
+static_assert(sizeof(g_PassNames) / sizeof(g_PassNames[0]) == (size_t)Pass::MAX_NUM, "Outdated pass names");
+
+// Independently recorded parts of the frame (one command buffer each), submitted in this order
+enum class Stage : uint32_t {
+    Acceleration, // streamer, TLAS
+    Sharc,        // SHARC update & resolve (async compute)
+    Confidence,   // history confidence (async compute)
+    Tracing,      // trace opaque
+    Denoising,    // NRD
+    Post,         // composition, transparency, upscaling, final, copy to back buffer
+
+    MAX_NUM
+};
+
+// Render graph queue index for async compute passes ("0" is the graphics queue)
+constexpr uint32_t ASYNC_COMPUTE_QUEUE = 1;
+
+static inline Stage GetStage(Pass pass) {
+    if (pass < Pass::ConfidenceBlur)
+        return Stage::Sharc;
+    if (pass == Pass::ConfidenceBlur)
+        return Stage::Confidence;
+    if (pass == Pass::TraceOpaque)
+        return Stage::Tracing;
+    if (pass < Pass::Composition)
+        return Stage::Denoising;
+
+    return Stage::Post;
+}
+
+static inline bool IsAsyncComputeStage(Stage stage) {
+    return stage == Stage::Sharc || stage == Stage::Confidence;
+}
+
 // NRD sample doesn't use several instances of the same denoiser in one NRD instance (like REBLUR_DIFFUSE x 3),
 // thus we can use fields of "nrd::Denoiser" enum as unique identifiers
 #define NRD_ID(x) nrd::Identifier(nrd::Denoiser::x)
 
+constexpr uint32_t MAX_OPAQUE_DENOISER_NUM = 2;
+
+// Denoisers used for opaque surfaces by "Settings::denoiser" (REFERENCE accumulates the composed image)
+static inline uint32_t GetOpaqueDenoisers(int32_t denoiser, nrd::Identifier* denoisers) {
+    uint32_t num = 0;
+
+    if (denoiser == DENOISER_REBLUR) {
+#if (NRD_MODE == OCCLUSION)
+#    if (NRD_COMBINED == 1)
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE_SPECULAR_OCCLUSION);
+#    else
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE_OCCLUSION);
+        denoisers[num++] = NRD_ID(REBLUR_SPECULAR_OCCLUSION);
+#    endif
+#elif (NRD_MODE == SH)
+#    if (NRD_COMBINED == 1)
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE_SPECULAR_SH);
+#    else
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE_SH);
+        denoisers[num++] = NRD_ID(REBLUR_SPECULAR_SH);
+#    endif
+#elif (NRD_MODE == DIRECTIONAL_OCCLUSION)
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE_DIRECTIONAL_OCCLUSION);
+#else
+#    if (NRD_COMBINED == 1)
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE_SPECULAR);
+#    else
+        denoisers[num++] = NRD_ID(REBLUR_DIFFUSE);
+        denoisers[num++] = NRD_ID(REBLUR_SPECULAR);
+#    endif
+#endif
+    } else if (denoiser == DENOISER_RELAX) {
+#if (NRD_COMBINED == 1)
+#    if (NRD_MODE == SH)
+        denoisers[num++] = NRD_ID(RELAX_DIFFUSE_SPECULAR_SH);
+#    else
+        denoisers[num++] = NRD_ID(RELAX_DIFFUSE_SPECULAR);
+#    endif
+#else
+#    if (NRD_MODE == SH)
+        denoisers[num++] = NRD_ID(RELAX_DIFFUSE_SH);
+        denoisers[num++] = NRD_ID(RELAX_SPECULAR_SH);
+#    else
+        denoisers[num++] = NRD_ID(RELAX_DIFFUSE);
+        denoisers[num++] = NRD_ID(RELAX_SPECULAR);
+#    endif
+#endif
+    } else
+        denoisers[num++] = NRD_ID(REFERENCE);
+
+    return num;
+}
+
 struct QueuedFrame {
-    nri::CommandAllocator* commandAllocator;
+    std::array<nri::CommandAllocator*, (size_t)Stage::MAX_NUM> stageCommandAllocators;
+    std::array<nri::CommandBuffer*, (size_t)Stage::MAX_NUM> stageCommandBuffers;
+    std::array<nri::CommandAllocator*, (size_t)Stage::MAX_NUM> computeCommandAllocators; // only for async compute stages
+    std::array<nri::CommandBuffer*, (size_t)Stage::MAX_NUM> computeCommandBuffers;
+    nri::CommandAllocator* commandAllocator; // UI
+    nri::CommandBuffer* commandBuffer;
+};
+
+// CPU timestamps of a queued frame (ms), GPU start & end timestamps are resolved into the readback buffer
+struct LatencyMarkers {
+    double input; // input used for the simulation of this frame
+    double submit;
+    double present;
+    float resolutionScale;
+    bool isValid;
+};
+
+enum class LatencyMetric : uint32_t {
+    InputToSubmit,
+    InputToPresent,
+    SubmitToGpuStart,
+    Gpu,
+    InputToGpuEnd, // input-to-photon, excluding scan-out
+    GpuIdle,
+    Denoising, // GPU time of denoising and reference accumulation
+
+    MAX_NUM
+};
+
+constexpr const char* g_LatencyMetricNames[] = {
+    "Input - submit",
+    "Input - present",
+    "Submit - GPU start",
+    "GPU",
+    "Input - GPU end",
+    "GPU idle",
+    "Denoising",
+};
+static_assert(sizeof(g_LatencyMetricNames) / sizeof(g_LatencyMetricNames[0]) == (size_t)LatencyMetric::MAX_NUM, "Outdated latency metric names");
+
+// SHARC telemetry, derived from "SHARC_STAT_X" counters
+enum class SharcMetric : uint32_t {
+    Occupancy,   // % of capacity
+    Stale,       // % of occupied entries, not updated in the frame
+    Collisions,  // % of occupied entries, not in the home slot
+    FullBuckets, // % of buckets, insertions into them fail
+    Insertions,  // per frame
+    Evictions,   // per frame, estimated from occupancy and insertions
+
+    MAX_NUM
+};
+
+constexpr const char* g_SharcMetricNames[] = {
+    "Occupancy, %",
+    "Stale, %",
+    "Collisions, %",
+    "Full buckets, %",
+    "Insertions",
+    "Evictions",
+};
+static_assert(sizeof(g_SharcMetricNames) / sizeof(g_SharcMetricNames[0]) == (size_t)SharcMetric::MAX_NUM, "Outdated SHARC metric names");
+
+// GPU timestamps of a queued frame
+enum class Timestamp : uint32_t {
+    FrameBegin,
+    FrameEnd,
+    DenoisingBegin,
+    DenoisingEnd,
+    ReferenceBegin,
+    ReferenceEnd,
+
+    MAX_NUM
+};
+
+// VRAM ledger: the sample's own long-lived resources ( NRD, DLSS and NIS allocate internally )
+enum class VramCategory : uint8_t {
+    RenderTargets,
+    History,
+    Sharc,
+    SceneTextures,
+    SceneData,
+    AccelerationStructures,
+    Scratch,
+
+    MAX_NUM
+};
+
+constexpr const char* g_VramCategoryNames[] = {
+    "Render targets",
+    "History",
+    "SHARC",
+    "Scene textures",
+    "Scene data",
+    "BLAS/TLAS",
+    "Scratch",
+};
+static_assert(sizeof(g_VramCategoryNames) / sizeof(g_VramCategoryNames[0]) == (size_t)VramCategory::MAX_NUM, "Outdated VRAM category names");
+
+struct VramLedgerEntry {
+    const void* resource;
+    std::string name;
+    uint64_t size;
+    nri::Format format; // UNKNOWN for buffers, memory and acceleration structures
+    const char* heap;
+    VramCategory category;
+    bool isAliased; // lives in the transient heap, which has its own entry
+};
+
+// VRAM budget: degradations are applied in this order until the sample fits
+constexpr uint32_t VRAM_MAX_SCENE_MIP_BIAS = 2;
+constexpr uint32_t VRAM_MIN_SCENE_TEXTURE_SIZE = 256; // top mips are not dropped below this size
+
+// SHARC capacity tiers: "auto" (recommended for the scene), then "SHARC_MIN_CAPACITY << (tier - 1)" entries
+constexpr uint32_t SHARC_MIN_CAPACITY = 1 << 18;
+constexpr uint32_t SHARC_CAPACITY_HEADROOM = 2; // hash table load factor <= 50%, collisions and dynamic objects
+constexpr const char* g_SharcCapacityTierNames[] = {"Auto", "256K", "512K", "1M", "2M", "4M"};
+static_assert((SHARC_MIN_CAPACITY << (sizeof(g_SharcCapacityTierNames) / sizeof(g_SharcCapacityTierNames[0]) - 2)) == SHARC_CAPACITY, "Outdated SHARC capacity tiers");
+
+// SHARC amortization: a fraction of SHARC tiles updated per frame, i.e. the whole grid gets updated in "1 << index" frames
+constexpr const char* g_SharcUpdateFractionNames[] = {"1", "1/2", "1/4"};
+
+// Render resolution presets (heights), matching ".args"
+constexpr uint32_t g_RenderResolutionPresets[] = {600, 720, 1080, 1440, 2160};
+
+constexpr uint32_t TIMING_HISTORY_SIZE = 256;
+constexpr uint32_t LATENCY_CONTROLLER_WINDOW = 16; // frames
+constexpr float LATENCY_GPU_IDLE_MARGIN = 0.2f; // ms
+constexpr double PACING_SPIN_THRESHOLD = 0.5; // ms, minimal spinning time, grows to cover measured OS sleep overshoot
+constexpr uint32_t FRAME_TIME_HISTOGRAM_BIN_NUM = 32;
+constexpr float DRS_BUDGET_HEADROOM = 0.9f; // fraction of the frame time available for the GPU
+constexpr float DRS_SCALE_STEP = 1.0f / 64.0f; // quantization
+constexpr float DRS_HYSTERESIS = 0.05f; // minimal upscale
+constexpr uint32_t DRS_UPSCALE_DELAY = 30; // frames under budget
+constexpr float DRS_MIN_AREA_COST = 1e-3f; // ms, for the full resolution, the cost model is not trusted below
+
+// Tuner: the current settings and their variants, which differ in a single knob value, are rendered for each test and compared against the accumulated REFERENCE
+enum class TunerKnob : uint32_t {
+    Rpp,
+    BounceNum,
+    TracingMode,
+    ResolutionScale,
+    SHARC,
+    PSR,
+    ImportanceSampling,
+    MaxAccumulatedFrameNum,
+
+    MAX_NUM
+};
+
+constexpr const char* g_TunerKnobNames[] = {
+    "rpp",
+    "bounces",
+    "tracing",
+    "scale",
+    "SHARC",
+    "PSR",
+    "IS",
+    "history",
+};
+static_assert(sizeof(g_TunerKnobNames) / sizeof(g_TunerKnobNames[0]) == (size_t)TunerKnob::MAX_NUM, "Outdated tuner knob names");
+
+constexpr uint32_t TUNER_KNOB_MAX_VALUE_NUM = 3;
+
+struct TunerKnobValues {
+    float values[TUNER_KNOB_MAX_VALUE_NUM];
+    uint32_t num;
+};
+
+constexpr TunerKnobValues g_TunerKnobValues[] = {
+    {{1.0f, 2.0f}, 2},                                                     // rpp
+    {{1.0f, 2.0f}, 2},                                                     // bounces
+    {{RESOLUTION_FULL, RESOLUTION_FULL_PROBABILISTIC, RESOLUTION_HALF}, 3}, // tracing
+    {{1.0f, 0.67f}, 2},                                                    // scale
+    {{0.0f, 1.0f}, 2},                                                     // SHARC
+    {{0.0f, 1.0f}, 2},                                                     // PSR
+    {{0.0f, 1.0f}, 2},                                                     // IS
+    {{30.0f, 60.0f}, 2},                                                   // history
+};
+static_assert(sizeof(g_TunerKnobValues) / sizeof(g_TunerKnobValues[0]) == (size_t)TunerKnob::MAX_NUM, "Outdated tuner knob values");
+
+// Knob values of a rendered variant
+typedef std::array<float, (size_t)TunerKnob::MAX_NUM> TunerCombination;
+
+enum class TunerMode : uint8_t {
+    Sweep,       // quality / performance of tracing settings
+    Convergence, // frames to converge after a history reset
+    DenoiserCost // GPU time, memory and dispatches per denoiser
+};
+
+enum class TunerState : uint8_t {
+    Idle,
+
+    // Sweep
+    Reference, // accumulate the reference image of the current test
+    Sweep,     // render all combinations of the current test
+
+    // Convergence
+    Settle,   // converge the current variant to get its own reference image
+    Converge, // reset history and count frames until the error is low enough
+
+    // Denoiser cost
+    Measure // warm up and measure the current denoiser
+};
+
+struct TunerResult {
+    double gpuTime;          // ms, sum over tests
+    double denoisingTime;    // ms, sum over tests
+    double mse;              // sum over tests
+    uint32_t frameNum;       // frames to converge, sum over tests
+    uint32_t maxFrameNum;    // frames to converge, the worst test
+    uint32_t unconvergedNum; // tests
+};
+
+// Convergence after a history reset
+struct ConvergenceVariant {
+    const char* name;
+    int32_t denoiser;
+    int32_t maxFastAccumulatedFrameNum;
+    bool confidence;
+};
+
+constexpr ConvergenceVariant g_ConvergenceVariants[] = {
+    {"REBLUR", DENOISER_REBLUR, 6, true},
+    {"REBLUR, fast history 2", DENOISER_REBLUR, 2, true},
+    {"REBLUR, no confidence", DENOISER_REBLUR, 6, false},
+    {"RELAX", DENOISER_RELAX, 6, true},
+    {"RELAX, fast history 2", DENOISER_RELAX, 2, true},
+    {"RELAX, no confidence", DENOISER_RELAX, 6, false},
+};
+
+// Denoiser cost
+constexpr int32_t g_CostDenoisers[] = {
+    DENOISER_REBLUR,
+#if (NRD_MODE != OCCLUSION && NRD_MODE != DIRECTIONAL_OCCLUSION)
+    DENOISER_RELAX,
+#endif
+    DENOISER_REFERENCE,
+};
+
+constexpr uint32_t TUNER_CONVERGENCE_MAX_FRAME_NUM = 128;
+constexpr double TUNER_CONVERGENCE_PSNR = 40.0; // dB
+
+constexpr float g_TunerBudgets[] = {4.0f, 8.0f, 16.7f, 33.3f}; // ms
+constexpr uint32_t TUNER_REFERENCE_FRAME_NUM = 256;
+constexpr uint32_t TUNER_WARMUP_FRAME_NUM = 8; // on top of "maxAccumulatedFrameNum"
+constexpr uint32_t TUNER_MEASURE_FRAME_NUM = 16;
+
+static inline float GetTunerKnobMax(TunerKnob knob) {
+    const TunerKnobValues& knobValues = g_TunerKnobValues[(uint32_t)knob];
+
+    float value = knobValues.values[0];
+    for (uint32_t i = 1; i < knobValues.num; i++)
+        value = std::max(value, knobValues.values[i]);
+
+    return value;
+}
+
+static inline float HalfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h >> 15) << 31;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0x1F) // inf / nan
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else if (exponent != 0) // normal
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa != 0) { // denormal
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    } else
+        bits = sign;
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+
+    return f;
+}
+
+// Process exit code, overrides the one returned by "SAMPLE_MAIN" unless "-1" (see "main")
+static int32_t g_ExitCode = -1;
+
+// Heap allocation counter: global "operator new" and ImGui (NRI and NRD go through "TrackingAllocator")
+static std::atomic<uint64_t> g_HeapAllocationNum = 0;
+
+void* operator new(size_t size) {
+    g_HeapAllocationNum.fetch_add(1, std::memory_order_relaxed);
+
+    void* memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    g_HeapAllocationNum.fetch_add(1, std::memory_order_relaxed);
+
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+static inline void* AlignedAllocate(size_t size, size_t alignment) {
+    size = helper::Align(size ? size : 1, alignment);
+
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    return aligned_alloc(alignment, size);
+#endif
+}
+
+static inline void AlignedFree(void* memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    g_HeapAllocationNum.fetch_add(1, std::memory_order_relaxed);
+
+    void* memory = AlignedAllocate(size, (size_t)alignment);
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    g_HeapAllocationNum.fetch_add(1, std::memory_order_relaxed);
+
+    return AlignedAllocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+    return operator new(size, alignment, tag);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    AlignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    AlignedFree(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    AlignedFree(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+    AlignedFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    AlignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    AlignedFree(memory);
+}
+
+static void* ImGuiAllocate(size_t size, void*) {
+    g_HeapAllocationNum.fetch_add(1, std::memory_order_relaxed);
+
+    return malloc(size);
+}
+
+static void ImGuiFree(void* memory, void*) {
+    free(memory);
+}
+
+static inline float GetPercentile(const std::array<float, TIMING_HISTORY_SIZE>& values, uint32_t num, float percentile) {
+    if (num == 0)
+        return 0.0f;
+
+    std::array<float, TIMING_HISTORY_SIZE> sorted;
+    std::copy(values.begin(), values.begin() + num, sorted.begin());
+
+    uint32_t n = std::min(uint32_t(percentile * num), num - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.begin() + num);
+
+    return sorted[n];
+}
+
+// Stages are recorded in parallel, thus each stage tracks resource states on its own, starting from states predicted by the render graph
+struct StageContext {
+    std::vector<nri::TextureBarrierDesc> textureStates;
+    std::array<nri::AccessBits, (size_t)Buffer::MAX_NUM> bufferStates;
     nri::CommandBuffer* commandBuffer;
+    const RenderGraphPass* externalPass; // the current pass, if its barriers are not managed by the graph
+    uint32_t passCursor;
+    uint32_t barrierNum;
+    uint32_t barrierFlushNum;
 };
 
 struct Settings {
@@ -296,11 +877,99 @@ struct Settings {
     bool confidence = true;
 };
 
-struct TextureState {
-    Texture texture;
-    nri::AccessLayoutStage after;
+// Simulation (camera, animation, instance gathering) can run one frame ahead on a worker thread. It reads a snapshot of
+// the main thread state and writes results into a separate snapshot, which is applied to the main thread state later
+struct SimulationInput {
+    Settings settings;
+    Settings settingsPrev;
+    Camera camera;
+    CameraDesc cameraDesc;
+    double timeStamp;
+    float frameTime;
+    uint32_t frameIndex;
+    bool glassObjects;
+};
+
+struct FrameSnapshot {
+    Settings settings;
+    Camera camera;
+    std::vector<InstanceData> instanceData;
+    std::vector<nri::TopLevelInstance> worldTlasData;
+    std::vector<nri::TopLevelInstance> lightTlasData;
+    double inputTimeStamp;
+};
+
+// Textures, which are fully overwritten every frame before use and don't carry history. They live in one
+// transient heap and share memory if their lifetimes ( derived from accesses declared in "BuildRenderGraph" ) don't overlap
+constexpr Texture g_TransientTextures[] = {
+    Texture::DirectLighting,
+    Texture::DirectEmission,
+    Texture::Unfiltered_Penumbra,
+    Texture::Unfiltered_Translucency,
+    Texture::Unfiltered_Diff,
+    Texture::Unfiltered_Spec,
+#if (NRD_MODE == SH)
+    Texture::Unfiltered_DiffSh,
+    Texture::Unfiltered_SpecSh,
+#endif
+    Texture::Composed,
+    Texture::PreFinal,
+    Texture::Final,
 };
 
+static inline bool IsTransient(Texture texture) {
+    for (Texture transientTexture : g_TransientTextures) {
+        if (transientTexture == texture)
+            return true;
+    }
+
+    return false;
+}
+
+static inline VramCategory GetVramCategory(Texture texture) {
+    if (texture >= Texture::BaseReadOnlyTexture)
+        return VramCategory::SceneTextures;
+
+    switch (texture) {
+        case Texture::Gradient_StoredPing:
+        case Texture::Gradient_StoredPong:
+        case Texture::ComposedDiff:
+        case Texture::ComposedSpec_ViewZ:
+        case Texture::TaaHistoryPing:
+        case Texture::TaaHistoryPong:
+            return VramCategory::History;
+        default:
+            return VramCategory::RenderTargets;
+    }
+}
+
+static inline VramCategory GetVramCategory(Buffer buffer) {
+    switch (buffer) {
+        case Buffer::SharcHashEntries:
+        case Buffer::SharcAccumulated:
+        case Buffer::SharcResolved:
+        case Buffer::SharcStats:
+        case Buffer::SharcActiveEntries:
+        case Buffer::SharcActiveArgs:
+        case Buffer::SharcResolveArgs:
+            return VramCategory::Sharc;
+        case Buffer::WorldScratch:
+        case Buffer::LightScratch:
+            return VramCategory::Scratch;
+        default:
+            return VramCategory::SceneData;
+    }
+}
+
+// Render graph resources: textures with states, followed by buffers
+static inline uint32_t GetResource(Texture texture) {
+    return (uint32_t)texture;
+}
+
+static inline uint32_t GetResource(Buffer buffer) {
+    return (uint32_t)Texture::BaseReadOnlyTexture + (uint32_t)buffer;
+}
+
 struct AnimatedInstance {
     float3 basePosition;
     float3 rotationAxis;
@@ -353,6 +1022,9 @@ static inline nri::TextureBarrierDesc TextureBarrierFromState(nri::TextureBarrie
 class Sample : public SampleBase {
 public:
     inline Sample() {
+#ifdef _WIN32
+        timeBeginPeriod(1); // default timer granularity is ~15.6 ms, too coarse for "WaitUntil"
+#endif
     }
 
     ~Sample();
@@ -365,6 +1037,10 @@ public:
         return m_Settings.SR || m_Settings.RR;
     }
 
+    inline bool IsAsyncComputeEnabled() const {
+        return m_AsyncCompute && m_ComputeQueue;
+    }
+
     inline nri::Texture*& Get(Texture index) {
         return m_Textures[(uint32_t)index];
     }
@@ -413,8 +1089,8 @@ public:
         return m_Descriptors[(uint32_t)Descriptor::BaseReadOnlyTexture + index];
     }
 
-    inline nrd::Resource GetNrdResource(Texture index) {
-        nri::TextureBarrierDesc* textureState = &m_TextureStates[(uint32_t)index];
+    inline nrd::Resource GetNrdResource(StageContext& context, Texture index) {
+        nri::TextureBarrierDesc* textureState = &context.textureStates[(uint32_t)index];
 
         nrd::Resource resource = {};
         resource.state = textureState->after;
@@ -437,67 +1113,69 @@ public:
         return resource;
     }
 
-    inline void Denoise(const nrd::Identifier* denoisers, uint32_t denoiserNum, nri::CommandBuffer& commandBuffer) {
+    inline void Denoise(const nrd::Identifier* denoisers, uint32_t denoiserNum, StageContext& context) {
+        nri::CommandBuffer& commandBuffer = *context.commandBuffer;
+
         // Fill resource snapshot
         nrd::ResourceSnapshot resourceSnapshot = {};
         {
             resourceSnapshot.restoreInitialState = NRD_RESTORE_INITIAL_STATE;
 
             // Common
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_MV, GetNrdResource(Texture::Mv));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_NORMAL_ROUGHNESS, GetNrdResource(Texture::Normal_Roughness));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_VIEWZ, GetNrdResource(Texture::ViewZ));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_MV, GetNrdResource(context, Texture::Mv));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_NORMAL_ROUGHNESS, GetNrdResource(context, Texture::Normal_Roughness));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_VIEWZ, GetNrdResource(context, Texture::ViewZ));
 
             // (Optional) Validation
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_VALIDATION, GetNrdResource(Texture::Validation));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_VALIDATION, GetNrdResource(context, Texture::Validation));
 
             // Diffuse
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_RADIANCE_HITDIST, GetNrdResource(Texture::Unfiltered_Diff));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_RADIANCE_HITDIST, GetNrdResource(Texture::Diff));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_CONFIDENCE, GetNrdResource(Texture::Gradient_Pong));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_RADIANCE_HITDIST, GetNrdResource(context, Texture::Unfiltered_Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_RADIANCE_HITDIST, GetNrdResource(context, Texture::Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_CONFIDENCE, GetNrdResource(context, Texture::Gradient_Pong));
 
             // Specular
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_RADIANCE_HITDIST, GetNrdResource(Texture::Unfiltered_Spec));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_RADIANCE_HITDIST, GetNrdResource(Texture::Spec));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_CONFIDENCE, GetNrdResource(Texture::Gradient_Pong));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_RADIANCE_HITDIST, GetNrdResource(context, Texture::Unfiltered_Spec));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_RADIANCE_HITDIST, GetNrdResource(context, Texture::Spec));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_CONFIDENCE, GetNrdResource(context, Texture::Gradient_Pong));
 
 #if (NRD_MODE == SH)
             // Diffuse SH
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_SH0, GetNrdResource(Texture::Unfiltered_Diff));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_SH1, GetNrdResource(Texture::Unfiltered_DiffSh));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_SH0, GetNrdResource(Texture::Diff));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_SH1, GetNrdResource(Texture::DiffSh));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_SH0, GetNrdResource(context, Texture::Unfiltered_Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_SH1, GetNrdResource(context, Texture::Unfiltered_DiffSh));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_SH0, GetNrdResource(context, Texture::Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_SH1, GetNrdResource(context, Texture::DiffSh));
 
             // Specular SH
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_SH0, GetNrdResource(Texture::Unfiltered_Spec));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_SH1, GetNrdResource(Texture::Unfiltered_SpecSh));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_SH0, GetNrdResource(Texture::Spec));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_SH1, GetNrdResource(Texture::SpecSh));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_SH0, GetNrdResource(context, Texture::Unfiltered_Spec));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_SH1, GetNrdResource(context, Texture::Unfiltered_SpecSh));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_SH0, GetNrdResource(context, Texture::Spec));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_SH1, GetNrdResource(context, Texture::SpecSh));
 #endif
 
             // SIGMA
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_PENUMBRA, GetNrdResource(Texture::Unfiltered_Penumbra));
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_TRANSLUCENCY, GetNrdResource(Texture::Unfiltered_Translucency));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SHADOW_TRANSLUCENCY, GetNrdResource(Texture::Shadow));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_PENUMBRA, GetNrdResource(context, Texture::Unfiltered_Penumbra));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_TRANSLUCENCY, GetNrdResource(context, Texture::Unfiltered_Translucency));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SHADOW_TRANSLUCENCY, GetNrdResource(context, Texture::Shadow));
 
             // REFERENCE
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_SIGNAL, GetNrdResource(Texture::Composed));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SIGNAL, GetNrdResource(Texture::Composed));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_SIGNAL, GetNrdResource(context, Texture::Composed));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SIGNAL, GetNrdResource(context, Texture::Composed));
 
             // Diffuse directional occlusion
 #if (NRD_MODE == DIRECTIONAL_OCCLUSION)
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_DIRECTION_HITDIST, GetNrdResource(Texture::Unfiltered_Diff));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_DIRECTION_HITDIST, GetNrdResource(Texture::Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_DIRECTION_HITDIST, GetNrdResource(context, Texture::Unfiltered_Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_DIRECTION_HITDIST, GetNrdResource(context, Texture::Diff));
 #endif
 
 #if (NRD_MODE == OCCLUSION)
             // Diffuse occlusion
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_HITDIST, GetNrdResource(Texture::Unfiltered_Diff));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_HITDIST, GetNrdResource(Texture::Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_DIFF_HITDIST, GetNrdResource(context, Texture::Unfiltered_Diff));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_DIFF_HITDIST, GetNrdResource(context, Texture::Diff));
 
             // Specular occlusion
-            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_HITDIST, GetNrdResource(Texture::Unfiltered_Spec));
-            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_HITDIST, GetNrdResource(Texture::Spec));
+            resourceSnapshot.SetResource(nrd::ResourceType::IN_SPEC_HITDIST, GetNrdResource(context, Texture::Unfiltered_Spec));
+            resourceSnapshot.SetResource(nrd::ResourceType::OUT_SPEC_HITDIST, GetNrdResource(context, Texture::Spec));
 #endif
         }
 
@@ -528,16 +1206,27 @@ public:
                 state->after = resourceSnapshot.unique[i].state;
             }
         }
+
+        // Bring textures to declared states, other stages rely on them
+        EndExternalPass(context);
     }
 
     inline void InitCmdLine(cmdline::parser& cmdLine) override {
         cmdLine.add<int32_t>("dlssQuality", 'd', "DLSS quality: [-1: 4]", false, -1, cmdline::range(-1, 4));
         cmdLine.add("debugNRD", 0, "enable NRD validation");
+        cmdLine.add("checkAllocations", 0, "report heap allocations in steady-state frames, exit with 1 if any");
+        cmdLine.add<std::string>("nrdMemoryReport", 0, "write NRD memory requirements to a file (.csv or .md) and quit without rendering", false, "");
+        cmdLine.add("sharcTelemetry", 0, "enable SHARC occupancy & collision telemetry");
+        cmdLine.add<uint32_t>("vramBudget", 0, "VRAM budget in Mb, quality is lowered until the sample fits (0 - no budget)", false, 0);
     }
 
     inline void ReadCmdLine(cmdline::parser& cmdLine) override {
         m_DlssQuality = cmdLine.get<int32_t>("dlssQuality");
         m_DebugNRD = cmdLine.exist("debugNRD");
+        m_CheckAllocations = cmdLine.exist("checkAllocations");
+        m_NrdMemoryReport = cmdLine.get<std::string>("nrdMemoryReport");
+        m_VramBudget = cmdLine.get<uint32_t>("vramBudget");
+        m_SharcTelemetry = cmdLine.exist("sharcTelemetry");
     }
 
     inline nrd::RelaxSettings GetDefaultRelaxSettings() const {
@@ -593,12 +1282,58 @@ public:
         return sunDirection;
     }
 
+    inline bool IsSharcTelemetryEnabled() const {
+        return m_SharcTelemetry && m_Settings.SHARC;
+    }
+
+    inline uint64_t GetSharcMemorySize() const {
+        return uint64_t(m_SharcCapacity) * (sizeof(uint64_t) + sizeof(uint32_t) * 4 * 2 + sizeof(uint32_t) * 3); // hash entries, accumulated, resolved, active entries
+    }
+
     inline uint2 GetSharcDims() const {
         return 16 * uint2((m_RenderResolution / SHARC_DOWNSCALE + 15) / 16);
     }
 
+    // Must match "UpdateConstantBuffer" and "SPECIALIZED_*" values in "TraceOpaque*.cs.hlsl"
+    inline Pipeline GetTraceOpaquePipeline() const {
+        if (!m_UseSpecializedShaders)
+            return Pipeline::TraceOpaque;
+
+        uint32_t tracingMode = m_Settings.RR ? RESOLUTION_FULL_PROBABILISTIC : m_Settings.tracingMode;
+        bool isImportanceSampling = GetSunDirection().z < 0.0f && m_Settings.importanceSampling && NRD_MODE < OCCLUSION;
+        bool isHotPath = m_Settings.rpp == 1 && m_Settings.bounceNum == 1 && !m_Settings.PSR && m_Settings.SHARC && m_Settings.specularLobeTrimming && !isImportanceSampling;
+
+        if (isHotPath && tracingMode == RESOLUTION_FULL_PROBABILISTIC)
+            return Pipeline::TraceOpaqueProbabilistic;
+
+        if (isHotPath && tracingMode == RESOLUTION_HALF)
+            return Pipeline::TraceOpaqueHalf;
+
+        return Pipeline::TraceOpaque;
+    }
+
     bool Initialize(nri::GraphicsAPI graphicsAPI, bool) override;
     void LatencySleep(uint32_t frameIndex) override;
+    void ResolveLatency(uint32_t queuedFrameIndex);
+    bool RecreateNrd();
+    bool WriteNrdMemoryReport(const char* path);
+    void UpdateRenderResolution();
+    void ResizeRenderResolution();
+    void WaitUntil(double timeStamp);
+    void PaceFrame();
+    void UpdateDynamicResolution(float gpuTime, float resolutionScale);
+    const std::string& GetTestPath();
+    uint32_t GetTestNum();
+    bool LoadTest(uint32_t test);
+    void StartTuner(TunerMode mode);
+    void FinishTuner(bool isCompleted);
+    bool NextTunerStep();
+    void SetupTunerStep();
+    uint32_t GetTunerStepFrameNum() const;
+    void PrintDenoiserCosts();
+    void ReadTunerImage();
+    double GetTunerImageMse() const;
+    void UpdateTuner(uint32_t frameIndex);
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
 
@@ -611,16 +1346,50 @@ public:
     void CreatePipelines(bool recreate);
     void CreateAccelerationStructures();
     void CreateResourcesAndDescriptors(nri::Format swapChainFormat);
+    void CreateResolutionDependentTextures(nri::Format swapChainFormat);
     void CreateDescriptorSets();
+    void UpdateDescriptorSets();
     void CreateTexture(Texture texture, const char* debugName, nri::Format format, nri::Dim_t width, nri::Dim_t height, nri::Dim_t mipNum, nri::Dim_t arraySize, bool isReadOnly, nri::AccessBits initialAccess);
+    void CreateTextureViews(Texture texture, nri::AccessBits initialAccess);
+    void CreateTransientHeap();
     void CreateBuffer(Buffer buffer, const char* debugName, uint64_t elements, uint32_t stride, nri::BufferUsageBits usage);
+    void CreateDlss(nri::UpscalerType type, nri::Upscaler*& upscaler);
+    void CreateModeSpecificTextures();
+    void DestroyTexture(Texture texture);
+    void AddVramLedgerEntry(const void* resource, const char* name, VramCategory category, const char* heap, nri::Format format, uint64_t size, bool isAliased);
+    void RemoveVramLedgerEntry(const void* resource);
+    void PrintVramLedger(bool isDetailed);
+    uint64_t GetVramLedgerSize() const;
+    uint32_t GetSceneTextureMipOffset(const utils::Texture& texture) const;
+    bool ApplyVramDegradation();
+    void FitVramBudget(uint64_t baselineSize, nri::Format swapChainFormat);
+    uint32_t GetRecommendedSharcCapacity() const;
+    uint32_t GetSharcCapacity() const;
+    void CreateSharcBuffers();
+    void RecreateSharcBuffers(uint32_t frameIndex);
+    void ResolveSharcStats(uint32_t queuedFrameIndex);
+    void PrintSharcTelemetry() const;
+    void UpdateModeSpecificResources();
     void UploadStaticData();
     void UpdateConstantBuffer(uint32_t frameIndex, uint32_t maxAccumulatedFrameNum);
     void RestoreBindings(nri::CommandBuffer& commandBuffer);
-    void GatherInstanceData();
-    uint32_t BuildOptimizedTransitions(const TextureState* states, uint32_t stateNum, std::array<nri::TextureBarrierDesc, MAX_TEXTURE_TRANSITIONS_NUM>& transitions);
+    void FillSimulationInput(uint32_t frameIndex, bool useInputDevices);
+    void Simulate(const SimulationInput& input, FrameSnapshot& snapshot);
+    void ApplySimulation();
+    void SimulationThread();
+    void GatherInstanceData(const SimulationInput& input, FrameSnapshot& snapshot);
+    void StreamInstanceData(const FrameSnapshot& snapshot);
+    void BuildRenderGraph(bool isEven);
+    void PrepareStageContexts(const QueuedFrame& queuedFrame);
+    bool BeginPass(StageContext& context, Pass pass);
+    void EndExternalPass(StageContext& context);
+    void RecordStage(Stage stage);
+    void RecordingThread(Stage stage);
 
 private:
+    // CPU allocations (must outlive the device and NRD)
+    TrackingAllocator m_Allocator;
+
     // NRD
     nrd::Integration m_NRD = {};
     nrd::RelaxSettings m_RelaxSettings = {};
@@ -637,10 +1406,15 @@ private:
     nri::Upscaler* m_DLRR = nullptr;
     nri::SwapChain* m_SwapChain = nullptr;
     nri::Queue* m_GraphicsQueue = nullptr;
+    nri::Queue* m_ComputeQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
+    nri::Fence* m_AsyncComputeFence = nullptr;
+    nri::QueryPool* m_TimestampQueryPool = nullptr;
+    nri::Buffer* m_TimestampReadbackBuffer = nullptr;
     nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     std::array<nri::Upscaler*, 2> m_NIS = {};
+    nri::Memory* m_TransientHeap = nullptr;
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<nri::Texture*> m_Textures;
     std::vector<nri::TextureBarrierDesc> m_TextureStates;
@@ -649,33 +1423,69 @@ private:
     std::vector<nri::DescriptorSet*> m_DescriptorSets;
     std::vector<nri::Pipeline*> m_Pipelines;
     std::vector<nri::AccelerationStructure*> m_AccelerationStructures;
+    std::vector<VramLedgerEntry> m_VramLedger;
     std::vector<SwapChainTexture> m_SwapChainTextures;
+    std::array<nri::AccessBits, (size_t)Buffer::MAX_NUM> m_BufferStates = {};
+    RenderGraph m_RenderGraph;
+    std::vector<RenderGraphState> m_SimulatedStates;
+    std::array<StageContext, (size_t)Stage::MAX_NUM> m_StageContexts = {};
+
+    // Recording threads (one per stage, except the first one recorded by the main thread)
+    std::array<std::thread, (size_t)Stage::MAX_NUM - 1> m_RecordingThreads;
+    std::mutex m_RecordingMutex;
+    std::condition_variable m_RecordingStart;
+    std::condition_variable m_RecordingFinish;
+    uint64_t m_RecordingGeneration = 0;
+
+    // Simulation thread (runs one frame ahead, if pipelined)
+    std::thread m_SimulationThread;
+    std::mutex m_SimulationMutex;
+    std::condition_variable m_SimulationStart;
+    std::condition_variable m_SimulationFinish;
+    bool m_IsSimulationRunning = false;
+    bool m_IsSimulationExitRequested = false;
+    uint32_t m_RecordingPendingNum = 0;
+    bool m_IsRecordingExitRequested = false;
 
     // Data
-    std::vector<InstanceData> m_InstanceData;
-    std::vector<nri::TopLevelInstance> m_WorldTlasData;
-    std::vector<nri::TopLevelInstance> m_LightTlasData;
+    std::array<FrameSnapshot, 2> m_FrameSnapshots = {}; // rendered & simulated
+    SimulationInput m_SimulationInput = {};
     std::vector<AnimatedInstance> m_AnimatedInstances;
-    std::array<float, 256> m_FrameTimes = {};
+    std::array<float, TIMING_HISTORY_SIZE> m_FrameTimes = {};
+    std::array<float, TIMING_HISTORY_SIZE> m_PacingErrors = {};
+    std::array<std::array<float, TIMING_HISTORY_SIZE>, (size_t)LatencyMetric::MAX_NUM> m_LatencyHistory = {};
+    std::vector<LatencyMarkers> m_LatencyMarkers; // per queued frame
     Settings m_Settings = {};
     Settings m_SettingsPrev = {};
     Settings m_SettingsDefault = {};
     const std::vector<uint32_t>* m_checkMeTests = nullptr;
     const std::vector<uint32_t>* m_improveMeTests = nullptr;
+    std::string m_NrdMemoryReport;
+    std::string m_TestPath; // cached, the scene doesn't change
     float3 m_HairBaseColor = float3(0.25f, 0.15f, 0.15f);
     float3 m_PrevLocalPos = {};
     float2 m_HairBetas = float2(0.25f, 0.3f);
     uint2 m_RenderResolution = {};
+    nrd::CommonSettings m_CommonSettings = {};
     nri::BufferOffset m_WorldTlasDataLocation = {};
+    uint64_t m_AsyncComputeFenceValue = 0;
     nri::BufferOffset m_LightTlasDataLocation = {};
     uint32_t m_GlobalConstantBufferOffset = 0;
     uint32_t m_OpaqueObjectsNum = 0;
     uint32_t m_TransparentObjectsNum = 0;
     uint32_t m_EmissiveObjectsNum = 0;
     uint32_t m_ProxyInstancesNum = 0;
+    uint32_t m_RecordedFrameIndex = 0;
+    uint32_t m_FrameSnapshotIndex = 0;
+    uint32_t m_SwapChainTextureIndex = 0;
     uint32_t m_LastSelectedTest = uint32_t(-1);
     uint32_t m_TestNum = uint32_t(-1);
+    uint64_t m_HeapAllocationNumPrev = 0;
+    uint32_t m_FrameHeapAllocationNum = 0;      // in the previous frame
+    uint32_t m_SteadyStateAllocationFrameNum = 0; // frames allocating after warm-up
+    uint32_t m_AllocationWarmupFrameNum = ALLOCATION_WARMUP_FRAME_NUM;
     int32_t m_DlssQuality = int32_t(-1);
+    int32_t m_RenderResolutionPreset = -1; // native, if DLSR is not used
     float m_UiWidth = 0.0f;
     float m_MinResolutionScale = 0.5f;
     float m_DofAperture = 0.0f;
@@ -685,19 +1495,129 @@ private:
     bool m_ForceHistoryReset = false;
     bool m_Resolve = true;
     bool m_DebugNRD = false;
+    bool m_CheckAllocations = false;
     bool m_ShowValidationOverlay = false;
     bool m_PositiveZ = true;
     bool m_ReversedZ = false;
     bool m_IsSrgb = false;
     bool m_GlassObjects = false;
     bool m_IsReloadShadersSucceeded = true;
+    bool m_UseSpecializedShaders = true;
+    bool m_IsDlsrSupported = false;
+    bool m_IsDlrrSupported = false;
+    bool m_IsDlssOutputAllocated = false;
+    bool m_AreInitialStatesApplied = false;
+    bool m_IsRrGuidesAllocated = false;
+    uint32_t m_VramBudget = 0; // Mb
+    uint32_t m_SceneTextureMipBias = 0;
+    uint32_t m_SharcCapacity = SHARC_CAPACITY;
+    uint32_t m_SharcCapacityTier = 0; // auto
+    uint32_t m_SharcUpdateFraction = 0; // see "g_SharcUpdateFractionNames"
+    uint32_t m_SharcClearFrameIndex = 0;
+    bool m_IsSharcRecreationRequested = false;
+    bool m_SharcTelemetry = false;
+    nri::Buffer* m_SharcStatsReadbackBuffer = nullptr;
+    std::vector<bool> m_IsSharcStatsPending; // per queued frame
+    std::array<std::array<float, TIMING_HISTORY_SIZE>, (size_t)SharcMetric::MAX_NUM> m_SharcHistory = {};
+    uint32_t m_SharcSampleNum = 0;
+    uint32_t m_SharcOccupiedPrev = 0;
+    uint32_t m_SharcMisplacedNum = 0;
+    bool m_UseCompactColorFormats = false;
+    uint32_t m_BarrierNum = 0;
+    uint32_t m_BarrierFlushNum = 0;
+    bool m_IsDenoisingCulled = false;
+    bool m_PrintRenderGraph = false;
+    bool m_HoistBarriers = true;
+    bool m_MultithreadedRecording = true;
+    bool m_AsyncCompute = false;
+    bool m_PipelinedSimulation = true;
+    bool m_IsSimulationPending = false;
+    bool m_IsResizeRequested = false;
+
+    // Latency
+    double m_TimestampPeriod = 0.0; // ms
+    double m_GpuClockOffset = std::numeric_limits<double>::max(); // ms
+    uint64_t m_PrevGpuEnd = 0;
+    uint32_t m_LatencySampleNum = 0;
+    uint32_t m_FramesInFlight = 0;
+    uint32_t m_LatencyWindowNum = 0;
+    float m_LatencyWindowGpuIdle = 0.0f;
+    float m_LatencyWindowGpuTime = 0.0f;
+    float m_LatencyDelay = 0.0f; // ms
+    bool m_AdaptiveLatency = false;
+
+    // Frame pacing
+    double m_PacingTargetTimeStamp = 0.0; // ms
+    double m_SleepOvershoot = 0.0; // ms
+    uint32_t m_PacingSampleNum = 0;
+
+    // Dynamic resolution (not in "Settings", which are stored in test files)
+    float4 m_DrsMoments = {}; // EWMA of "area", "GPU time", "area^2", "area * GPU time"
+    float m_DrsResolutionScale = 1.0f;
+    uint32_t m_DrsCooldown = 0;
+    uint32_t m_DrsUnderBudgetNum = 0;
+    float m_DrsTargetFps = 60.0f;
+    bool m_Drs = false;
+
+    // Tuner
+    Settings m_TunerSettings = {}; // restored at the end
+    Camera m_TunerCamera;
+    std::vector<float> m_TunerReference; // RGB
+    std::vector<float> m_TunerImage;     // RGB
+    std::vector<TunerResult> m_TunerResults;
+    std::vector<TunerCombination> m_TunerCombinations;
+    nri::Buffer* m_TunerReadbackBuffer = nullptr;
+    double m_TunerGpuTime = 0.0;       // ms, sum over measured frames
+    double m_TunerDenoisingTime = 0.0; // ms, sum over measured frames
+    uint32_t m_TunerReadbackRowPitch = 0;
+    uint32_t m_TunerReadbackFrameIndex = uint32_t(-1);
+    uint32_t m_TunerTest = 0;
+    uint32_t m_TunerTestNum = 0;
+    uint32_t m_TunerCombination = 0;
+    uint32_t m_TunerFrame = 0;
+    uint32_t m_TunerMeasuredFrameNum = 0;
+    int32_t m_TunerDenoiser = DENOISER_REBLUR;
+    TunerState m_TunerState = TunerState::Idle;
+    TunerMode m_TunerMode = TunerMode::Sweep;
+    bool m_TunerPipelinedSimulation = false;
+    bool m_TunerDrs = false;
 };
 
 Sample::~Sample() {
+    { // Stop recording threads
+        std::lock_guard<std::mutex> lock(m_RecordingMutex);
+        m_IsRecordingExitRequested = true;
+    }
+    m_RecordingStart.notify_all();
+
+    for (std::thread& thread : m_RecordingThreads) {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    { // Stop simulation thread
+        std::lock_guard<std::mutex> lock(m_SimulationMutex);
+        m_IsSimulationExitRequested = true;
+    }
+    m_SimulationStart.notify_all();
+
+    if (m_SimulationThread.joinable())
+        m_SimulationThread.join();
+
     if (NRI.HasCore()) {
         NRI.DeviceWaitIdle(m_Device);
 
         for (QueuedFrame& queuedFrame : m_QueuedFrames) {
+            for (uint32_t i = 0; i < (uint32_t)Stage::MAX_NUM; i++) {
+                NRI.DestroyCommandBuffer(queuedFrame.stageCommandBuffers[i]);
+                NRI.DestroyCommandAllocator(queuedFrame.stageCommandAllocators[i]);
+
+                if (queuedFrame.computeCommandAllocators[i]) {
+                    NRI.DestroyCommandBuffer(queuedFrame.computeCommandBuffers[i]);
+                    NRI.DestroyCommandAllocator(queuedFrame.computeCommandAllocators[i]);
+                }
+            }
+
             NRI.DestroyCommandBuffer(queuedFrame.commandBuffer);
             NRI.DestroyCommandAllocator(queuedFrame.commandAllocator);
         }
@@ -711,6 +1631,8 @@ Sample::~Sample() {
         for (uint32_t i = 0; i < m_Textures.size(); i++)
             NRI.DestroyTexture(m_Textures[i]);
 
+        NRI.FreeMemory(m_TransientHeap);
+
         for (uint32_t i = 0; i < m_Buffers.size(); i++)
             NRI.DestroyBuffer(m_Buffers[i]);
 
@@ -726,6 +1648,11 @@ Sample::~Sample() {
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptorPool(m_DescriptorPool);
         NRI.DestroyFence(m_FrameFence);
+        NRI.DestroyFence(m_AsyncComputeFence);
+        NRI.DestroyQueryPool(m_TimestampQueryPool);
+        NRI.DestroyBuffer(m_TimestampReadbackBuffer);
+        NRI.DestroyBuffer(m_TunerReadbackBuffer);
+        NRI.DestroyBuffer(m_SharcStatsReadbackBuffer);
     }
 
     if (NRI.HasUpscaler()) {
@@ -746,11 +1673,18 @@ Sample::~Sample() {
     DestroyImgui();
 
     nri::nriDestroyDevice(m_Device);
+
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     Rng::Hash::Initialize(m_RngState, 106937, 69);
 
+    // Count ImGui allocations (still "malloc" and "free", thus compatible with already allocated memory)
+    ImGui::SetAllocatorFunctions(ImGuiAllocate, ImGuiFree);
+
     // Adapters
     nri::AdapterDesc adapterDesc[4] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -765,7 +1699,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.disableD3D12EnhancedBarriers = D3D12_DISABLE_ENHANCED_BARRIERS;
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
-    deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+    m_Allocator.SetUpstream(m_AllocationCallbacks);
+    deviceCreationDesc.allocationCallbacks = m_Allocator.GetCallbacks(AllocationTag::NRI);
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
@@ -778,6 +1713,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    // Async compute is optional
+    if (NRI.GetQueue(*m_Device, nri::QueueType::COMPUTE, 0, m_ComputeQueue) == nri::Result::SUCCESS)
+        NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_AsyncComputeFence));
+    else
+        m_ComputeQueue = nullptr;
+
     { // Create streamer
         nri::StreamerDesc streamerDesc = {};
         streamerDesc.constantBufferMemoryLocation = nri::MemoryLocation::DEVICE_UPLOAD;
@@ -788,422 +1729,1281 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
     }
 
-    { // Create upscaler: NIS
-        nri::UpscalerDesc upscalerDesc = {};
-        upscalerDesc.upscaleResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
-        upscalerDesc.type = nri::UpscalerType::NIS;
-
-        upscalerDesc.flags = nri::UpscalerBits::NONE;
-        NRI_ABORT_ON_FAILURE(NRI.CreateUpscaler(*m_Device, upscalerDesc, m_NIS[0]));
+    // Create upscalers: DLSR and DLRR ( NIS upscalers and DLRR are created on first use, see "UpdateModeSpecificResources" )
+    if (m_DlssQuality != -1) {
+        m_IsDlsrSupported = NRI.IsUpscalerSupported(*m_Device, nri::UpscalerType::DLSR);
+        m_IsDlrrSupported = NRI.IsUpscalerSupported(*m_Device, nri::UpscalerType::DLRR);
 
-        upscalerDesc.flags = nri::UpscalerBits::HDR;
-        NRI_ABORT_ON_FAILURE(NRI.CreateUpscaler(*m_Device, upscalerDesc, m_NIS[1]));
+        // DLSR is on by default
+        m_Settings.SR = m_IsDlsrSupported;
     }
 
-    // Create upscalers: DLSR and DLRR
-    m_RenderResolution = GetOutputResolution();
+    UpdateRenderResolution();
 
-    if (m_DlssQuality != -1) {
-        nri::UpscalerBits upscalerFlags = nri::UpscalerBits::DEPTH_INFINITE;
-        upscalerFlags |= NRD_MODE < OCCLUSION ? nri::UpscalerBits::HDR : nri::UpscalerBits::NONE;
-        upscalerFlags |= m_ReversedZ ? nri::UpscalerBits::DEPTH_INVERTED : nri::UpscalerBits::NONE;
-
-        nri::UpscalerMode mode = nri::UpscalerMode::NATIVE;
-        if (m_DlssQuality == 0)
-            mode = nri::UpscalerMode::ULTRA_PERFORMANCE;
-        else if (m_DlssQuality == 1)
-            mode = nri::UpscalerMode::PERFORMANCE;
-        else if (m_DlssQuality == 2)
-            mode = nri::UpscalerMode::BALANCED;
-        else if (m_DlssQuality == 3)
-            mode = nri::UpscalerMode::QUALITY;
-
-        if (NRI.IsUpscalerSupported(*m_Device, nri::UpscalerType::DLSR)) {
-            nri::VideoMemoryInfo videoMemoryInfo1 = {};
-            NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo1);
-
-            nri::UpscalerDesc upscalerDesc = {};
-            upscalerDesc.upscaleResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
-            upscalerDesc.type = upscalerType;
-            upscalerDesc.mode = mode;
-            upscalerDesc.flags = upscalerFlags;
-            upscalerDesc.preset = DLSS_PRESET;
-            NRI_ABORT_ON_FAILURE(NRI.CreateUpscaler(*m_Device, upscalerDesc, m_DLSR));
-
-            nri::UpscalerProps upscalerProps = {};
-            NRI.GetUpscalerProps(*m_DLSR, upscalerProps);
-
-            float sx = float(upscalerProps.renderResolutionMin.w) / float(upscalerProps.renderResolution.w);
-            float sy = float(upscalerProps.renderResolutionMin.h) / float(upscalerProps.renderResolution.h);
-
-            m_RenderResolution = {upscalerProps.renderResolution.w, upscalerProps.renderResolution.h};
-            m_MinResolutionScale = sy > sx ? sy : sx;
-
-            nri::VideoMemoryInfo videoMemoryInfo2 = {};
-            NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo2);
-
-            printf("Render resolution (%u, %u)\n", m_RenderResolution.x, m_RenderResolution.y);
-            printf("DLSS-SR: allocated %.2f Mb\n", (videoMemoryInfo2.usageSize - videoMemoryInfo1.usageSize) / (1024.0f * 1024.0f));
-
-            m_Settings.SR = true;
-        }
+    // README "Memory requirements" table (no rendering). Initialization stops here, the sample shuts down through the usual path
+    // and the process exits with "0", if the report is written
+    if (!m_NrdMemoryReport.empty()) {
+        g_ExitCode = WriteNrdMemoryReport(m_NrdMemoryReport.c_str()) ? 0 : 1;
+        return false;
+    }
 
-        if (NRI.IsUpscalerSupported(*m_Device, nri::UpscalerType::DLRR)) {
-            nri::VideoMemoryInfo videoMemoryInfo1 = {};
-            NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo1);
+    // Initialize NRD: REBLUR, RELAX and SIGMA in one instance
+    if (!RecreateNrd())
+        return false;
 
-            nri::UpscalerDesc upscalerDesc = {};
-            upscalerDesc.upscaleResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
-            upscalerDesc.type = nri::UpscalerType::DLRR;
-            upscalerDesc.mode = mode;
-            upscalerDesc.flags = upscalerFlags;
-            NRI_ABORT_ON_FAILURE(NRI.CreateUpscaler(*m_Device, upscalerDesc, m_DLRR));
+    LoadScene();
 
-            nri::VideoMemoryInfo videoMemoryInfo2 = {};
-            NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo2);
+    if (m_SceneFile.find("BistroInterior") != std::string::npos)
+        AddInnerGlassSurfaces();
 
-            printf("DLSS-RR: allocated %.2f Mb\n", (videoMemoryInfo2.usageSize - videoMemoryInfo1.usageSize) / (1024.0f * 1024.0f));
-        }
-    }
+    GenerateAnimatedCubes();
 
-    // Initialize NRD: REBLUR, RELAX and SIGMA in one instance
-    {
-        const nrd::DenoiserDesc denoisersDescs[] = {
-        // REBLUR
+    m_SharcCapacity = GetSharcCapacity();
+
+    m_Pipelines.resize((size_t)Pipeline::MAX_NUM);
+    m_DescriptorSets.resize((size_t)DescriptorSet::MAX_NUM);
+    m_Buffers.resize((size_t)Buffer::MAX_NUM);
+    m_Textures.resize((size_t)Texture::BaseReadOnlyTexture + m_Scene.textures.size());
+    m_TextureStates.resize((size_t)Texture::BaseReadOnlyTexture); // no read-only textures
+    m_Descriptors.resize((size_t)Descriptor::BaseReadOnlyTexture + m_Scene.textures.size());
+    m_AccelerationStructures.resize((size_t)AccelerationStructure::BLAS_Other);
+
+    nri::Format swapChainFormat = CreateSwapChain();
+    CreateCommandBuffers();
+    CreatePipelineLayoutAndDescriptorPool();
+    CreatePipelines(false);
+
+    // Everything allocated so far (framework, NRD, swap chain) is out of reach of the VRAM budget
+    nri::VideoMemoryInfo baselineMemoryInfo = {};
+    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, baselineMemoryInfo);
+
+    CreateAccelerationStructures();
+    CreateResourcesAndDescriptors(swapChainFormat);
+
+    if (m_VramBudget)
+        FitVramBudget(baselineMemoryInfo.usageSize, swapChainFormat);
+
+    CreateDescriptorSets();
+
+    UploadStaticData();
+    m_Scene.UnloadTextureData();
+    m_Scene.UnloadGeometryData();
+
+    m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, CAMERA_RELATIVE);
+
+    m_SettingsDefault = m_Settings;
+    m_ShowValidationOverlay = m_DebugNRD;
+
+    nri::VideoMemoryInfo videoMemoryInfo = {};
+    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo);
+    printf("Allocated %.2f Mb\n", videoMemoryInfo.usageSize / (1024.0f * 1024.0f));
+
+    PrintVramLedger(false);
+
+    for (uint32_t i = 1; i < (uint32_t)Stage::MAX_NUM; i++)
+        m_RecordingThreads[i - 1] = std::thread(&Sample::RecordingThread, this, (Stage)i);
+
+    m_SimulationThread = std::thread(&Sample::SimulationThread, this);
+
+    return InitImgui(*m_Device);
+}
+
+bool Sample::RecreateNrd() {
+    const nrd::DenoiserDesc denoisersDescs[] = {
+    // REBLUR
 #if (NRD_MODE == OCCLUSION)
 #    if (NRD_COMBINED == 1)
-            {NRD_ID(REBLUR_DIFFUSE_SPECULAR_OCCLUSION), nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR_OCCLUSION},
+        {NRD_ID(REBLUR_DIFFUSE_SPECULAR_OCCLUSION), nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR_OCCLUSION},
 #    else
-            {NRD_ID(REBLUR_DIFFUSE_OCCLUSION), nrd::Denoiser::REBLUR_DIFFUSE_OCCLUSION},
-            {NRD_ID(REBLUR_SPECULAR_OCCLUSION), nrd::Denoiser::REBLUR_SPECULAR_OCCLUSION},
+        {NRD_ID(REBLUR_DIFFUSE_OCCLUSION), nrd::Denoiser::REBLUR_DIFFUSE_OCCLUSION},
+        {NRD_ID(REBLUR_SPECULAR_OCCLUSION), nrd::Denoiser::REBLUR_SPECULAR_OCCLUSION},
 #    endif
 #elif (NRD_MODE == SH)
 #    if (NRD_COMBINED == 1)
-            {NRD_ID(REBLUR_DIFFUSE_SPECULAR_SH), nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR_SH},
+        {NRD_ID(REBLUR_DIFFUSE_SPECULAR_SH), nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR_SH},
 #    else
-            {NRD_ID(REBLUR_DIFFUSE_SH), nrd::Denoiser::REBLUR_DIFFUSE_SH},
-            {NRD_ID(REBLUR_SPECULAR_SH), nrd::Denoiser::REBLUR_SPECULAR_SH},
+        {NRD_ID(REBLUR_DIFFUSE_SH), nrd::Denoiser::REBLUR_DIFFUSE_SH},
+        {NRD_ID(REBLUR_SPECULAR_SH), nrd::Denoiser::REBLUR_SPECULAR_SH},
 #    endif
 #elif (NRD_MODE == DIRECTIONAL_OCCLUSION)
-            {NRD_ID(REBLUR_DIFFUSE_DIRECTIONAL_OCCLUSION), nrd::Denoiser::REBLUR_DIFFUSE_DIRECTIONAL_OCCLUSION},
+        {NRD_ID(REBLUR_DIFFUSE_DIRECTIONAL_OCCLUSION), nrd::Denoiser::REBLUR_DIFFUSE_DIRECTIONAL_OCCLUSION},
 #else
 #    if (NRD_COMBINED == 1)
-            {NRD_ID(REBLUR_DIFFUSE_SPECULAR), nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR},
+        {NRD_ID(REBLUR_DIFFUSE_SPECULAR), nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR},
 #    else
-            {NRD_ID(REBLUR_DIFFUSE), nrd::Denoiser::REBLUR_DIFFUSE},
-            {NRD_ID(REBLUR_SPECULAR), nrd::Denoiser::REBLUR_SPECULAR},
+        {NRD_ID(REBLUR_DIFFUSE), nrd::Denoiser::REBLUR_DIFFUSE},
+        {NRD_ID(REBLUR_SPECULAR), nrd::Denoiser::REBLUR_SPECULAR},
 #    endif
 #endif
 
-        // RELAX
+    // RELAX
 #if (NRD_MODE == SH)
 #    if (NRD_COMBINED == 1)
-            {NRD_ID(RELAX_DIFFUSE_SPECULAR_SH), nrd::Denoiser::RELAX_DIFFUSE_SPECULAR_SH},
+        {NRD_ID(RELAX_DIFFUSE_SPECULAR_SH), nrd::Denoiser::RELAX_DIFFUSE_SPECULAR_SH},
 #    else
-            {NRD_ID(RELAX_DIFFUSE_SH), nrd::Denoiser::RELAX_DIFFUSE_SH},
-            {NRD_ID(RELAX_SPECULAR_SH), nrd::Denoiser::RELAX_SPECULAR_SH},
+        {NRD_ID(RELAX_DIFFUSE_SH), nrd::Denoiser::RELAX_DIFFUSE_SH},
+        {NRD_ID(RELAX_SPECULAR_SH), nrd::Denoiser::RELAX_SPECULAR_SH},
 #    endif
 #else
 #    if (NRD_COMBINED == 1)
-            {NRD_ID(RELAX_DIFFUSE_SPECULAR), nrd::Denoiser::RELAX_DIFFUSE_SPECULAR},
+        {NRD_ID(RELAX_DIFFUSE_SPECULAR), nrd::Denoiser::RELAX_DIFFUSE_SPECULAR},
 #    else
-            {NRD_ID(RELAX_DIFFUSE), nrd::Denoiser::RELAX_DIFFUSE},
-            {NRD_ID(RELAX_SPECULAR), nrd::Denoiser::RELAX_SPECULAR},
+        {NRD_ID(RELAX_DIFFUSE), nrd::Denoiser::RELAX_DIFFUSE},
+        {NRD_ID(RELAX_SPECULAR), nrd::Denoiser::RELAX_SPECULAR},
 #    endif
 #endif
 
-        // SIGMA
+    // SIGMA
 #if (NRD_MODE < OCCLUSION)
-            {NRD_ID(SIGMA_SHADOW), SIGMA_VARIANT},
+        {NRD_ID(SIGMA_SHADOW), SIGMA_VARIANT},
 #endif
 
-            // REFERENCE
-            {NRD_ID(REFERENCE), nrd::Denoiser::REFERENCE},
-        };
-
-        nrd::InstanceCreationDesc instanceCreationDesc = {};
-        instanceCreationDesc.denoisers = denoisersDescs;
-        instanceCreationDesc.denoisersNum = helper::GetCountOf(denoisersDescs);
-
-        nrd::IntegrationCreationDesc desc = {};
-        strcpy(desc.name, "NRD");
-        desc.queuedFrameNum = GetQueuedFrameNum();
-        desc.enableWholeLifetimeDescriptorCaching = NRD_ENABLE_WHOLE_LIFETIME_DESCRIPTOR_CACHING;
-        desc.promoteFloat16to32 = NRD_PROMOTE_FLOAT16_TO_32;
-        desc.demoteFloat32to16 = NRD_DEMOTE_FLOAT32_TO_16;
-        desc.resourceWidth = (uint16_t)m_RenderResolution.x;
-        desc.resourceHeight = (uint16_t)m_RenderResolution.y;
-        desc.autoWaitForIdle = false;
-
-        nri::VideoMemoryInfo videoMemoryInfo1 = {};
-        NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo1);
+        // REFERENCE
+        {NRD_ID(REFERENCE), nrd::Denoiser::REFERENCE},
+    };
 
-        if constexpr (NRD_USE_AUTO_WRAPPER) {
-            const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+    nrd::InstanceCreationDesc instanceCreationDesc = {};
+    instanceCreationDesc.denoisers = denoisersDescs;
+    instanceCreationDesc.denoisersNum = helper::GetCountOf(denoisersDescs);
+
+    const nri::AllocationCallbacks nrdAllocationCallbacks = m_Allocator.GetCallbacks(AllocationTag::NRD);
+    instanceCreationDesc.allocationCallbacks.Allocate = nrdAllocationCallbacks.Allocate;
+    instanceCreationDesc.allocationCallbacks.Reallocate = nrdAllocationCallbacks.Reallocate;
+    instanceCreationDesc.allocationCallbacks.Free = nrdAllocationCallbacks.Free;
+    instanceCreationDesc.allocationCallbacks.userArg = nrdAllocationCallbacks.userArg;
+
+    nrd::IntegrationCreationDesc desc = {};
+    strcpy(desc.name, "NRD");
+    desc.queuedFrameNum = GetQueuedFrameNum();
+    desc.enableWholeLifetimeDescriptorCaching = NRD_ENABLE_WHOLE_LIFETIME_DESCRIPTOR_CACHING;
+    desc.promoteFloat16to32 = NRD_PROMOTE_FLOAT16_TO_32;
+    desc.demoteFloat32to16 = NRD_DEMOTE_FLOAT32_TO_16;
+    desc.resourceWidth = (uint16_t)m_RenderResolution.x;
+    desc.resourceHeight = (uint16_t)m_RenderResolution.y;
+    desc.autoWaitForIdle = false;
+
+    nri::VideoMemoryInfo videoMemoryInfo1 = {};
+    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo1);
+
+    if constexpr (NRD_USE_AUTO_WRAPPER) {
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
 
-            if (deviceDesc.graphicsAPI == nri::GraphicsAPI::D3D12) {
-                ID3D12CommandQueue* queue = (ID3D12CommandQueue*)NRI.GetQueueNativeObject(m_GraphicsQueue);
+        if (deviceDesc.graphicsAPI == nri::GraphicsAPI::D3D12) {
+            ID3D12CommandQueue* queue = (ID3D12CommandQueue*)NRI.GetQueueNativeObject(m_GraphicsQueue);
 
-                nri::QueueFamilyD3D12Desc queueFamily = {};
-                queueFamily.d3d12Queues = &queue;
-                queueFamily.queueType = nri::QueueType::GRAPHICS;
-                queueFamily.queueNum = 1;
+            nri::QueueFamilyD3D12Desc queueFamily = {};
+            queueFamily.d3d12Queues = &queue;
+            queueFamily.queueType = nri::QueueType::GRAPHICS;
+            queueFamily.queueNum = 1;
 
-                nri::DeviceCreationD3D12Desc deviceCreationD3D12Desc = {};
-                deviceCreationD3D12Desc.d3d12Device = (ID3D12Device*)NRI.GetDeviceNativeObject(m_Device);
-                deviceCreationD3D12Desc.queueFamilies = &queueFamily;
-                deviceCreationD3D12Desc.queueFamilyNum = 1;
-                deviceCreationD3D12Desc.enableNRIValidation = m_DebugNRI;
+            nri::DeviceCreationD3D12Desc deviceCreationD3D12Desc = {};
+            deviceCreationD3D12Desc.d3d12Device = (ID3D12Device*)NRI.GetDeviceNativeObject(m_Device);
+            deviceCreationD3D12Desc.queueFamilies = &queueFamily;
+            deviceCreationD3D12Desc.queueFamilyNum = 1;
+            deviceCreationD3D12Desc.enableNRIValidation = m_DebugNRI;
+            deviceCreationD3D12Desc.allocationCallbacks = m_Allocator.GetCallbacks(AllocationTag::NRD);
 
-                if (m_NRD.RecreateD3D12(desc, instanceCreationDesc, deviceCreationD3D12Desc) != nrd::Result::SUCCESS)
-                    return false;
-            } else {
-                nri::WrapperVKInterface iWrapperVK = {};
-                NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::WrapperVKInterface), &iWrapperVK));
-
-                nri::QueueFamilyVKDesc queueFamily = {};
-                queueFamily.familyIndex = iWrapperVK.GetQueueFamilyIndexVK(*m_GraphicsQueue);
-                queueFamily.queueType = nri::QueueType::GRAPHICS;
-                queueFamily.queueNum = 1;
-
-                nri::DeviceCreationVKDesc deviceCreationVKDesc = {};
-                deviceCreationVKDesc.vkInstance = (VKHandle)iWrapperVK.GetInstanceVK(*m_Device);
-                deviceCreationVKDesc.vkPhysicalDevice = (VKHandle)iWrapperVK.GetPhysicalDeviceVK(*m_Device);
-                deviceCreationVKDesc.vkDevice = (VKHandle)NRI.GetDeviceNativeObject(m_Device);
-                deviceCreationVKDesc.minorVersion = 3;
-                deviceCreationVKDesc.queueFamilies = &queueFamily;
-                deviceCreationVKDesc.queueFamilyNum = 1;
-                deviceCreationVKDesc.enableNRIValidation = m_DebugNRI;
-
-                if (m_NRD.RecreateVK(desc, instanceCreationDesc, deviceCreationVKDesc) != nrd::Result::SUCCESS)
-                    return false;
-            }
+            if (m_NRD.RecreateD3D12(desc, instanceCreationDesc, deviceCreationD3D12Desc) != nrd::Result::SUCCESS)
+                return false;
         } else {
-            if (m_NRD.Recreate(desc, instanceCreationDesc, m_Device) != nrd::Result::SUCCESS)
+            nri::WrapperVKInterface iWrapperVK = {};
+            NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::WrapperVKInterface), &iWrapperVK));
+
+            nri::QueueFamilyVKDesc queueFamily = {};
+            queueFamily.familyIndex = iWrapperVK.GetQueueFamilyIndexVK(*m_GraphicsQueue);
+            queueFamily.queueType = nri::QueueType::GRAPHICS;
+            queueFamily.queueNum = 1;
+
+            nri::DeviceCreationVKDesc deviceCreationVKDesc = {};
+            deviceCreationVKDesc.vkInstance = (VKHandle)iWrapperVK.GetInstanceVK(*m_Device);
+            deviceCreationVKDesc.vkPhysicalDevice = (VKHandle)iWrapperVK.GetPhysicalDeviceVK(*m_Device);
+            deviceCreationVKDesc.vkDevice = (VKHandle)NRI.GetDeviceNativeObject(m_Device);
+            deviceCreationVKDesc.minorVersion = 3;
+            deviceCreationVKDesc.queueFamilies = &queueFamily;
+            deviceCreationVKDesc.queueFamilyNum = 1;
+            deviceCreationVKDesc.enableNRIValidation = m_DebugNRI;
+            deviceCreationVKDesc.allocationCallbacks = m_Allocator.GetCallbacks(AllocationTag::NRD);
+
+            if (m_NRD.RecreateVK(desc, instanceCreationDesc, deviceCreationVKDesc) != nrd::Result::SUCCESS)
                 return false;
         }
+    } else {
+        if (m_NRD.Recreate(desc, instanceCreationDesc, m_Device) != nrd::Result::SUCCESS)
+            return false;
+    }
+
+    nri::VideoMemoryInfo videoMemoryInfo2 = {};
+    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo2);
 
-        nri::VideoMemoryInfo videoMemoryInfo2 = {};
-        NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo2);
+    printf("NRD: allocated %.2f Mb for REBLUR, RELAX, SIGMA and REFERENCE denoisers\n", (videoMemoryInfo2.usageSize - videoMemoryInfo1.usageSize) / (1024.0f * 1024.0f));
 
-        printf("NRD: allocated %.2f Mb for REBLUR, RELAX, SIGMA and REFERENCE denoisers\n", (videoMemoryInfo2.usageSize - videoMemoryInfo1.usageSize) / (1024.0f * 1024.0f));
+    return true;
+}
+
+bool Sample::WriteNrdMemoryReport(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("Can't open '%s'\n", path);
+        return false;
     }
 
-#if 0
-        // README "Memory requirements" table generator
-        printf("| %10s | %36s | %16s | %16s | %16s |\n", "Resolution", "Denoiser", "Working set (Mb)", "Persistent (Mb)", "Aliasable (Mb)");
-        printf("|------------|--------------------------------------|------------------|------------------|------------------|\n");
+    // Markdown, unless CSV is requested
+    const char* extension = strrchr(path, '.');
+    bool isCsv = extension && strcmp(extension, ".csv") == 0;
 
-        for (uint32_t j = 0; j < 3; j++)
-        {
-            const char* resolution = "1080p";
-            uint16_t w = 1920;
-            uint16_t h = 1080;
+    if (isCsv)
+        fprintf(fp, "Resolution,Denoiser,Promote FP16 to FP32,Demote FP32 to FP16,Descriptor caching,Working set (Mb),Persistent (Mb),Aliasable (Mb)\n");
+    else {
+        fprintf(fp, "| %10s | %36s | %7s | %7s | %7s | %16s | %16s | %16s |\n", "Resolution", "Denoiser", "FP16>32", "FP32>16", "Caching", "Working set (Mb)", "Persistent (Mb)", "Aliasable (Mb)");
+        fprintf(fp, "|------------|--------------------------------------|---------|---------|---------|------------------|------------------|------------------|\n");
+    }
 
-            if (j == 1)
-            {
-                resolution = "1440p";
-                w = 2560;
-                h = 1440;
-            }
-            else if (j == 2)
-            {
-                resolution = "2160p";
-                w = 3840;
-                h = 2160;
-            }
+    for (uint32_t h : g_RenderResolutionPresets) {
+        uint16_t w = uint16_t((h * 16 + 8) / 9);
 
-            for (uint32_t i = 0; i <= (uint32_t)nrd::Denoiser::REFERENCE; i++)
-            {
-                nrd::Denoiser denoiser = (nrd::Denoiser)i;
-                const char* methodName = nrd::GetDenoiserString(denoiser);
+        char resolution[16];
+        snprintf(resolution, sizeof(resolution), "%up", h);
+
+        for (uint32_t i = 0; i <= (uint32_t)nrd::Denoiser::REFERENCE; i++) {
+            nrd::Denoiser denoiser = (nrd::Denoiser)i;
+            const char* methodName = nrd::GetDenoiserString(denoiser);
+
+            const nrd::DenoiserDesc denoiserDesc = {0, denoiser};
 
-                const nrd::DenoiserDesc denoiserDesc = {0, denoiser};
+            nrd::InstanceCreationDesc instanceCreationDesc = {};
+            instanceCreationDesc.denoisers = &denoiserDesc;
+            instanceCreationDesc.denoisersNum = 1;
 
-                nrd::InstanceCreationDesc instanceCreationDesc = {};
-                instanceCreationDesc.denoisers = &denoiserDesc;
-                instanceCreationDesc.denoisersNum = 1;
+            // Options: bit 0 - promote, bit 1 - demote, bit 2 - descriptor caching (promotion and demotion are exclusive)
+            for (uint32_t options = 0; options < 8; options++) {
+                bool promote = (options & 0x1) != 0;
+                bool demote = (options & 0x2) != 0;
+                bool caching = (options & 0x4) != 0;
+
+                if (promote && demote)
+                    continue;
 
                 nrd::IntegrationCreationDesc desc = {};
                 desc.queuedFrameNum = GetQueuedFrameNum();
-                desc.enableWholeLifetimeDescriptorCaching = NRD_ENABLE_WHOLE_LIFETIME_DESCRIPTOR_CACHING;
-                desc.promoteFloat16to32 = NRD_PROMOTE_FLOAT16_TO_32;
-                desc.demoteFloat32to16 = NRD_DEMOTE_FLOAT32_TO_16;
+                desc.enableWholeLifetimeDescriptorCaching = caching;
+                desc.promoteFloat16to32 = promote;
+                desc.demoteFloat32to16 = demote;
                 desc.resourceWidth = w;
-                desc.resourceHeight = h;
+                desc.resourceHeight = (uint16_t)h;
 
                 nrd::Integration instance;
-                instance.Recreate(desc, instanceCreationDesc, m_Device);
+                if (instance.Recreate(desc, instanceCreationDesc, m_Device) != nrd::Result::SUCCESS) {
+                    printf("NRD: '%s' can't be created at %ux%u\n", methodName, w, h);
+                    continue;
+                }
 
-                printf("| %10s | %36s | %16.2f | %16.2f | %16.2f |\n", i == 0 ? resolution : "", methodName, instance.GetTotalMemoryUsageInMb(), instance.GetPersistentMemoryUsageInMb(), instance.GetAliasableMemoryUsageInMb());
+                const char* format = isCsv ? "%s,%s,%u,%u,%u,%.2f,%.2f,%.2f\n" : "| %10s | %36s | %7u | %7u | %7u | %16.2f | %16.2f | %16.2f |\n";
+                fprintf(fp, format, resolution, methodName, promote, demote, caching, instance.GetTotalMemoryUsageInMb(), instance.GetPersistentMemoryUsageInMb(), instance.GetAliasableMemoryUsageInMb());
 
                 instance.Destroy();
             }
-
-            if (j != 2)
-                printf("| %10s | %36s | %16s | %16s | %16s |\n", "", "", "", "", "");
         }
+    }
 
-        __debugbreak();
-#endif
+    fclose(fp);
 
-    LoadScene();
+    printf("NRD: memory requirements written to '%s'\n", path);
 
-    if (m_SceneFile.find("BistroInterior") != std::string::npos)
-        AddInnerGlassSurfaces();
+    return true;
+}
 
-    GenerateAnimatedCubes();
+void Sample::UpdateRenderResolution() {
+    m_RenderResolution = GetOutputResolution();
 
-    m_Pipelines.resize((size_t)Pipeline::MAX_NUM);
-    m_DescriptorSets.resize((size_t)DescriptorSet::MAX_NUM);
-    m_Buffers.resize((size_t)Buffer::MAX_NUM);
-    m_Textures.resize((size_t)Texture::BaseReadOnlyTexture + m_Scene.textures.size());
-    m_TextureStates.resize((size_t)Texture::BaseReadOnlyTexture); // no read-only textures
-    m_Descriptors.resize((size_t)Descriptor::BaseReadOnlyTexture + m_Scene.textures.size());
-    m_AccelerationStructures.resize((size_t)AccelerationStructure::BLAS_Other);
+    // Preset height, output aspect ratio
+    if (m_RenderResolutionPreset >= 0) {
+        uint32_t h = min(g_RenderResolutionPresets[m_RenderResolutionPreset], m_RenderResolution.y);
+        uint32_t w = uint32_t(float(m_RenderResolution.x) * float(h) / float(m_RenderResolution.y) + 0.5f);
 
-    nri::Format swapChainFormat = CreateSwapChain();
-    CreateCommandBuffers();
-    CreatePipelineLayoutAndDescriptorPool();
-    CreatePipelines(false);
-    CreateAccelerationStructures();
-    CreateResourcesAndDescriptors(swapChainFormat);
-    CreateDescriptorSets();
+        m_RenderResolution = uint2(w, h);
+    }
 
-    UploadStaticData();
-    m_Scene.UnloadTextureData();
-    m_Scene.UnloadGeometryData();
+    // DLSR defines the render resolution
+    if (m_DlssQuality != -1 && m_IsDlsrSupported) {
+        if (!m_DLSR)
+            CreateDlss(upscalerType, m_DLSR);
 
-    m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, CAMERA_RELATIVE);
+        nri::UpscalerProps upscalerProps = {};
+        NRI.GetUpscalerProps(*m_DLSR, upscalerProps);
 
-    m_SettingsDefault = m_Settings;
-    m_ShowValidationOverlay = m_DebugNRD;
+        float sx = float(upscalerProps.renderResolutionMin.w) / float(upscalerProps.renderResolution.w);
+        float sy = float(upscalerProps.renderResolutionMin.h) / float(upscalerProps.renderResolution.h);
 
-    nri::VideoMemoryInfo videoMemoryInfo = {};
-    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo);
-    printf("Allocated %.2f Mb\n", videoMemoryInfo.usageSize / (1024.0f * 1024.0f));
+        m_RenderResolution = {upscalerProps.renderResolution.w, upscalerProps.renderResolution.h};
+        m_MinResolutionScale = sy > sx ? sy : sx;
+    }
 
-    return InitImgui(*m_Device);
+    printf("Render resolution (%u, %u)\n", m_RenderResolution.x, m_RenderResolution.y);
+}
+
+void Sample::ResizeRenderResolution() {
+    NRI.DeviceWaitIdle(m_Device);
+
+    // DLSS upscalers are created for a specific quality mode ( recreated on demand in "UpdateModeSpecificResources" )
+    NRI.DestroyUpscaler(m_DLSR);
+    NRI.DestroyUpscaler(m_DLRR);
+    m_DLSR = nullptr;
+    m_DLRR = nullptr;
+
+    UpdateRenderResolution();
+
+    // Only resolution dependent textures (all, except read-only ones), their views and NRD get recreated. Scene data,
+    // BLASes, pipelines, SHARC buffers and descriptor sets are reused
+    nri::Format swapChainFormat = NRI.GetTextureDesc(*Get(Texture::Final)).format;
+
+    for (uint32_t i = 0; i < (uint32_t)Texture::BaseReadOnlyTexture; i++)
+        DestroyTexture((Texture)i);
+
+    RemoveVramLedgerEntry(m_TransientHeap);
+    NRI.FreeMemory(m_TransientHeap);
+    m_TransientHeap = nullptr;
+
+    CreateResolutionDependentTextures(swapChainFormat);
+    UpdateDescriptorSets();
+    NRI_ABORT_ON_FALSE(RecreateNrd());
+
+    m_Settings.resolutionScale = max(m_Settings.resolutionScale, m_MinResolutionScale);
+    m_DrsResolutionScale = m_Settings.resolutionScale;
+    m_ForceHistoryReset = true;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
-    const QueuedFrame& queuedFrame = m_QueuedFrames[frameIndex % GetQueuedFrameNum()];
+    uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
+    QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+
+    // Waiting for more frames than needed to recycle the queued frame reduces latency
+    uint32_t framesInFlight = clamp(m_FramesInFlight, 1u, GetQueuedFrameNum());
+    NRI.Wait(*m_FrameFence, frameIndex >= framesInFlight ? 1 + frameIndex - framesInFlight : 0);
+
+    // Delay CPU start to submit "just in time"
+    if (m_LatencyDelay > 0.0f)
+        WaitUntil(m_Timer.GetTimeStamp() + m_LatencyDelay);
+
+    // The previous frame using this queued frame is finished
+    ResolveLatency(queuedFrameIndex);
+    ResolveSharcStats(queuedFrameIndex);
 
-    NRI.Wait(*m_FrameFence, frameIndex >= GetQueuedFrameNum() ? 1 + frameIndex - GetQueuedFrameNum() : 0);
+    // Async compute work is waited by the graphics queue, thus covered by the frame fence
+    for (uint32_t i = 0; i < (uint32_t)Stage::MAX_NUM; i++) {
+        NRI.ResetCommandAllocator(*queuedFrame.stageCommandAllocators[i]);
+
+        if (queuedFrame.computeCommandAllocators[i])
+            NRI.ResetCommandAllocator(*queuedFrame.computeCommandAllocators[i]);
+    }
     NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
 }
 
-void Sample::PrepareFrame(uint32_t frameIndex) {
-    nri::nriBeginAnnotation("Prepare frame", nri::BGRA_UNUSED);
+void Sample::ResolveSharcStats(uint32_t queuedFrameIndex) {
+    if (!m_IsSharcStatsPending[queuedFrameIndex])
+        return;
 
-    m_ForceHistoryReset = false;
-    m_SettingsPrev = m_Settings;
-    m_Camera.SavePreviousState();
+    m_IsSharcStatsPending[queuedFrameIndex] = false;
 
-    if (IsKeyToggled(Key::Tab))
-        m_ShowUi = !m_ShowUi;
-    if (IsKeyToggled(Key::F1))
-        m_Settings.debug = step(0.5f, 1.0f - m_Settings.debug);
-    if (IsKeyToggled(Key::F3))
-        m_Settings.emission = !m_Settings.emission;
-    if (IsKeyToggled(Key::Space))
-        m_Settings.pauseAnimation = !m_Settings.pauseAnimation;
-    if (IsKeyToggled(Key::PageDown) || IsKeyToggled(Key::Num3)) {
-        m_Settings.denoiser++;
-        if (m_Settings.denoiser > DENOISER_REFERENCE)
-            m_Settings.denoiser = DENOISER_REBLUR;
+    const uint64_t statsSize = SHARC_STAT_NUM * sizeof(uint32_t);
+    std::array<uint32_t, SHARC_STAT_NUM> stats = {};
+    memcpy(stats.data(), NRI.MapBuffer(*m_SharcStatsReadbackBuffer, queuedFrameIndex * statsSize, statsSize), statsSize);
+    NRI.UnmapBuffer(*m_SharcStatsReadbackBuffer);
+
+    uint32_t occupied = stats[SHARC_STAT_OCCUPIED];
+    uint32_t inserted = stats[SHARC_STAT_INSERTED];
+    float invOccupied = occupied ? 100.0f / occupied : 0.0f;
+
+    std::array<float, (size_t)SharcMetric::MAX_NUM> metrics = {};
+    metrics[(uint32_t)SharcMetric::Occupancy] = 100.0f * occupied / m_SharcCapacity;
+    metrics[(uint32_t)SharcMetric::Stale] = (occupied - stats[SHARC_STAT_UPDATED]) * invOccupied;
+    metrics[(uint32_t)SharcMetric::Collisions] = stats[SHARC_STAT_DISPLACED] * invOccupied;
+    metrics[(uint32_t)SharcMetric::FullBuckets] = stats[SHARC_STAT_BUCKETS] ? 100.0f * stats[SHARC_STAT_FULL_BUCKETS] / stats[SHARC_STAT_BUCKETS] : 0.0f;
+    metrics[(uint32_t)SharcMetric::Insertions] = (float)inserted;
+    metrics[(uint32_t)SharcMetric::Evictions] = m_SharcOccupiedPrev + inserted > occupied ? float(m_SharcOccupiedPrev + inserted - occupied) : 0.0f;
+
+    m_SharcOccupiedPrev = occupied;
+
+    // Home slots in "SharcStats" must match "HashGridInsert", otherwise "Collisions" and "Full buckets" are meaningless
+    if (stats[SHARC_STAT_MISPLACED] && !m_SharcMisplacedNum) {
+        printf("SHARC telemetry: %u entries outside of the probed range of their home slot, home slot computation is out of sync with SHARC!\n", stats[SHARC_STAT_MISPLACED]);
+        assert(false && "SHARC home slot mismatch");
     }
-    if (IsKeyToggled(Key::PageUp) || IsKeyToggled(Key::Num9)) {
-        m_Settings.denoiser--;
-        if (m_Settings.denoiser < DENOISER_REBLUR)
-            m_Settings.denoiser = DENOISER_REFERENCE;
+    m_SharcMisplacedNum = stats[SHARC_STAT_MISPLACED];
+
+    uint32_t head = m_SharcSampleNum++ % TIMING_HISTORY_SIZE;
+    for (uint32_t i = 0; i < (uint32_t)SharcMetric::MAX_NUM; i++)
+        m_SharcHistory[i][head] = metrics[i];
+}
+
+void Sample::PrintSharcTelemetry() const {
+    uint32_t sampleNum = std::min(m_SharcSampleNum, TIMING_HISTORY_SIZE);
+    if (!sampleNum) {
+        printf("SHARC telemetry: no samples (use '--sharcTelemetry' or the UI toggle)\n");
+        return;
     }
 
-    ImGui::NewFrame();
-    if (!IsKeyPressed(Key::LAlt) && m_ShowUi) {
-        static const char* onScreenModes[] = {
-#if (NRD_MODE == OCCLUSION)
-            "Diffuse occlusion",
-            "Specular occlusion",
-#elif (NRD_MODE == DIRECTIONAL_OCCLUSION)
-            "Diffuse occlusion",
-#else
-            "Final",
-            "Denoised diffuse",
-            "Denoised specular",
-            "Diffuse occlusion",
-            "Specular occlusion",
-            "Shadow",
-            "Base color",
-            "Normal",
-            "Roughness",
-            "Metalness",
-            "Material ID",
-            "PSR throughput",
-            "World units",
-            "Instance index",
-            "UV",
-            "Curvature",
-            "Mip level (primary)",
-            "Mip level (specular)",
-#endif
-        };
+    printf("SHARC telemetry: %u entries, last %u frame(s)\n", m_SharcCapacity, sampleNum);
+    printf("| %16s | %10s | %10s | %10s | %10s |\n", "Metric", "Last", "Average", "p99", "Max");
+    printf("|------------------|------------|------------|------------|------------|\n");
 
-        static std::array<const char*, 4> nrdModes = {
-            "NORMAL",
-            "SH",
-            "OCCLUSION"
-            "DIRECTIONAL_OCCLUSION",
-        };
+    uint32_t last = (m_SharcSampleNum - 1) % TIMING_HISTORY_SIZE;
+    for (uint32_t i = 0; i < (uint32_t)SharcMetric::MAX_NUM; i++) {
+        const std::array<float, TIMING_HISTORY_SIZE>& history = m_SharcHistory[i];
 
-        const nrd::LibraryDesc& nrdLibraryDesc = *nrd::GetLibraryDesc();
+        double sum = 0.0;
+        float maxValue = 0.0f;
+        for (uint32_t j = 0; j < sampleNum; j++) {
+            sum += history[j];
+            maxValue = std::max(maxValue, history[j]);
+        }
 
-        char buf[256];
-        snprintf(buf, sizeof(buf) - 1, "NRD v%u.%u.%u (%u.%u) - %s [Tab]", nrdLibraryDesc.versionMajor, nrdLibraryDesc.versionMinor, nrdLibraryDesc.versionBuild, (uint32_t)nrdLibraryDesc.normalEncoding, (uint32_t)nrdLibraryDesc.roughnessEncoding, nrdModes[NRD_MODE]);
+        printf("| %16s | %10.2f | %10.2f | %10.2f | %10.2f |\n", g_SharcMetricNames[i], history[last], sum / sampleNum, GetPercentile(history, sampleNum, 0.99f), maxValue);
+    }
+}
 
-        ImGui::SetNextWindowPos(ImVec2(m_Settings.windowAlignment ? 5.0f : GetOutputResolution().x - m_UiWidth - 5.0f, 5.0f));
-        ImGui::SetNextWindowSize(ImVec2(0.0f, 0.0f));
-        ImGui::Begin(buf, nullptr, ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoResize);
-        {
-            float avgFrameTime = m_Timer.GetVerySmoothedFrameTime();
-            snprintf(buf, sizeof(buf), "%.1f FPS (%.2f ms) @ %up", 1000.0f / avgFrameTime, avgFrameTime, m_OutputResolution.y);
+void Sample::ResolveLatency(uint32_t queuedFrameIndex) {
+    LatencyMarkers& markers = m_LatencyMarkers[queuedFrameIndex];
+    if (!markers.isValid)
+        return;
+
+    markers.isValid = false;
+
+    const uint64_t timestampSize = (uint32_t)Timestamp::MAX_NUM * sizeof(uint64_t);
+    const uint64_t* timestamps = (uint64_t*)NRI.MapBuffer(*m_TimestampReadbackBuffer, queuedFrameIndex * timestampSize, timestampSize);
+    uint64_t gpuStart = timestamps[(uint32_t)Timestamp::FrameBegin];
+    uint64_t gpuEnd = timestamps[(uint32_t)Timestamp::FrameEnd];
+    uint64_t denoisingTicks = timestamps[(uint32_t)Timestamp::DenoisingEnd] - timestamps[(uint32_t)Timestamp::DenoisingBegin];
+    denoisingTicks += timestamps[(uint32_t)Timestamp::ReferenceEnd] - timestamps[(uint32_t)Timestamp::ReferenceBegin];
+    NRI.UnmapBuffer(*m_TimestampReadbackBuffer);
+
+    // GPU and CPU clocks are not synchronized, but GPU can't start the frame before submission. The tightest bound comes from
+    // frames submitted to an idle GPU (at least the first frames), in this case the latency is underestimated by the submission overhead only
+    double gpuStartTime = gpuStart * m_TimestampPeriod;
+    double gpuEndTime = gpuEnd * m_TimestampPeriod;
+    m_GpuClockOffset = std::min(m_GpuClockOffset, gpuStartTime - markers.submit);
+
+    float gpuTime = float(gpuEndTime - gpuStartTime);
+    float gpuIdle = (m_PrevGpuEnd != 0 && gpuStart > m_PrevGpuEnd) ? float((gpuStart - m_PrevGpuEnd) * m_TimestampPeriod) : 0.0f;
+    m_PrevGpuEnd = gpuEnd;
+
+    std::array<float, (size_t)LatencyMetric::MAX_NUM> metrics = {};
+    metrics[(uint32_t)LatencyMetric::InputToSubmit] = float(markers.submit - markers.input);
+    metrics[(uint32_t)LatencyMetric::InputToPresent] = float(markers.present - markers.input);
+    metrics[(uint32_t)LatencyMetric::SubmitToGpuStart] = float(gpuStartTime - m_GpuClockOffset - markers.submit);
+    metrics[(uint32_t)LatencyMetric::Gpu] = gpuTime;
+    metrics[(uint32_t)LatencyMetric::InputToGpuEnd] = float(gpuEndTime - m_GpuClockOffset - markers.input);
+    metrics[(uint32_t)LatencyMetric::GpuIdle] = gpuIdle;
+    metrics[(uint32_t)LatencyMetric::Denoising] = float(denoisingTicks * m_TimestampPeriod);
+
+    uint32_t head = m_LatencySampleNum++ % TIMING_HISTORY_SIZE;
+    for (uint32_t i = 0; i < (uint32_t)LatencyMetric::MAX_NUM; i++)
+        m_LatencyHistory[i][head] = metrics[i];
+
+    if (m_Drs)
+        UpdateDynamicResolution(gpuTime, markers.resolutionScale);
+
+    if (!m_AdaptiveLatency)
+        return;
+
+    // Adaptive latency: keep the GPU saturated with as little queued work as possible. If the GPU idles between frames
+    // the CPU is late: reduce the delay or, if there is nothing to reduce, allow one more frame in flight. Otherwise
+    // delay the CPU start a bit more, since a delay longer than a GPU frame is equivalent to one less frame in flight
+    m_LatencyWindowGpuIdle = m_LatencyWindowNum == 0 ? gpuIdle : std::min(m_LatencyWindowGpuIdle, gpuIdle);
+    m_LatencyWindowGpuTime = m_LatencyWindowNum == 0 ? gpuTime : std::max(m_LatencyWindowGpuTime, gpuTime);
+
+    if (++m_LatencyWindowNum < LATENCY_CONTROLLER_WINDOW)
+        return;
+
+    m_LatencyWindowNum = 0;
+
+    float step = m_LatencyWindowGpuTime * 0.05f;
+    if (m_LatencyWindowGpuIdle > LATENCY_GPU_IDLE_MARGIN) {
+        if (m_LatencyDelay > 0.0f)
+            m_LatencyDelay = std::max(m_LatencyDelay - m_LatencyWindowGpuIdle - step, 0.0f);
+        else if (m_FramesInFlight < GetQueuedFrameNum())
+            m_FramesInFlight++;
+    } else {
+        m_LatencyDelay += step;
 
-            ImVec4 colorFps = UI_GREEN;
-            if (avgFrameTime > 1000.0f / 59.5f)
-                colorFps = UI_YELLOW;
-            if (avgFrameTime > 1000.0f / 29.5f)
-                colorFps = UI_RED;
+        if (m_LatencyDelay > m_LatencyWindowGpuTime && m_FramesInFlight > 1) {
+            m_LatencyDelay -= m_LatencyWindowGpuTime;
+            m_FramesInFlight--;
+        }
+    }
+}
 
-            float lo = avgFrameTime * 0.5f;
-            float hi = avgFrameTime * 1.5f;
+void Sample::UpdateDynamicResolution(float gpuTime, float resolutionScale) {
+    // Cost model "GPU time = a + b * area", fitted with exponential forgetting. Samples come with the resolution scale used
+    // for the frame, since several frames are in flight
+    float area = resolutionScale * resolutionScale;
+    float4 sample = float4(area, gpuTime, area * area, area * gpuTime);
+    m_DrsMoments = m_DrsMoments.x == 0.0f ? sample : m_DrsMoments + (sample - m_DrsMoments) * 0.05f;
+
+    float variance = m_DrsMoments.z - m_DrsMoments.x * m_DrsMoments.x;
+    float covariance = m_DrsMoments.w - m_DrsMoments.x * m_DrsMoments.y;
+    float proportionalCost = m_DrsMoments.y / m_DrsMoments.x;
+
+    // At least a half of the cost scales with resolution (also a fallback if the resolution scale barely changes)
+    float b = variance > 1e-4f ? covariance / variance : 0.0f;
+    b = clamp(b, 0.5f * proportionalCost, proportionalCost);
+    float a = m_DrsMoments.y - b * m_DrsMoments.x;
+
+    if (m_DrsCooldown) {
+        m_DrsCooldown--;
+        return;
+    }
 
-            const uint32_t N = helper::GetCountOf(m_FrameTimes);
-            uint32_t head = frameIndex % N;
-            m_FrameTimes[head] = m_Timer.GetFrameTime();
-            ImGui::PushStyleColor(ImGuiCol_Text, colorFps);
-            ImGui::PlotLines("##Plot", m_FrameTimes.data(), N, head, buf, lo, hi, ImVec2(0.0f, 70.0f));
-            ImGui::PopStyleColor();
+    // Predict next frame cost: the model corrected by a half of the latest residual
+    float residual = gpuTime - (a + b * area);
+    float budget = 1000.0f / m_DrsTargetFps * DRS_BUDGET_HEADROOM;
+    float predictedTime = a + b * m_DrsResolutionScale * m_DrsResolutionScale + residual * 0.5f;
+
+    // Keep the current scale if the model can't predict it (no resolution dependent cost or not finite values)
+    if (!(b > DRS_MIN_AREA_COST))
+        return;
+
+    float desiredArea = (budget - a - residual * 0.5f) / b;
+    if (!std::isfinite(desiredArea))
+        return;
+
+    float desiredScale = sqrt(clamp(desiredArea, m_MinResolutionScale * m_MinResolutionScale, 1.0f));
+    desiredScale = max(floor(desiredScale / DRS_SCALE_STEP) * DRS_SCALE_STEP, m_MinResolutionScale);
+
+    // Hysteresis: downscale immediately if over budget, upscale only after being under budget for a while. Both reset
+    // NRD and TAA history partially, thus frequent changes must be avoided
+    bool isChanged = false;
+    if (predictedTime > budget && desiredScale < m_DrsResolutionScale) {
+        m_DrsResolutionScale = desiredScale;
+        isChanged = true;
+    } else if (desiredScale > m_DrsResolutionScale + DRS_HYSTERESIS) {
+        if (++m_DrsUnderBudgetNum >= DRS_UPSCALE_DELAY) {
+            m_DrsResolutionScale = desiredScale;
+            isChanged = true;
+        }
+    } else
+        m_DrsUnderBudgetNum = 0;
 
-            if (IsButtonPressed(Button::Right)) {
-                ImGui::Text("Move - W/S/A/D");
-                ImGui::Text("Accelerate - MOUSE SCROLL");
-            } else {
-                // "Camera" section
-                ImGui::PushStyleColor(ImGuiCol_Text, UI_HEADER);
-                ImGui::PushStyleColor(ImGuiCol_Header, UI_HEADER_BACKGROUND);
-                bool isUnfolded = ImGui::CollapsingHeader("CAMERA (press RIGHT MOUSE BOTTON for free-fly mode)", ImGuiTreeNodeFlags_CollapsingHeader | ImGuiTreeNodeFlags_DefaultOpen);
-                ImGui::PopStyleColor();
-                ImGui::PopStyleColor();
+    // Wait for frames rendered with the new scale
+    if (isChanged) {
+        m_DrsCooldown = GetQueuedFrameNum() + 1;
+        m_DrsUnderBudgetNum = 0;
+    }
+}
 
-                ImGui::PushID("CAMERA");
-                if (isUnfolded) {
-                    static const char* motionMode[] = {
-                        "Left / Right",
-                        "Up / Down",
-                        "Forward / Backward",
-                        "Mixed",
-                        "Pan",
-                    };
+const std::string& Sample::GetTestPath() {
+    if (m_TestPath.empty()) {
+        std::string sceneName = std::string(utils::GetFileName(m_SceneFile));
+        size_t dotPos = sceneName.find_last_of(".");
+        if (dotPos != std::string::npos)
+            sceneName = sceneName.substr(0, dotPos) + ".bin";
+
+        m_TestPath = utils::GetFullPath(sceneName, utils::DataFolder::TESTS);
+    }
+
+    return m_TestPath;
+}
+
+uint32_t Sample::GetTestNum() {
+    const std::string& path = GetTestPath();
+    const uint32_t testByteSize = sizeof(m_Settings) + Camera::GetStateSize();
+
+    if (m_TestNum == uint32_t(-1)) {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (fp) {
+// Use this code to convert tests to reflect new Settings and Camera layouts
+#if 0
+                typedef Settings SettingsOld; // adjust if needed
+                typedef Camera CameraOld; // adjust if needed
+
+                const uint32_t oldItemSize = sizeof(SettingsOld) + CameraOld::GetStateSize();
+
+                fseek(fp, 0, SEEK_END);
+                m_TestNum = ftell(fp) / oldItemSize;
+                fseek(fp, 0, SEEK_SET);
+
+                FILE* fpNew;
+                fopen_s(&fpNew, (path + ".new").c_str(), "wb");
+
+                for (uint32_t i = 0; i < m_TestNum && fpNew; i++)
+                {
+                    SettingsOld settingsOld;
+                    fread_s(&settingsOld, sizeof(SettingsOld), 1, sizeof(SettingsOld), fp);
+
+                    CameraOld cameraOld;
+                    fread_s(cameraOld.GetState(), CameraOld::GetStateSize(), 1, CameraOld::GetStateSize(), fp);
+
+                    // Convert Old to New here
+                    m_Settings = settingsOld;
+                    m_Camera.state = cameraOld.state;
+
+                    // ...
+
+                    fwrite(&m_Settings, 1, sizeof(m_Settings), fpNew);
+                    fwrite(m_Camera.GetState(), 1, Camera::GetStateSize(), fpNew);
+                }
+
+                fclose(fp);
+                fclose(fpNew);
+
+                __debugbreak();
+#endif
+
+            fseek(fp, 0, SEEK_END);
+            m_TestNum = ftell(fp) / testByteSize;
+            fclose(fp);
+        } else
+            m_TestNum = 0;
+    }
+
+    return m_TestNum;
+}
+
+bool Sample::LoadTest(uint32_t test) {
+    const std::string& path = GetTestPath();
+    const uint32_t testByteSize = sizeof(m_Settings) + Camera::GetStateSize();
+
+    FILE* fp = fopen(path.c_str(), "rb");
+    bool isLoaded = fp && fseek(fp, test * testByteSize, SEEK_SET) == 0;
+
+    if (isLoaded) {
+        size_t elemNum = fread(&m_Settings, sizeof(m_Settings), 1, fp);
+        if (elemNum == 1)
+            elemNum = fread(m_Camera.GetState(), Camera::GetStateSize(), 1, fp);
+
+        m_LastSelectedTest = test;
+
+        // File read error
+        if (elemNum != 1) {
+            m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, CAMERA_RELATIVE);
+            m_Settings = m_SettingsDefault;
+        }
+
+        // Reset some settings to defaults to avoid a potential confusion
+        m_Settings.debug = 0.0f;
+        m_Settings.denoiser = DENOISER_REBLUR;
+        m_Settings.RR = false;
+        m_Settings.SR = m_IsDlsrSupported;
+        m_Settings.TAA = true;
+        m_Settings.cameraJitter = true;
+
+        m_ForceHistoryReset = true;
+    }
+
+    if (fp)
+        fclose(fp);
+
+    return isLoaded;
+}
+
+void Sample::StartTuner(TunerMode mode) {
+    m_TunerSettings = m_Settings;
+    m_TunerCamera = m_Camera;
+    m_TunerDenoiser = m_Settings.denoiser == DENOISER_REFERENCE ? DENOISER_REBLUR : m_Settings.denoiser;
+    m_TunerTestNum = GetTestNum();
+    m_TunerTest = 0;
+    m_TunerCombination = 0;
+    m_TunerFrame = 0;
+    m_TunerMode = mode;
+
+    if (mode == TunerMode::Sweep) {
+        // A full cross product of all knob values is too long to render, thus each knob is swept alone around the current settings
+        TunerCombination current = {};
+        current[(uint32_t)TunerKnob::Rpp] = (float)m_Settings.rpp;
+        current[(uint32_t)TunerKnob::BounceNum] = (float)m_Settings.bounceNum;
+        current[(uint32_t)TunerKnob::TracingMode] = (float)m_Settings.tracingMode;
+        current[(uint32_t)TunerKnob::ResolutionScale] = m_Settings.resolutionScale;
+        current[(uint32_t)TunerKnob::SHARC] = m_Settings.SHARC ? 1.0f : 0.0f;
+        current[(uint32_t)TunerKnob::PSR] = m_Settings.PSR ? 1.0f : 0.0f;
+        current[(uint32_t)TunerKnob::ImportanceSampling] = m_Settings.importanceSampling ? 1.0f : 0.0f;
+        current[(uint32_t)TunerKnob::MaxAccumulatedFrameNum] = (float)m_Settings.maxAccumulatedFrameNum;
+
+        m_TunerCombinations.assign(1, current);
+        for (uint32_t i = 0; i < (uint32_t)TunerKnob::MAX_NUM; i++) {
+            const TunerKnobValues& knobValues = g_TunerKnobValues[i];
+
+            for (uint32_t j = 0; j < knobValues.num; j++) {
+                if (knobValues.values[j] == current[i])
+                    continue;
+
+                TunerCombination combination = current;
+                combination[i] = knobValues.values[j];
+                m_TunerCombinations.push_back(combination);
+            }
+        }
+
+        m_TunerState = TunerState::Reference;
+        m_TunerResults.assign(m_TunerCombinations.size(), {});
+    } else if (mode == TunerMode::Convergence) {
+        m_TunerState = TunerState::Settle;
+        m_TunerResults.assign(helper::GetCountOf(g_ConvergenceVariants), {});
+    } else {
+        m_TunerState = TunerState::Measure;
+        m_TunerResults.assign(helper::GetCountOf(g_CostDenoisers), {});
+    }
+
+    // A loaded test must be rendered in the same frame
+    m_TunerPipelinedSimulation = m_PipelinedSimulation;
+    m_PipelinedSimulation = false;
+
+    // Measurements need a fixed resolution
+    m_TunerDrs = m_Drs;
+    m_Drs = false;
+
+    { // Readback buffer for "Final"
+        const nri::TextureDesc& textureDesc = NRI.GetTextureDesc(*Get(Texture::Final));
+        const nri::FormatProps* formatProps = nriGetFormatProps(textureDesc.format);
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+        m_TunerReadbackRowPitch = helper::Align(textureDesc.width * formatProps->stride, deviceDesc.memoryAlignment.uploadBufferTextureRow);
+
+        nri::BufferDesc bufferDesc = {uint64_t(m_TunerReadbackRowPitch) * textureDesc.height, 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommittedBuffer(*m_Device, nri::MemoryLocation::HOST_READBACK, 0.0f, bufferDesc, m_TunerReadbackBuffer));
+    }
+
+    // Estimated run length ("Converge" steps are counted in full), tests can override "maxAccumulatedFrameNum"
+    uint32_t warmupFrameNum = TUNER_WARMUP_FRAME_NUM + TUNER_MEASURE_FRAME_NUM;
+    uint64_t frameNum = 0;
+    if (mode == TunerMode::Sweep) {
+        frameNum = TUNER_REFERENCE_FRAME_NUM;
+        for (const TunerCombination& combination : m_TunerCombinations)
+            frameNum += min((uint32_t)combination[(uint32_t)TunerKnob::MaxAccumulatedFrameNum], (uint32_t)MAX_HISTORY_FRAME_NUM) + warmupFrameNum;
+    } else if (mode == TunerMode::Convergence)
+        frameNum = m_TunerResults.size() * (TUNER_REFERENCE_FRAME_NUM + TUNER_CONVERGENCE_MAX_FRAME_NUM);
+    else
+        frameNum = m_TunerResults.size() * (m_Settings.maxAccumulatedFrameNum + warmupFrameNum);
+
+    frameNum *= max(m_TunerTestNum, 1u);
+    double minutes = double(frameNum) * m_Timer.GetVerySmoothedFrameTime() / 60000.0;
+
+    const char* items = mode == TunerMode::Sweep ? "combination(s)" : (mode == TunerMode::Convergence ? "convergence variant(s)" : "denoiser(s)");
+    printf("Tuner: %u test(s) x %u %s, up to %llu frame(s), ~%.1f min at the current frame rate...\n", max(m_TunerTestNum, 1u), (uint32_t)m_TunerResults.size(), items, (unsigned long long)frameNum, minutes);
+}
+
+void Sample::FinishTuner(bool isCompleted) {
+    uint32_t testNum = max(m_TunerTestNum, 1u);
+
+    if (isCompleted && m_TunerMode == TunerMode::DenoiserCost)
+        PrintDenoiserCosts();
+    else if (isCompleted && m_TunerMode == TunerMode::Convergence) {
+        printf("Tuner: frames to converge to %.0f dB after a history reset (average, worst, unconverged tests)\n", TUNER_CONVERGENCE_PSNR);
+        for (uint32_t i = 0; i < (uint32_t)m_TunerResults.size(); i++) {
+            const TunerResult& result = m_TunerResults[i];
+            printf("  %-24s %6.1f %4u %4u\n", g_ConvergenceVariants[i].name, double(result.frameNum) / testNum, result.maxFrameNum, result.unconvergedNum);
+        }
+    } else if (isCompleted) {
+        uint32_t combinationNum = (uint32_t)m_TunerCombinations.size();
+
+        for (TunerResult& result : m_TunerResults) {
+            result.gpuTime /= testNum;
+            result.mse /= testNum;
+        }
+
+        auto printCombination = [&](uint32_t combination) {
+            const TunerResult& result = m_TunerResults[combination];
+            double psnr = 10.0 * log10(1.0 / std::max(result.mse, 1e-12));
+
+            printf("%7.2f ms %6.2f dB  ", result.gpuTime, psnr);
+            for (uint32_t i = 0; i < (uint32_t)TunerKnob::MAX_NUM; i++)
+                printf(" %s=%g", g_TunerKnobNames[i], m_TunerCombinations[combination][i]);
+            printf("\n");
+        };
+
+        // Pareto front: combinations, which can't be beaten in GPU time without losing quality
+        std::vector<uint32_t> front;
+        for (uint32_t i = 0; i < combinationNum; i++) {
+            const TunerResult& a = m_TunerResults[i];
+
+            bool isDominated = false;
+            for (uint32_t j = 0; j < combinationNum && !isDominated; j++) {
+                const TunerResult& b = m_TunerResults[j];
+                isDominated = b.gpuTime <= a.gpuTime && b.mse <= a.mse && (b.gpuTime < a.gpuTime || b.mse < a.mse);
+            }
+
+            if (!isDominated)
+                front.push_back(i);
+        }
+
+        std::sort(front.begin(), front.end(), [&](uint32_t a, uint32_t b) { return m_TunerResults[a].gpuTime < m_TunerResults[b].gpuTime; });
+
+        printf("Tuner: Pareto front (GPU time, PSNR vs REFERENCE, settings)\n");
+        for (uint32_t combination : front) {
+            printf("  ");
+            printCombination(combination);
+        }
+
+        // Error decreases along the front, thus the best preset is the last one fitting into the budget
+        printf("Tuner: recommended presets\n");
+        for (float budget : g_TunerBudgets) {
+            uint32_t best = uint32_t(-1);
+            for (uint32_t combination : front) {
+                if (m_TunerResults[combination].gpuTime <= budget)
+                    best = combination;
+            }
+
+            printf("  %5.1f ms:", budget);
+            if (best == uint32_t(-1))
+                printf(" none\n");
+            else
+                printCombination(best);
+        }
+    } else
+        printf("Tuner: stopped\n");
+
+    if (isCompleted && m_SharcTelemetry)
+        PrintSharcTelemetry();
+
+    // A requested readback is not recorded yet, previous ones are consumed
+    m_TunerReadbackFrameIndex = uint32_t(-1);
+    NRI.DestroyBuffer(m_TunerReadbackBuffer);
+    m_TunerReadbackBuffer = nullptr;
+
+    m_Settings = m_TunerSettings;
+    m_Camera = m_TunerCamera;
+    m_PipelinedSimulation = m_TunerPipelinedSimulation;
+    m_Drs = m_TunerDrs;
+    m_ForceHistoryReset = true;
+    m_TunerState = TunerState::Idle;
+}
+
+bool Sample::NextTunerStep() {
+    m_TunerFrame = 0;
+
+    switch (m_TunerState) {
+        case TunerState::Reference:
+            m_TunerState = TunerState::Sweep;
+            return true;
+        case TunerState::Settle:
+            m_TunerState = TunerState::Converge;
+            return true;
+        default:
+            break;
+    }
+
+    // The next combination or variant
+    if (++m_TunerCombination < (uint32_t)m_TunerResults.size()) {
+        if (m_TunerState == TunerState::Converge)
+            m_TunerState = TunerState::Settle;
+
+        return true;
+    }
+
+    // The next test
+    m_TunerCombination = 0;
+    if (m_TunerMode == TunerMode::Sweep)
+        m_TunerState = TunerState::Reference;
+    else if (m_TunerMode == TunerMode::Convergence)
+        m_TunerState = TunerState::Settle;
+
+    return ++m_TunerTest < max(m_TunerTestNum, 1u);
+}
+
+void Sample::SetupTunerStep() {
+    if (m_TunerTestNum)
+        LoadTest(m_TunerTest);
+    else {
+        m_Settings = m_TunerSettings;
+        m_Camera = m_TunerCamera;
+    }
+
+    // Static, uncapped and not obstructed
+    m_Settings.onScreen = 0;
+    m_Settings.debug = 0.0f;
+    m_Settings.separator = 0.0f;
+    m_Settings.motionStartTime = 0.0;
+    m_Settings.pauseAnimation = true;
+    m_Settings.limitFps = false;
+    m_Settings.RR = false;
+    m_Settings.adaptiveAccumulation = false;
+
+    if (m_TunerState == TunerState::Reference) {
+        m_Settings.denoiser = DENOISER_REFERENCE;
+        m_Settings.rpp = (int32_t)GetTunerKnobMax(TunerKnob::Rpp);
+        m_Settings.bounceNum = (int32_t)GetTunerKnobMax(TunerKnob::BounceNum);
+        m_Settings.tracingMode = RESOLUTION_FULL;
+        m_Settings.resolutionScale = 1.0f;
+        m_Settings.SHARC = false; // biased
+        m_Settings.importanceSampling = true;
+    } else if (m_TunerState == TunerState::Sweep) {
+        const TunerCombination& combination = m_TunerCombinations[m_TunerCombination];
+
+        m_Settings.denoiser = m_TunerDenoiser;
+        m_Settings.rpp = (int32_t)combination[(uint32_t)TunerKnob::Rpp];
+        m_Settings.bounceNum = (int32_t)combination[(uint32_t)TunerKnob::BounceNum];
+        m_Settings.tracingMode = (int32_t)combination[(uint32_t)TunerKnob::TracingMode];
+        m_Settings.resolutionScale = max(combination[(uint32_t)TunerKnob::ResolutionScale], m_MinResolutionScale);
+        m_Settings.SHARC = combination[(uint32_t)TunerKnob::SHARC] != 0.0f;
+        m_Settings.PSR = combination[(uint32_t)TunerKnob::PSR] != 0.0f;
+        m_Settings.importanceSampling = combination[(uint32_t)TunerKnob::ImportanceSampling] != 0.0f;
+        m_Settings.maxAccumulatedFrameNum = min((int32_t)combination[(uint32_t)TunerKnob::MaxAccumulatedFrameNum], MAX_HISTORY_FRAME_NUM);
+        m_Settings.maxFastAccumulatedFrameNum = m_Settings.maxAccumulatedFrameNum / 5;
+    } else if (m_TunerState == TunerState::Measure)
+        m_Settings.denoiser = g_CostDenoisers[m_TunerCombination];
+    else {
+        // The test is loaded again, thus the history reset is the only difference between "Settle" and "Converge"
+        const ConvergenceVariant& variant = g_ConvergenceVariants[m_TunerCombination];
+        m_Settings.denoiser = variant.denoiser;
+        m_Settings.maxFastAccumulatedFrameNum = min(variant.maxFastAccumulatedFrameNum, m_Settings.maxAccumulatedFrameNum);
+        m_Settings.confidence = variant.confidence;
+    }
+
+    m_TunerGpuTime = 0.0;
+    m_TunerDenoisingTime = 0.0;
+    m_TunerMeasuredFrameNum = 0;
+    m_ForceHistoryReset = true;
+}
+
+uint32_t Sample::GetTunerStepFrameNum() const {
+    if (m_TunerState == TunerState::Sweep || m_TunerState == TunerState::Measure)
+        return uint32_t(m_Settings.maxAccumulatedFrameNum) + TUNER_WARMUP_FRAME_NUM + TUNER_MEASURE_FRAME_NUM;
+
+    if (m_TunerState == TunerState::Converge)
+        return TUNER_CONVERGENCE_MAX_FRAME_NUM;
+
+    return TUNER_REFERENCE_FRAME_NUM;
+}
+
+void Sample::PrintDenoiserCosts() {
+    uint32_t testNum = max(m_TunerTestNum, 1u);
+
+    printf("Tuner: denoiser cost at %ux%u, memory and dispatches are for the denoiser alone\n", m_RenderResolution.x, m_RenderResolution.y);
+    printf("| %36s | %10s | %10s | %10s | %10s | %10s | %10s |\n", "Denoiser", "Frame, ms", "NRD, ms", "Total, Mb", "Persist, Mb", "Alias, Mb", "Dispatches");
+
+    for (uint32_t i = 0; i < (uint32_t)helper::GetCountOf(g_CostDenoisers); i++) {
+        int32_t costDenoiser = g_CostDenoisers[i];
+        const TunerResult& result = m_TunerResults[i];
+
+        nrd::Identifier denoisers[MAX_OPAQUE_DENOISER_NUM];
+        uint32_t denoiserNum = GetOpaqueDenoisers(costDenoiser, denoisers);
+
+        nrd::DenoiserDesc denoiserDescs[MAX_OPAQUE_DENOISER_NUM] = {};
+        for (uint32_t j = 0; j < denoiserNum; j++)
+            denoiserDescs[j] = {denoisers[j], (nrd::Denoiser)denoisers[j]};
+
+        nrd::InstanceCreationDesc instanceCreationDesc = {};
+        instanceCreationDesc.denoisers = denoiserDescs;
+        instanceCreationDesc.denoisersNum = denoiserNum;
+
+        // Memory
+        nrd::IntegrationCreationDesc desc = {};
+        desc.queuedFrameNum = GetQueuedFrameNum();
+        desc.enableWholeLifetimeDescriptorCaching = NRD_ENABLE_WHOLE_LIFETIME_DESCRIPTOR_CACHING;
+        desc.promoteFloat16to32 = NRD_PROMOTE_FLOAT16_TO_32;
+        desc.demoteFloat32to16 = NRD_DEMOTE_FLOAT32_TO_16;
+        desc.resourceWidth = (uint16_t)m_RenderResolution.x;
+        desc.resourceHeight = (uint16_t)m_RenderResolution.y;
+
+        nrd::Integration integration;
+        integration.Recreate(desc, instanceCreationDesc, m_Device);
+
+        float totalMemory = integration.GetTotalMemoryUsageInMb();
+        float persistentMemory = integration.GetPersistentMemoryUsageInMb();
+        float aliasableMemory = integration.GetAliasableMemoryUsageInMb();
+
+        integration.Destroy();
+
+        // Dispatches for the last used common settings
+        uint32_t dispatchNum = 0;
+
+        nrd::Instance* instance = nullptr;
+        if (nrd::CreateInstance(instanceCreationDesc, instance) == nrd::Result::SUCCESS) {
+            const void* settings = &m_ReferenceSettings;
+            if (costDenoiser == DENOISER_REBLUR)
+                settings = &m_ReblurSettings;
+            else if (costDenoiser == DENOISER_RELAX)
+                settings = &m_RelaxSettings;
+
+            nrd::SetCommonSettings(*instance, m_CommonSettings);
+            for (uint32_t j = 0; j < denoiserNum; j++)
+                nrd::SetDenoiserSettings(*instance, denoisers[j], settings);
+
+            const nrd::DispatchDesc* dispatchDescs = nullptr;
+            nrd::GetComputeDispatches(*instance, denoisers, denoiserNum, dispatchDescs, dispatchNum);
+
+            nrd::DestroyInstance(*instance);
+        }
+
+        const char* name = nrd::GetDenoiserString((nrd::Denoiser)denoisers[0]);
+        printf("| %36s | %10.2f | %10.2f | %10.2f | %10.2f | %10.2f | %10u |\n", name, result.gpuTime / testNum, result.denoisingTime / testNum, totalMemory, persistentMemory, aliasableMemory, dispatchNum);
+    }
+}
+
+void Sample::ReadTunerImage() {
+    NRI.Wait(*m_FrameFence, 1 + m_TunerReadbackFrameIndex);
+    m_TunerReadbackFrameIndex = uint32_t(-1);
+
+    const nri::TextureDesc& textureDesc = NRI.GetTextureDesc(*Get(Texture::Final));
+    const nri::FormatProps* formatProps = nriGetFormatProps(textureDesc.format);
+
+    m_TunerImage.resize(size_t(textureDesc.width) * textureDesc.height * 3);
+    float* dst = m_TunerImage.data();
+
+    // Channel order doesn't matter, since the reference is decoded in the same way
+    const uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_TunerReadbackBuffer, 0, nri::WHOLE_SIZE);
+    for (uint32_t y = 0; y < textureDesc.height; y++) {
+        const uint8_t* row = data + y * m_TunerReadbackRowPitch;
+
+        for (uint32_t x = 0; x < textureDesc.width; x++, dst += 3) {
+            if (formatProps->stride == 8) { // RGBA16f
+                const uint16_t* texel = (const uint16_t*)row + x * 4;
+                for (uint32_t i = 0; i < 3; i++)
+                    dst[i] = HalfToFloat(texel[i]);
+            } else if (formatProps->redBits == 10) { // R10G10B10A2
+                uint32_t texel;
+                memcpy(&texel, row + x * 4, sizeof(texel));
+                for (uint32_t i = 0; i < 3; i++)
+                    dst[i] = float((texel >> (i * 10)) & 0x3FF) / 1023.0f;
+            } else { // RGBA8 / BGRA8
+                const uint8_t* texel = row + x * 4;
+                for (uint32_t i = 0; i < 3; i++)
+                    dst[i] = float(texel[i]) / 255.0f;
+            }
+        }
+    }
+    NRI.UnmapBuffer(*m_TunerReadbackBuffer);
+}
+
+double Sample::GetTunerImageMse() const {
+    double mse = 0.0;
+    for (size_t i = 0; i < m_TunerImage.size(); i++) {
+        double d = double(m_TunerImage[i]) - double(m_TunerReference[i]);
+        mse += d * d;
+    }
+
+    return mse / double(m_TunerImage.size());
+}
+
+void Sample::UpdateTuner(uint32_t frameIndex) {
+    if (m_TunerState == TunerState::Idle)
+        return;
+
+    bool isStepFinished = false;
+    if (m_TunerReadbackFrameIndex != uint32_t(-1)) {
+        // The previous frame is ready
+        ReadTunerImage();
+
+        isStepFinished = true;
+        if (m_TunerState == TunerState::Reference || m_TunerState == TunerState::Settle)
+            m_TunerReference.swap(m_TunerImage);
+        else if (m_TunerState == TunerState::Sweep) {
+            TunerResult& result = m_TunerResults[m_TunerCombination];
+            result.gpuTime += m_TunerMeasuredFrameNum ? m_TunerGpuTime / m_TunerMeasuredFrameNum : 0.0;
+            result.mse += GetTunerImageMse();
+        } else {
+            // "m_TunerFrame" frames have been rendered since the reset, including the read back one
+            double psnr = 10.0 * log10(1.0 / std::max(GetTunerImageMse(), 1e-12));
+            bool isConverged = psnr >= TUNER_CONVERGENCE_PSNR;
+
+            isStepFinished = isConverged || m_TunerFrame >= TUNER_CONVERGENCE_MAX_FRAME_NUM;
+            if (isStepFinished) {
+                TunerResult& result = m_TunerResults[m_TunerCombination];
+                result.frameNum += m_TunerFrame;
+                result.maxFrameNum = max(result.maxFrameNum, m_TunerFrame);
+                result.unconvergedNum += isConverged ? 0 : 1;
+
+                printf("  test %u, %s: %u frame(s)%s\n", m_TunerTest + 1, g_ConvergenceVariants[m_TunerCombination].name, m_TunerFrame, isConverged ? "" : " (not converged)");
+            }
+        }
+    } else if (m_TunerState == TunerState::Measure && m_TunerFrame == GetTunerStepFrameNum()) {
+        // Timings only, no readback
+        TunerResult& result = m_TunerResults[m_TunerCombination];
+        result.gpuTime += m_TunerMeasuredFrameNum ? m_TunerGpuTime / m_TunerMeasuredFrameNum : 0.0;
+        result.denoisingTime += m_TunerMeasuredFrameNum ? m_TunerDenoisingTime / m_TunerMeasuredFrameNum : 0.0;
+
+        isStepFinished = true;
+    }
+
+    if (isStepFinished && !NextTunerStep()) {
+        FinishTuner(true);
+        return;
+    }
+
+    if (m_TunerFrame == 0)
+        SetupTunerStep();
+
+    uint32_t frameNum = GetTunerStepFrameNum();
+    if (m_TunerState == TunerState::Sweep || m_TunerState == TunerState::Measure) {
+        // Timings are resolved with a delay, but warm-up is longer than the queue
+        if (m_TunerFrame >= frameNum - TUNER_MEASURE_FRAME_NUM && m_LatencySampleNum) {
+            uint32_t sample = (m_LatencySampleNum - 1) % TIMING_HISTORY_SIZE;
+
+            m_TunerGpuTime += m_LatencyHistory[(size_t)LatencyMetric::Gpu][sample];
+            m_TunerDenoisingTime += m_LatencyHistory[(size_t)LatencyMetric::Denoising][sample];
+            m_TunerMeasuredFrameNum++;
+        }
+    }
+
+    // Read back the last frame of the step or every frame while converging
+    bool isLastFrame = ++m_TunerFrame == frameNum;
+    if ((isLastFrame && m_TunerState != TunerState::Measure) || m_TunerState == TunerState::Converge)
+        m_TunerReadbackFrameIndex = frameIndex;
+}
+
+void Sample::PrepareFrame(uint32_t frameIndex) {
+    nri::nriBeginAnnotation("Prepare frame", nri::BGRA_UNUSED);
+
+    m_Allocator.BeginFrame();
+
+    { // Heap allocations in the previous frame: the steady state must not allocate
+        uint64_t heapAllocationNum = g_HeapAllocationNum.load(std::memory_order_relaxed);
+        m_FrameHeapAllocationNum = (uint32_t)(heapAllocationNum - m_HeapAllocationNumPrev);
+        m_HeapAllocationNumPrev = heapAllocationNum;
+
+        for (uint32_t i = 0; i < (uint32_t)AllocationTag::MAX_NUM; i++)
+            m_FrameHeapAllocationNum += m_Allocator.GetStats((AllocationTag)i).frameUpstreamAllocationNum;
+
+        if (m_AllocationWarmupFrameNum)
+            m_AllocationWarmupFrameNum--;
+        else if (m_FrameHeapAllocationNum) {
+            m_SteadyStateAllocationFrameNum++;
+
+            // Not an assert, the check must work in all builds
+            if (m_CheckAllocations) {
+                printf("Frame %u: %u heap allocations after warm-up!\n", frameIndex - 1, m_FrameHeapAllocationNum);
+                g_ExitCode = 1;
+            }
+        }
+    }
+
+    m_ForceHistoryReset = false;
+    m_SettingsPrev = m_Settings;
+
+    // Dynamic resolution (RR doesn't support DRS)
+    if (m_Drs && !m_Settings.RR)
+        m_Settings.resolutionScale = m_DrsResolutionScale;
+    else
+        m_DrsResolutionScale = m_Settings.resolutionScale;
+
+    // Pipelined simulation: this frame has been simulated during the previous frame
+    bool isSimulated = m_IsSimulationPending;
+    if (m_IsSimulationPending) {
+        {
+            std::unique_lock<std::mutex> lock(m_SimulationMutex);
+            m_SimulationFinish.wait(lock, [&] { return !m_IsSimulationRunning; });
+        }
+
+        ApplySimulation();
+        m_IsSimulationPending = false;
+    }
+
+    if (IsKeyToggled(Key::Tab))
+        m_ShowUi = !m_ShowUi;
+    if (IsKeyToggled(Key::F1))
+        m_Settings.debug = step(0.5f, 1.0f - m_Settings.debug);
+    if (IsKeyToggled(Key::F3))
+        m_Settings.emission = !m_Settings.emission;
+    if (IsKeyToggled(Key::Space))
+        m_Settings.pauseAnimation = !m_Settings.pauseAnimation;
+    if (IsKeyToggled(Key::PageDown) || IsKeyToggled(Key::Num3)) {
+        m_Settings.denoiser++;
+        if (m_Settings.denoiser > DENOISER_REFERENCE)
+            m_Settings.denoiser = DENOISER_REBLUR;
+    }
+    if (IsKeyToggled(Key::PageUp) || IsKeyToggled(Key::Num9)) {
+        m_Settings.denoiser--;
+        if (m_Settings.denoiser < DENOISER_REBLUR)
+            m_Settings.denoiser = DENOISER_REFERENCE;
+    }
+
+    // Tuner (before UI, to let the user stop it)
+    UpdateTuner(frameIndex);
+
+    ImGui::NewFrame();
+    if (!IsKeyPressed(Key::LAlt) && m_ShowUi) {
+        static const char* onScreenModes[] = {
+#if (NRD_MODE == OCCLUSION)
+            "Diffuse occlusion",
+            "Specular occlusion",
+#elif (NRD_MODE == DIRECTIONAL_OCCLUSION)
+            "Diffuse occlusion",
+#else
+            "Final",
+            "Denoised diffuse",
+            "Denoised specular",
+            "Diffuse occlusion",
+            "Specular occlusion",
+            "Shadow",
+            "Base color",
+            "Normal",
+            "Roughness",
+            "Metalness",
+            "Material ID",
+            "PSR throughput",
+            "World units",
+            "Instance index",
+            "UV",
+            "Curvature",
+            "Mip level (primary)",
+            "Mip level (specular)",
+#endif
+        };
+
+        static std::array<const char*, 4> nrdModes = {
+            "NORMAL",
+            "SH",
+            "OCCLUSION"
+            "DIRECTIONAL_OCCLUSION",
+        };
+
+        const nrd::LibraryDesc& nrdLibraryDesc = *nrd::GetLibraryDesc();
+
+        char buf[256];
+        snprintf(buf, sizeof(buf) - 1, "NRD v%u.%u.%u (%u.%u) - %s [Tab]", nrdLibraryDesc.versionMajor, nrdLibraryDesc.versionMinor, nrdLibraryDesc.versionBuild, (uint32_t)nrdLibraryDesc.normalEncoding, (uint32_t)nrdLibraryDesc.roughnessEncoding, nrdModes[NRD_MODE]);
+
+        ImGui::SetNextWindowPos(ImVec2(m_Settings.windowAlignment ? 5.0f : GetOutputResolution().x - m_UiWidth - 5.0f, 5.0f));
+        ImGui::SetNextWindowSize(ImVec2(0.0f, 0.0f));
+        ImGui::Begin(buf, nullptr, ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoResize);
+        {
+            float avgFrameTime = m_Timer.GetVerySmoothedFrameTime();
+            snprintf(buf, sizeof(buf), "%.1f FPS (%.2f ms) @ %up", 1000.0f / avgFrameTime, avgFrameTime, m_OutputResolution.y);
+
+            ImVec4 colorFps = UI_GREEN;
+            if (avgFrameTime > 1000.0f / 59.5f)
+                colorFps = UI_YELLOW;
+            if (avgFrameTime > 1000.0f / 29.5f)
+                colorFps = UI_RED;
+
+            float lo = avgFrameTime * 0.5f;
+            float hi = avgFrameTime * 1.5f;
+
+            const uint32_t N = helper::GetCountOf(m_FrameTimes);
+            uint32_t head = frameIndex % N;
+            m_FrameTimes[head] = m_Timer.GetFrameTime();
+            ImGui::PushStyleColor(ImGuiCol_Text, colorFps);
+            ImGui::PlotLines("##Plot", m_FrameTimes.data(), N, head, buf, lo, hi, ImVec2(0.0f, 70.0f));
+
+            // Frame-to-frame delta distribution in the same range
+            std::array<float, FRAME_TIME_HISTOGRAM_BIN_NUM> histogram = {};
+            for (float frameTime : m_FrameTimes) {
+                if (frameTime != 0.0f) {
+                    uint32_t bin = (uint32_t)clamp(int32_t((frameTime - lo) / (hi - lo) * FRAME_TIME_HISTOGRAM_BIN_NUM), 0, int32_t(FRAME_TIME_HISTOGRAM_BIN_NUM - 1));
+                    histogram[bin] += 1.0f;
+                }
+            }
+
+            snprintf(buf, sizeof(buf), "%.2f - %.2f ms", lo, hi);
+            ImGui::PlotHistogram("##Histogram", histogram.data(), FRAME_TIME_HISTOGRAM_BIN_NUM, 0, buf, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+            ImGui::PopStyleColor();
+
+            if (IsButtonPressed(Button::Right)) {
+                ImGui::Text("Move - W/S/A/D");
+                ImGui::Text("Accelerate - MOUSE SCROLL");
+            } else {
+                // "Camera" section
+                ImGui::PushStyleColor(ImGuiCol_Text, UI_HEADER);
+                ImGui::PushStyleColor(ImGuiCol_Header, UI_HEADER_BACKGROUND);
+                bool isUnfolded = ImGui::CollapsingHeader("CAMERA (press RIGHT MOUSE BOTTON for free-fly mode)", ImGuiTreeNodeFlags_CollapsingHeader | ImGuiTreeNodeFlags_DefaultOpen);
+                ImGui::PopStyleColor();
+                ImGui::PopStyleColor();
+
+                ImGui::PushID("CAMERA");
+                if (isUnfolded) {
+                    static const char* motionMode[] = {
+                        "Left / Right",
+                        "Up / Down",
+                        "Forward / Backward",
+                        "Mixed",
+                        "Pan",
+                    };
 
                     static const char* mvType[] = {
                         "2D",
@@ -1229,11 +3029,11 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                     ImGui::SliderFloat("FOV (deg)", &m_Settings.camFov, 1.0f, 160.0f, "%.1f");
                     ImGui::SliderFloat("Exposure", &m_Settings.exposure, 0.0f, 1000.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
 
-                    if (m_DLRR) {
+                    if (m_IsDlrrSupported) {
                         ImGui::Checkbox("DLSS-RR", &m_Settings.RR);
                         ImGui::SameLine();
                     }
-                    if (m_DLSR && !m_Settings.RR) {
+                    if (m_IsDlsrSupported && !m_Settings.RR) {
                         ImGui::Checkbox("DLSS-SR", &m_Settings.SR);
                         ImGui::SameLine();
                     }
@@ -1244,8 +3044,46 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                     ImGui::SetNextItemWidth(ImGui::CalcItemWidth() - ImGui::GetCursorPosX() + ImGui::GetStyle().ItemSpacing.x);
                     if (m_Settings.RR)
                         m_Settings.resolutionScale = 1.0f; // TODO: RR doesn't support DRS
-                    else
+                    else {
+                        ImGui::BeginDisabled(m_Drs);
                         ImGui::SliderFloat("Resolution scale (%)", &m_Settings.resolutionScale, m_MinResolutionScale, 1.0f, "%.3f");
+                        ImGui::EndDisabled();
+
+                        ImGui::Checkbox("DRS", &m_Drs);
+                        if (m_Drs) {
+                            ImGui::SameLine();
+                            ImGui::SetNextItemWidth(ImGui::CalcItemWidth() - ImGui::GetCursorPosX() + ImGui::GetStyle().ItemSpacing.x);
+                            ImGui::SliderFloat("Target FPS", &m_DrsTargetFps, 30.0f, 144.0f, "%.0f");
+                        }
+                    }
+
+                    // Changing render resolution recreates resolution dependent resources
+                    if (m_DlssQuality != -1 && m_IsDlsrSupported) {
+                        static const char* dlssQuality[] = {
+                            "Ultra performance",
+                            "Performance",
+                            "Balanced",
+                            "Quality",
+                            "Native",
+                        };
+
+                        m_IsResizeRequested |= ImGui::Combo("DLSS quality", &m_DlssQuality, dlssQuality, helper::GetCountOf(dlssQuality));
+                    } else {
+                        static const char* renderResolution[] = {
+                            "Native",
+                            "600p",
+                            "720p",
+                            "1080p",
+                            "1440p",
+                            "2160p",
+                        };
+
+                        int32_t renderResolutionPreset = m_RenderResolutionPreset + 1;
+                        if (ImGui::Combo("Render resolution", &renderResolutionPreset, renderResolution, helper::GetCountOf(renderResolution))) {
+                            m_RenderResolutionPreset = renderResolutionPreset - 1;
+                            m_IsResizeRequested = true;
+                        }
+                    }
 
                     ImGui::SliderFloat("Aperture (cm)", &m_DofAperture, 0.0f, 100.0f, "%.2f");
                     ImGui::SliderFloat("Focal distance (m)", &m_DofFocalDistance, NEAR_Z, 10.0f, "%.3f");
@@ -1255,6 +3093,9 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                         ImGui::SameLine();
                         ImGui::SetNextItemWidth(ImGui::CalcItemWidth() - ImGui::GetCursorPosX() + ImGui::GetStyle().ItemSpacing.x);
                         ImGui::SliderFloat("Max FPS", &m_Settings.maxFps, 30.0f, 120.0f, "%.0f");
+
+                        uint32_t pacingSampleNum = std::min(m_PacingSampleNum, TIMING_HISTORY_SIZE);
+                        ImGui::Text("Pacing error (ms), p50 / p99: %.3f / %.3f", GetPercentile(m_PacingErrors, pacingSampleNum, 0.5f), GetPercentile(m_PacingErrors, pacingSampleNum, 0.99f));
                     }
 
                     ImGui::PushStyleColor(ImGuiCol_Text, m_Settings.motionStartTime > 0.0 ? UI_YELLOW : UI_DEFAULT);
@@ -1432,6 +3273,41 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                         ImGui::PushStyleColor(ImGuiCol_Text, m_Settings.PSR ? UI_GREEN : UI_YELLOW);
                         ImGui::Checkbox("PSR", &m_Settings.PSR);
                         ImGui::PopStyleColor();
+
+#if (NRD_MODE < OCCLUSION)
+                        if (m_Settings.SHARC) {
+                            int32_t sharcCapacityTier = (int32_t)m_SharcCapacityTier;
+                            m_IsSharcRecreationRequested |= ImGui::Combo("SHARC capacity", &sharcCapacityTier, g_SharcCapacityTierNames, helper::GetCountOf(g_SharcCapacityTierNames));
+                            m_SharcCapacityTier = (uint32_t)sharcCapacityTier;
+
+                            ImGui::Text("  %u entries (%.1f Mb, %s), recommended: %u", m_SharcCapacity, GetSharcMemorySize() / (1024.0 * 1024.0), SHARC_USE_FP16 ? "FP16" : "FP32", GetRecommendedSharcCapacity());
+
+                            int32_t sharcUpdateFraction = (int32_t)m_SharcUpdateFraction;
+                            ImGui::Combo("SHARC update", &sharcUpdateFraction, g_SharcUpdateFractionNames, helper::GetCountOf(g_SharcUpdateFractionNames));
+                            m_SharcUpdateFraction = (uint32_t)sharcUpdateFraction;
+
+                            ImGui::Checkbox("SHARC telemetry", &m_SharcTelemetry);
+                            if (m_SharcTelemetry) {
+                                ImGui::SameLine();
+                                if (ImGui::Button("Print"))
+                                    PrintSharcTelemetry();
+
+                                // Time series, oldest to newest
+                                uint32_t offset = m_SharcSampleNum % TIMING_HISTORY_SIZE;
+                                uint32_t last = (m_SharcSampleNum + TIMING_HISTORY_SIZE - 1) % TIMING_HISTORY_SIZE;
+                                for (uint32_t i = 0; i < (uint32_t)SharcMetric::MAX_NUM && m_SharcSampleNum; i++) {
+                                    const std::array<float, TIMING_HISTORY_SIZE>& history = m_SharcHistory[i];
+
+                                    char overlay[64];
+                                    snprintf(overlay, sizeof(overlay), "%s: %.1f", g_SharcMetricNames[i], history[last]);
+
+                                    ImGui::PushID(i);
+                                    ImGui::PlotLines("##SharcMetric", history.data(), TIMING_HISTORY_SIZE, offset, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 30.0f));
+                                    ImGui::PopID();
+                                }
+                            }
+                        }
+#endif
                     }
                     ImGui::PopID();
 
@@ -1698,6 +3574,62 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                         ImGui::SliderFloat("Debug [F1]", &m_Settings.debug, 0.0f, 1.0f, "%.6f");
                         ImGui::SliderFloat("Input / Denoised", &m_Settings.separator, 0.0f, 1.0f, "%.2f");
 
+                        ImGui::PushStyleColor(ImGuiCol_Text, GetTraceOpaquePipeline() == Pipeline::TraceOpaque ? UI_DEFAULT : UI_GREEN);
+                        ImGui::Checkbox("Specialized shaders", &m_UseSpecializedShaders);
+                        ImGui::PopStyleColor();
+
+                        ImGui::SameLine();
+                        if (ImGui::Button("Print render graph"))
+                            m_PrintRenderGraph = true;
+
+                        if (ImGui::Button("Print VRAM ledger"))
+                            PrintVramLedger(true);
+
+                        ImGui::Checkbox("Hoist barriers", &m_HoistBarriers);
+                        ImGui::SameLine();
+                        ImGui::Text("(%u barriers, %u flushes)", m_BarrierNum, m_BarrierFlushNum);
+
+                        ImGui::BeginDisabled(m_Settings.denoiser == DENOISER_REFERENCE);
+                        ImGui::Checkbox("Multithreaded recording", &m_MultithreadedRecording);
+                        ImGui::EndDisabled();
+
+                        ImGui::BeginDisabled(!m_ComputeQueue);
+                        ImGui::SameLine();
+                        ImGui::Checkbox("Async compute", &m_AsyncCompute);
+                        ImGui::EndDisabled();
+
+                        ImGui::Checkbox("Pipelined simulation", &m_PipelinedSimulation); // +1 frame of input latency
+                        ImGui::SameLine();
+                        ImGui::Checkbox("Adaptive latency", &m_AdaptiveLatency);
+
+                        ImGui::BeginDisabled(m_AdaptiveLatency);
+                        ImGui::SliderInt("Frames in flight", (int32_t*)&m_FramesInFlight, 1, (int32_t)GetQueuedFrameNum());
+                        ImGui::SliderFloat("CPU start delay (ms)", &m_LatencyDelay, 0.0f, 33.0f, "%.2f");
+                        ImGui::EndDisabled();
+
+                        uint32_t latencySampleNum = std::min(m_LatencySampleNum, TIMING_HISTORY_SIZE);
+                        ImGui::Text("Latency (ms), p50 / p90 / p99:");
+                        for (uint32_t i = 0; i < (uint32_t)LatencyMetric::MAX_NUM; i++) {
+                            const std::array<float, TIMING_HISTORY_SIZE>& history = m_LatencyHistory[i];
+
+                            ImGui::PushStyleColor(ImGuiCol_Text, i == (uint32_t)LatencyMetric::InputToGpuEnd ? UI_GREEN : UI_DEFAULT);
+                            ImGui::Text("  %s: %.2f / %.2f / %.2f", g_LatencyMetricNames[i], GetPercentile(history, latencySampleNum, 0.5f), GetPercentile(history, latencySampleNum, 0.9f), GetPercentile(history, latencySampleNum, 0.99f));
+                            ImGui::PopStyleColor();
+                        }
+
+                        ImGui::Text("CPU allocations per frame (upstream), live / peak (Kb):");
+                        for (uint32_t i = 0; i < (uint32_t)AllocationTag::MAX_NUM; i++) {
+                            AllocationStats stats = m_Allocator.GetStats((AllocationTag)i);
+
+                            ImGui::PushStyleColor(ImGuiCol_Text, stats.frameUpstreamAllocationNum ? UI_YELLOW : UI_DEFAULT);
+                            ImGui::Text("  %s: %u (%u), %.1f / %.1f", g_AllocationTagNames[i], stats.frameAllocationNum, stats.frameUpstreamAllocationNum, stats.liveBytes / 1024.0, stats.peakBytes / 1024.0);
+                            ImGui::PopStyleColor();
+                        }
+
+                        ImGui::PushStyleColor(ImGuiCol_Text, m_SteadyStateAllocationFrameNum ? UI_YELLOW : UI_DEFAULT);
+                        ImGui::Text("  Heap allocations per frame: %u (%s), %u frames allocated after warm-up", m_FrameHeapAllocationNum, m_AllocationWarmupFrameNum ? "warm-up" : "steady", m_SteadyStateAllocationFrameNum);
+                        ImGui::PopStyleColor();
+
                         if (ImGui::Button(m_Settings.windowAlignment ? ">>" : "<<"))
                             m_Settings.windowAlignment = !m_Settings.windowAlignment;
 
@@ -1780,61 +3712,11 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                     const float buttonWidth = 27.0f;
 
                         char s[64];
-                        std::string sceneName = std::string(utils::GetFileName(m_SceneFile));
-                        size_t dotPos = sceneName.find_last_of(".");
-                        if (dotPos != std::string::npos)
-                            sceneName = sceneName.substr(0, dotPos) + ".bin";
-                        const std::string path = utils::GetFullPath(sceneName, utils::DataFolder::TESTS);
+                        const std::string& path = GetTestPath();
                         const uint32_t testByteSize = sizeof(m_Settings) + Camera::GetStateSize();
 
                         // Get number of tests
-                        if (m_TestNum == uint32_t(-1)) {
-                            FILE* fp = fopen(path.c_str(), "rb");
-                            if (fp) {
-// Use this code to convert tests to reflect new Settings and Camera layouts
-#if 0
-                                    typedef Settings SettingsOld; // adjust if needed
-                                    typedef Camera CameraOld; // adjust if needed
-
-                                    const uint32_t oldItemSize = sizeof(SettingsOld) + CameraOld::GetStateSize();
-
-                                    fseek(fp, 0, SEEK_END);
-                                    m_TestNum = ftell(fp) / oldItemSize;
-                                    fseek(fp, 0, SEEK_SET);
-
-                                    FILE* fpNew;
-                                    fopen_s(&fpNew, (path + ".new").c_str(), "wb");
-
-                                    for (uint32_t i = 0; i < m_TestNum && fpNew; i++)
-                                    {
-                                        SettingsOld settingsOld;
-                                        fread_s(&settingsOld, sizeof(SettingsOld), 1, sizeof(SettingsOld), fp);
-
-                                        CameraOld cameraOld;
-                                        fread_s(cameraOld.GetState(), CameraOld::GetStateSize(), 1, CameraOld::GetStateSize(), fp);
-
-                                        // Convert Old to New here
-                                        m_Settings = settingsOld;
-                                        m_Camera.state = cameraOld.state;
-
-                                        // ...
-
-                                        fwrite(&m_Settings, 1, sizeof(m_Settings), fpNew);
-                                        fwrite(m_Camera.GetState(), 1, Camera::GetStateSize(), fpNew);
-                                    }
-
-                                    fclose(fp);
-                                    fclose(fpNew);
-
-                                    __debugbreak();
-#endif
-
-                                fseek(fp, 0, SEEK_END);
-                                m_TestNum = ftell(fp) / testByteSize;
-                                fclose(fp);
-                            } else
-                                m_TestNum = 0;
-                        }
+                        GetTestNum();
 
                         // Adjust current test index
                         bool isTestChanged = false;
@@ -1867,36 +3749,9 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
 
                             if (ImGui::Button(i == m_LastSelectedTest ? "*" : s, ImVec2(buttonWidth, 0.0f)) || isTestChanged) {
                                 uint32_t test = isTestChanged ? m_LastSelectedTest : i;
-                                FILE* fp = fopen(path.c_str(), "rb");
-
-                                if (fp && fseek(fp, test * testByteSize, SEEK_SET) == 0) {
-                                    size_t elemNum = fread(&m_Settings, sizeof(m_Settings), 1, fp);
-                                    if (elemNum == 1)
-                                        elemNum = fread(m_Camera.GetState(), Camera::GetStateSize(), 1, fp);
-
-                                    m_LastSelectedTest = test;
-
-                                    // File read error
-                                    if (elemNum != 1) {
-                                        m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, CAMERA_RELATIVE);
-                                        m_Settings = m_SettingsDefault;
-                                    }
-
-                                    // Reset some settings to defaults to avoid a potential confusion
-                                    m_Settings.debug = 0.0f;
-                                    m_Settings.denoiser = DENOISER_REBLUR;
-                                    m_Settings.RR = false;
-                                    m_Settings.SR = m_DLSR;
-                                    m_Settings.TAA = true;
-                                    m_Settings.cameraJitter = true;
+                                if (LoadTest(test))
                                     m_Settings.onScreen = clamp(m_Settings.onScreen, 0, (int32_t)helper::GetCountOf(onScreenModes));
 
-                                    m_ForceHistoryReset = true;
-                                }
-
-                                if (fp)
-                                    fclose(fp);
-
                                 isTestChanged = false;
                             }
 
@@ -1944,6 +3799,26 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
                                 m_TestNum = uint32_t(-1);
                             }
                         }
+
+                        // Tuner (all tests or the current view, if there are no tests)
+                        if (m_TunerState == TunerState::Idle) {
+                            if (ImGui::Button("Run tuner"))
+                                StartTuner(TunerMode::Sweep);
+
+                            ImGui::SameLine();
+                            if (ImGui::Button("Run convergence"))
+                                StartTuner(TunerMode::Convergence);
+
+                            ImGui::SameLine();
+                            if (ImGui::Button("Run denoiser cost"))
+                                StartTuner(TunerMode::DenoiserCost);
+                        } else {
+                            if (ImGui::Button("Stop tuner"))
+                                FinishTuner(false);
+
+                            ImGui::SameLine();
+                            ImGui::Text("Test %u/%u, %s %u/%u", m_TunerTest + 1, max(m_TunerTestNum, 1u), m_TunerMode == TunerMode::Sweep ? "combination" : (m_TunerMode == TunerMode::Convergence ? "variant" : "denoiser"), m_TunerCombination + 1, (uint32_t)m_TunerResults.size());
+                        }
                     }
                     ImGui::PopID();
                 }
@@ -1955,138 +3830,42 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     ImGui::EndFrame();
     ImGui::Render();
 
-    // Animate scene and update camera
-    cBoxf cameraLimits = m_Scene.aabb;
-    cameraLimits.Scale(4.0f);
-
-    CameraDesc desc = {};
-    desc.limits = cameraLimits;
-    desc.aspectRatio = float(GetOutputResolution().x) / float(GetOutputResolution().y);
-    desc.horizontalFov = degrees(atan(tan(radians(m_Settings.camFov) * 0.5f) * desc.aspectRatio * 9.0f / 16.0f) * 2.0f); // recalculate to ultra-wide if needed
-    desc.nearZ = NEAR_Z * m_Settings.meterToUnitsMultiplier;
-    desc.farZ = 10000.0f * m_Settings.meterToUnitsMultiplier;
-    desc.isCustomMatrixSet = false; // No camera animation hooked up
-    desc.isPositiveZ = m_PositiveZ;
-    desc.isReversedZ = m_ReversedZ;
-    desc.orthoRange = m_Settings.ortho ? tan(radians(m_Settings.camFov) * 0.5f) * 3.0f * m_Settings.meterToUnitsMultiplier : 0.0f;
-    desc.backwardOffset = CAMERA_BACKWARD_OFFSET;
-    GetCameraDescFromInputDevices(desc);
-
-    if (m_Settings.motionStartTime > 0.0) {
-        float time = float(m_Timer.GetTimeStamp() - m_Settings.motionStartTime);
-        float amplitude = 40.0f * m_Camera.state.motionScale;
-        float period = 0.0003f * time * (m_Settings.emulateMotionSpeed < 0.0f ? 1.0f / (1.0f + abs(m_Settings.emulateMotionSpeed)) : (1.0f + m_Settings.emulateMotionSpeed));
-
-        float3 localPos = m_Camera.state.mWorldToView.Row(0).xyz;
-        if (m_Settings.motionMode == 1)
-            localPos = m_Camera.state.mWorldToView.Row(1).xyz;
-        else if (m_Settings.motionMode == 2)
-            localPos = m_Camera.state.mWorldToView.Row(2).xyz;
-        else if (m_Settings.motionMode == 3) {
-            float3 rows[3] = {m_Camera.state.mWorldToView.Row(0).xyz, m_Camera.state.mWorldToView.Row(1).xyz, m_Camera.state.mWorldToView.Row(2).xyz};
-            float f = sin(Pi(period * 3.0f));
-            localPos = normalize(f < 0.0f ? lerp(rows[1], rows[0], float3(abs(f))) : lerp(rows[1], rows[2], float3(f)));
-        }
-
-        if (m_Settings.motionMode == 4) {
-            float f = fmod(Pi(period * 2.0f), Pi(2.0f));
-            float3 axisX = m_Camera.state.mWorldToView.Row(0).xyz;
-            float3 axisY = m_Camera.state.mWorldToView.Row(1).xyz;
-            float2 v = Rotate(float2(1.0f, 0.0f), f);
-            localPos = (axisX * v.x + axisY * v.y) * amplitude / Pi(1.0f);
-        } else
-            localPos *= amplitude * (m_Settings.linearMotion ? WaveTriangle(period) - 0.5f : sin(Pi(period)) * 0.5f);
-
-        desc.dUser = localPos - m_PrevLocalPos;
-        m_PrevLocalPos = localPos;
-    } else if (m_Settings.motionStartTime == -1.0) {
-        m_Settings.motionStartTime = m_Timer.GetTimeStamp();
-        m_PrevLocalPos = float3::Zero();
+    // Resize (requested from UI)
+    if (m_IsResizeRequested) {
+        ResizeRenderResolution();
+        m_IsResizeRequested = false;
     }
 
-    m_Camera.Update(desc, frameIndex);
+    // SHARC capacity (requested from UI)
+    if (m_IsSharcRecreationRequested) {
+        if (GetSharcCapacity() != m_SharcCapacity)
+            RecreateSharcBuffers(frameIndex);
 
-    // Animate scene
-    const float animationSpeed = m_Settings.pauseAnimation ? 0.0f : (m_Settings.animationSpeed < 0.0f ? 1.0f / (1.0f + abs(m_Settings.animationSpeed)) : (1.0f + m_Settings.animationSpeed));
-    const float animationDelta = animationSpeed * m_Timer.GetFrameTime() * 0.001f;
-
-    for (size_t i = 0; i < m_Scene.animations.size(); i++)
-        m_Scene.Animate(animationSpeed, m_Timer.GetFrameTime(), m_Settings.animationProgress, (int32_t)i);
-
-    // Animate sun
-    if (m_Settings.animateSun) {
-        static float sunAzimuthPrev = 0.0f;
-        static double sunMotionStartTime = 0.0;
-        if (m_Settings.animateSun != m_SettingsPrev.animateSun) {
-            sunAzimuthPrev = m_Settings.sunAzimuth;
-            sunMotionStartTime = m_Timer.GetTimeStamp();
-        }
-        double t = m_Timer.GetTimeStamp() - sunMotionStartTime;
-        if (!m_Settings.pauseAnimation)
-            m_Settings.sunAzimuth = sunAzimuthPrev + (float)sin(t * animationSpeed * 0.0003) * 10.0f;
+        m_IsSharcRecreationRequested = false;
     }
 
-    // Animate objects
-    const float scale = m_Settings.animatedObjectScale * m_Settings.meterToUnitsMultiplier / 2.0f;
-    if (m_Settings.nineBrothers) {
-        const float3& vRight = m_Camera.state.mViewToWorld[0].xyz;
-        const float3& vTop = m_Camera.state.mViewToWorld[1].xyz;
-        const float3& vForward = m_Camera.state.mViewToWorld[2].xyz;
-
-        float3 basePos = float3(m_Camera.state.globalPosition);
-
-#if (USE_CAMERA_ATTACHED_REFLECTION_TEST == 1)
-        m_Settings.animatedObjectNum = 3;
-
-        for (int32_t i = -1; i <= 1; i++) {
-            const uint32_t index = i + 1;
-
-            float x = float(i) * 3.0f;
-            float y = (i == 0) ? -1.5f : 0.0f;
-            float z = (i == 0) ? 1.0f : 3.0f;
-
-            x *= scale;
-            y *= scale;
-            z *= m_PositiveZ ? scale : -scale;
-
-            float3 pos = basePos + vRight * x + vTop * y + vForward * z;
-
-            utils::Instance& instance = m_Scene.instances[m_AnimatedInstances[index].instanceID];
-            instance.position = double3(pos);
-            instance.rotation = m_Camera.state.mViewToWorld;
-            instance.rotation.SetTranslation(float3::Zero());
-            instance.rotation.AddScale(scale);
-        }
-#else
-        m_Settings.animatedObjectNum = 9;
-
-        for (int32_t i = -1; i <= 1; i++) {
-            for (int32_t j = -1; j <= 1; j++) {
-                const uint32_t index = (i + 1) * 3 + (j + 1);
+    // Simulate
+    FillSimulationInput(frameIndex, true);
 
-                float x = float(i) * scale * 4.0f;
-                float y = float(j) * scale * 4.0f;
-                float z = 10.0f * (m_PositiveZ ? scale : -scale);
+    if (!isSimulated) {
+        // Not pipelined (or the first pipelined frame): simulate this frame right now
+        Simulate(m_SimulationInput, m_FrameSnapshots[1 - m_FrameSnapshotIndex]);
+        ApplySimulation();
 
-                float3 pos = basePos + vRight * x + vTop * y + vForward * z;
+        // The next frame starts from the updated camera, input is already consumed
+        FillSimulationInput(frameIndex + 1, false);
+    } else
+        m_SimulationInput.frameIndex = frameIndex + 1;
 
-                utils::Instance& instance = m_Scene.instances[m_AnimatedInstances[index].instanceID];
-                instance.position = double3(pos);
-                instance.rotation = m_Camera.state.mViewToWorld;
-                instance.rotation.SetTranslation(float3::Zero());
-                instance.rotation.AddScale(scale);
-            }
+    // Pipelined: simulate the next frame on the worker while this one is recorded and submitted
+    if (m_PipelinedSimulation) {
+        {
+            std::lock_guard<std::mutex> lock(m_SimulationMutex);
+            m_IsSimulationRunning = true;
         }
-#endif
-    } else if (m_Settings.animatedObjects) {
-        for (int32_t i = 0; i < m_Settings.animatedObjectNum; i++) {
-            float3 position;
-            float4x4 transform = m_AnimatedInstances[i].Animate(animationDelta, scale, position);
+        m_SimulationStart.notify_one();
 
-            utils::Instance& instance = m_Scene.instances[m_AnimatedInstances[i].instanceID];
-            instance.rotation = transform;
-            instance.position = double3(position);
-        }
+        m_IsSimulationPending = true;
     }
 
     // Reset settings if tracing mode change
@@ -2096,7 +3875,7 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     }
 
     // Print out information
-    if (m_SettingsPrev.resolutionScale != m_Settings.resolutionScale || m_SettingsPrev.tracingMode != m_Settings.tracingMode || m_SettingsPrev.rpp != m_Settings.rpp || frameIndex == 0) {
+    if ((m_SettingsPrev.resolutionScale != m_Settings.resolutionScale && !m_Drs) || m_SettingsPrev.tracingMode != m_Settings.tracingMode || m_SettingsPrev.rpp != m_Settings.rpp || frameIndex == 0) {
         std::array<uint32_t, 4> rppScale = {2, 1, 2, 2};
         std::array<float, 4> wScale = {1.0f, 1.0f, 0.5f, 0.5f};
         std::array<float, 4> hScale = {1.0f, 1.0f, 1.0f, 0.5f};
@@ -2189,7 +3968,12 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     m_RelaxSettings.specularMaxFastAccumulatedFrameNum = maxFastAccumulatedFrameNum;
 
     UpdateConstantBuffer(frameIndex, maxAccumulatedFrameNum);
-    GatherInstanceData();
+    UpdateModeSpecificResources();
+    StreamInstanceData(m_FrameSnapshots[m_FrameSnapshotIndex]);
+
+    // Workload changes (history reset, resize, UI interaction, tuner) are allowed to allocate
+    if (m_ForceHistoryReset || ImGui::IsAnyItemActive() || m_TunerState != TunerState::Idle)
+        m_AllocationWarmupFrameNum = ALLOCATION_WARMUP_FRAME_NUM;
 
     nri::nriEndAnnotation();
 }
@@ -2352,9 +4136,45 @@ nri::Format Sample::CreateSwapChain() {
 void Sample::CreateCommandBuffers() {
     m_QueuedFrames.resize(GetQueuedFrameNum());
     for (QueuedFrame& queuedFrame : m_QueuedFrames) {
+        for (uint32_t i = 0; i < (uint32_t)Stage::MAX_NUM; i++) {
+            NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, queuedFrame.stageCommandAllocators[i]));
+            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.stageCommandAllocators[i], queuedFrame.stageCommandBuffers[i]));
+
+            queuedFrame.computeCommandAllocators[i] = nullptr;
+            queuedFrame.computeCommandBuffers[i] = nullptr;
+
+            if (m_ComputeQueue && IsAsyncComputeStage((Stage)i)) {
+                NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_ComputeQueue, queuedFrame.computeCommandAllocators[i]));
+                NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.computeCommandAllocators[i], queuedFrame.computeCommandBuffers[i]));
+            }
+        }
+
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, queuedFrame.commandAllocator));
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
+
+    { // GPU start & end timestamps per queued frame
+        nri::QueryPoolDesc queryPoolDesc = {};
+        queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+        queryPoolDesc.capacity = GetQueuedFrameNum() * (uint32_t)Timestamp::MAX_NUM;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_TimestampQueryPool));
+
+        nri::BufferDesc bufferDesc = {queryPoolDesc.capacity * sizeof(uint64_t), 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommittedBuffer(*m_Device, nri::MemoryLocation::HOST_READBACK, 0.0f, bufferDesc, m_TimestampReadbackBuffer));
+
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+        m_TimestampPeriod = 1000.0 / double(deviceDesc.other.timestampFrequencyHz);
+    }
+
+    { // SHARC telemetry counters per queued frame
+        nri::BufferDesc bufferDesc = {GetQueuedFrameNum() * SHARC_STAT_NUM * sizeof(uint32_t), 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommittedBuffer(*m_Device, nri::MemoryLocation::HOST_READBACK, 0.0f, bufferDesc, m_SharcStatsReadbackBuffer));
+    }
+
+    m_LatencyMarkers.resize(GetQueuedFrameNum(), {});
+    m_IsSharcStatsPending.resize(GetQueuedFrameNum(), false);
+    m_FramesInFlight = GetQueuedFrameNum();
 }
 
 void Sample::CreatePipelineLayoutAndDescriptorPool() {
@@ -2373,7 +4193,7 @@ void Sample::CreatePipelineLayoutAndDescriptorPool() {
 
     // SET_SHARC
     const nri::DescriptorRangeDesc sharcRanges[] = {
-        {0, 3, nri::DescriptorType::STORAGE_STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER},
+        {0, 6, nri::DescriptorType::STORAGE_STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER},
     };
 
     // SET_ROOT
@@ -2385,8 +4205,6 @@ void Sample::CreatePipelineLayoutAndDescriptorPool() {
         {3, nri::DescriptorType::STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER},
     };
 
-    nri::RootConstantDesc rootConstant = {1, sizeof(uint32_t), nri::StageBits::COMPUTE_SHADER};
-
     nri::SamplerDesc samplerLinearMipmapLinear = {};
     samplerLinearMipmapLinear.addressModes = {nri::AddressMode::REPEAT, nri::AddressMode::REPEAT};
     samplerLinearMipmapLinear.filters = {nri::Filter::LINEAR, nri::Filter::LINEAR, nri::Filter::LINEAR};
@@ -2427,8 +4245,6 @@ void Sample::CreatePipelineLayoutAndDescriptorPool() {
     { // Pipeline layout
         nri::PipelineLayoutDesc pipelineLayoutDesc = {};
         pipelineLayoutDesc.rootRegisterSpace = SET_ROOT;
-        pipelineLayoutDesc.rootConstants = &rootConstant;
-        pipelineLayoutDesc.rootConstantNum = 1;
         pipelineLayoutDesc.rootDescriptors = rootDescriptors;
         pipelineLayoutDesc.rootDescriptorNum = helper::GetCountOf(rootDescriptors);
         pipelineLayoutDesc.rootSamplers = rootSamplers;
@@ -2530,6 +4346,10 @@ void Sample::CreateAccelerationStructures() {
         accelerationStructureDesc.geometryOrInstanceNum = helper::GetCountOf(m_Scene.instances);
 
         NRI_ABORT_ON_FAILURE(NRI.CreatePlacedAccelerationStructure(*m_Device, NriDeviceHeap, accelerationStructureDesc, Get(AccelerationStructure::TLAS_World)));
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetAccelerationStructureMemoryDesc(*Get(AccelerationStructure::TLAS_World), nri::MemoryLocation::DEVICE, memoryDesc);
+        AddVramLedgerEntry(Get(AccelerationStructure::TLAS_World), "TLAS_World", VramCategory::AccelerationStructures, "device", nri::Format::UNKNOWN, memoryDesc.size, false);
     }
 
     { // AccelerationStructure::TLAS_Emissive
@@ -2539,6 +4359,10 @@ void Sample::CreateAccelerationStructures() {
         accelerationStructureDesc.geometryOrInstanceNum = helper::GetCountOf(m_Scene.instances);
 
         NRI_ABORT_ON_FAILURE(NRI.CreatePlacedAccelerationStructure(*m_Device, NriDeviceHeap, accelerationStructureDesc, Get(AccelerationStructure::TLAS_Emissive)));
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetAccelerationStructureMemoryDesc(*Get(AccelerationStructure::TLAS_Emissive), nri::MemoryLocation::DEVICE, memoryDesc);
+        AddVramLedgerEntry(Get(AccelerationStructure::TLAS_Emissive), "TLAS_Emissive", VramCategory::AccelerationStructures, "device", nri::Format::UNKNOWN, memoryDesc.size, false);
     }
 
     // Create temp buffer for indices, vertices and transforms in UPLOAD heap
@@ -2829,6 +4653,15 @@ void Sample::CreateAccelerationStructures() {
 
         nri::AccelerationStructure* compactedBlas = compactedBlases[i];
         std::replace(m_AccelerationStructures.begin(), m_AccelerationStructures.end(), tempBlas, compactedBlas);
+
+        // Merged BLASes have dedicated slots, dynamic ones go after "BLAS_Other"
+        constexpr const char* blasNames[] = {"BLAS_MergedOpaque", "BLAS_MergedTransparent", "BLAS_MergedEmissive", "BLAS_Other"};
+        size_t slot = std::find(m_AccelerationStructures.begin(), m_AccelerationStructures.end(), compactedBlas) - m_AccelerationStructures.begin();
+        size_t nameIndex = std::min(slot - (size_t)AccelerationStructure::BLAS_MergedOpaque, (size_t)helper::GetCountOf(blasNames) - 1);
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetAccelerationStructureMemoryDesc(*compactedBlas, nri::MemoryLocation::DEVICE, memoryDesc);
+        AddVramLedgerEntry(compactedBlas, blasNames[nameIndex], VramCategory::AccelerationStructures, "device", nri::Format::UNKNOWN, memoryDesc.size, false);
     }
 
     NRI.UnmapBuffer(*uploadBuffer);
@@ -2883,6 +4716,9 @@ void Sample::CreatePipelines(bool recreate) {
     pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "SharcUpdate.cs", shaderCodeStorage);
     NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::SharcUpdate)));
 
+    pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "SharcStats.cs", shaderCodeStorage);
+    NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::SharcStats)));
+
     pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "SharcResolve.cs", shaderCodeStorage);
     NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::SharcResolve)));
 
@@ -2892,6 +4728,12 @@ void Sample::CreatePipelines(bool recreate) {
     pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "TraceOpaque.cs", shaderCodeStorage);
     NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::TraceOpaque)));
 
+    pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "TraceOpaqueProbabilistic.cs", shaderCodeStorage);
+    NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::TraceOpaqueProbabilistic)));
+
+    pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "TraceOpaqueHalf.cs", shaderCodeStorage);
+    NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::TraceOpaqueHalf)));
+
     pipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "Composition.cs", shaderCodeStorage);
     NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, pipelineDesc, Get(Pipeline::Composition)));
 
@@ -2912,6 +4754,63 @@ void Sample::CreatePipelines(bool recreate) {
 }
 
 void Sample::CreateResourcesAndDescriptors(nri::Format swapChainFormat) {
+    uint64_t instanceNum = m_Scene.instances.size() + MAX_ANIMATED_INSTANCE_NUM;
+    uint64_t instanceDataSize = instanceNum * sizeof(InstanceData);
+    uint64_t worldScratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(*Get(AccelerationStructure::TLAS_World));
+    uint64_t lightScratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(*Get(AccelerationStructure::TLAS_Emissive));
+
+    // IMPORTANT: "GatherInstanceData" refills these every frame and must not exceed the capacity
+    for (FrameSnapshot& snapshot : m_FrameSnapshots) {
+        snapshot.instanceData.reserve(instanceNum);
+        snapshot.worldTlasData.reserve(instanceNum);
+        snapshot.lightTlasData.reserve(instanceNum);
+    }
+
+    // Buffers
+    CreateBuffer(Buffer::InstanceData, "InstanceData", instanceDataSize / sizeof(InstanceData), sizeof(InstanceData), nri::BufferUsageBits::SHADER_RESOURCE);
+    CreateBuffer(Buffer::PrimitiveData, "PrimitiveData", m_Scene.totalInstancedPrimitivesNum, sizeof(PrimitiveData), nri::BufferUsageBits::SHADER_RESOURCE | nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
+    CreateSharcBuffers();
+    CreateBuffer(Buffer::SharcStats, "SharcStats", SHARC_STAT_NUM, sizeof(uint32_t), nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
+    CreateBuffer(Buffer::SharcActiveArgs, "SharcActiveArgs", 2 * SHARC_ACTIVE_ARGS_STRIDE, sizeof(uint32_t), nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
+    CreateBuffer(Buffer::SharcResolveArgs, "SharcResolveArgs", SHARC_ACTIVE_ARGS_STRIDE, sizeof(uint32_t), nri::BufferUsageBits::ARGUMENT_BUFFER);
+    CreateBuffer(Buffer::WorldScratch, "WorldScratch", worldScratchBufferSize, 1, nri::BufferUsageBits::SCRATCH_BUFFER);
+    CreateBuffer(Buffer::LightScratch, "LightScratch", lightScratchBufferSize, 1, nri::BufferUsageBits::SCRATCH_BUFFER);
+
+    // Textures
+    CreateResolutionDependentTextures(swapChainFormat);
+
+    for (size_t i = 0; i < m_Scene.textures.size(); i++) {
+        const utils::Texture* texture = m_Scene.textures[i];
+
+        uint32_t mipOffset = GetSceneTextureMipOffset(*texture);
+        nri::Dim_t w = (nri::Dim_t)max((uint32_t)texture->GetWidth() >> mipOffset, 1u);
+        nri::Dim_t h = (nri::Dim_t)max((uint32_t)texture->GetHeight() >> mipOffset, 1u);
+        nri::Dim_t mipNum = (nri::Dim_t)(texture->GetMipNum() - mipOffset);
+
+        CreateTexture((Texture)((size_t)Texture::BaseReadOnlyTexture + i), texture->name.c_str(), texture->GetFormat(), w, h, mipNum, texture->GetArraySize(), true, nri::AccessBits::NONE);
+    }
+
+    { // Descriptor::Constant_Buffer
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+        size_t maxSize = sizeof(GlobalConstants);
+
+        nri::BufferViewDesc bufferViewDesc = {};
+        bufferViewDesc.type = nri::BufferView::CONSTANT_BUFFER;
+        bufferViewDesc.buffer = NRI.GetStreamerConstantBuffer(*m_Streamer);
+        bufferViewDesc.size = helper::Align((uint32_t)maxSize, deviceDesc.memoryAlignment.constantBufferOffset);
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, GetDescriptor(Descriptor::Constant_Buffer)));
+    }
+
+    // Descriptor::TLAS_World
+    NRI.CreateAccelerationStructureDescriptor(*Get(AccelerationStructure::TLAS_World), GetDescriptor(Descriptor::TLAS_World));
+
+    // Descriptor::TLAS_Emissive
+    NRI.CreateAccelerationStructureDescriptor(*Get(AccelerationStructure::TLAS_Emissive), GetDescriptor(Descriptor::TLAS_Emissive));
+}
+
+void Sample::CreateResolutionDependentTextures(nri::Format swapChainFormat) {
     const nrd::LibraryDesc& nrdLibraryDesc = *nrd::GetLibraryDesc();
     nri::Format normalFormat = nri::Format::RGBA16_SFLOAT; // TODO: RGBA16_SNORM can't be used, because NGX doesn't support it
     switch (nrdLibraryDesc.normalEncoding) {
@@ -2946,28 +4845,7 @@ void Sample::CreateResourcesAndDescriptors(nri::Format swapChainFormat) {
 
     nri::Dim_t w = (nri::Dim_t)m_RenderResolution.x;
     nri::Dim_t h = (nri::Dim_t)m_RenderResolution.y;
-    nri::Dim_t rrw = m_DlssQuality == -1 ? 1 : w;
-    nri::Dim_t rrh = m_DlssQuality == -1 ? 1 : h;
-
-    uint64_t instanceNum = m_Scene.instances.size() + MAX_ANIMATED_INSTANCE_NUM;
-    uint64_t instanceDataSize = instanceNum * sizeof(InstanceData);
-    uint64_t worldScratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(*Get(AccelerationStructure::TLAS_World));
-    uint64_t lightScratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(*Get(AccelerationStructure::TLAS_Emissive));
-
-    m_InstanceData.resize(instanceNum);
-    m_WorldTlasData.resize(instanceNum);
-    m_LightTlasData.resize(instanceNum);
-
-    // Buffers
-    CreateBuffer(Buffer::InstanceData, "InstanceData", instanceDataSize / sizeof(InstanceData), sizeof(InstanceData), nri::BufferUsageBits::SHADER_RESOURCE);
-    CreateBuffer(Buffer::PrimitiveData, "PrimitiveData", m_Scene.totalInstancedPrimitivesNum, sizeof(PrimitiveData), nri::BufferUsageBits::SHADER_RESOURCE | nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
-    CreateBuffer(Buffer::SharcHashEntries, "SharcHashEntries", SHARC_CAPACITY, sizeof(uint64_t), nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
-    CreateBuffer(Buffer::SharcAccumulated, "SharcAccumulated", SHARC_CAPACITY, sizeof(uint32_t) * 4, nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
-    CreateBuffer(Buffer::SharcResolved, "SharcResolved", SHARC_CAPACITY, sizeof(uint32_t) * 4, nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
-    CreateBuffer(Buffer::WorldScratch, "WorldScratch", worldScratchBufferSize, 1, nri::BufferUsageBits::SCRATCH_BUFFER);
-    CreateBuffer(Buffer::LightScratch, "LightScratch", lightScratchBufferSize, 1, nri::BufferUsageBits::SCRATCH_BUFFER);
 
-    // Textures
     CreateTexture(Texture::ViewZ, "ViewZ", nri::Format::R32_SFLOAT, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Mv, "Mv", nri::Format::RGBA16_SFLOAT, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Normal_Roughness, "Normal_Roughness", normalFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
@@ -2983,7 +4861,7 @@ void Sample::CreateResourcesAndDescriptors(nri::Format swapChainFormat) {
     CreateTexture(Texture::Unfiltered_Spec, "Unfiltered_Spec", dataFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Unfiltered_Translucency, "Unfiltered_Translucency", shadowFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Validation, "Validation", nri::Format::RGBA8_UNORM, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
-    CreateTexture(Texture::Composed, "Composed", criticalColorFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
+    CreateTexture(Texture::Composed, "Composed", m_UseCompactColorFormats ? nri::Format::R11_G11_B10_UFLOAT : criticalColorFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Gradient_StoredPing, "Gradient_StoredPing", nri::Format::RGBA16_SFLOAT, (nri::Dim_t)GetSharcDims().x, (nri::Dim_t)GetSharcDims().y, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Gradient_StoredPong, "Gradient_StoredPong", nri::Format::RGBA16_SFLOAT, (nri::Dim_t)GetSharcDims().x, (nri::Dim_t)GetSharcDims().y, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Gradient_Ping, "Gradient_Ping", nri::Format::RGBA16_SFLOAT, (nri::Dim_t)GetSharcDims().x, (nri::Dim_t)GetSharcDims().y, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
@@ -2992,7 +4870,6 @@ void Sample::CreateResourcesAndDescriptors(nri::Format swapChainFormat) {
     CreateTexture(Texture::ComposedSpec_ViewZ, "ComposedSpec_ViewZ", nri::Format::RGBA16_SFLOAT, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
     CreateTexture(Texture::TaaHistoryPing, "TaaHistoryPing", taaFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::TaaHistoryPong, "TaaHistoryPong", taaFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
-    CreateTexture(Texture::DlssOutput, "DlssOutput", criticalColorFormat, (nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::PreFinal, "PreFinal", criticalColorFormat, (nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::Final, "Final", swapChainFormat, (nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y, 1, 1, false, nri::AccessBits::COPY_SOURCE);
 #if (NRD_MODE == SH)
@@ -3001,37 +4878,29 @@ void Sample::CreateResourcesAndDescriptors(nri::Format swapChainFormat) {
     CreateTexture(Texture::DiffSh, "DiffSh", dataFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
     CreateTexture(Texture::SpecSh, "SpecSh", dataFormat, w, h, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
 #endif
-    CreateTexture(Texture::RRGuide_DiffAlbedo, "RRGuide_DiffAlbedo", nri::Format::R10_G10_B10_A2_UNORM, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
-    CreateTexture(Texture::RRGuide_SpecAlbedo, "RRGuide_SpecAlbedo", nri::Format::R10_G10_B10_A2_UNORM, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
-    CreateTexture(Texture::RRGuide_SpecHitDistance, "RRGuide_SpecHitDistance", nri::Format::R16_SFLOAT, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
-    CreateTexture(Texture::RRGuide_Normal_Roughness, "RRGuide_Normal_Roughness", nri::Format::RGBA16_SFLOAT, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
-
-    for (size_t i = 0; i < m_Scene.textures.size(); i++) {
-        const utils::Texture* texture = m_Scene.textures[i];
-        CreateTexture((Texture)((size_t)Texture::BaseReadOnlyTexture + i), "", texture->GetFormat(), texture->GetWidth(), texture->GetHeight(), texture->GetMipNum(), texture->GetArraySize(), true, nri::AccessBits::NONE);
-    }
-
-    { // Descriptor::Constant_Buffer
-        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-
-        size_t maxSize = sizeof(GlobalConstants);
-
-        nri::BufferViewDesc bufferViewDesc = {};
-        bufferViewDesc.type = nri::BufferView::CONSTANT_BUFFER;
-        bufferViewDesc.buffer = NRI.GetStreamerConstantBuffer(*m_Streamer);
-        bufferViewDesc.size = helper::Align((uint32_t)maxSize, deviceDesc.memoryAlignment.constantBufferOffset);
-
-        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, GetDescriptor(Descriptor::Constant_Buffer)));
-    }
+    CreateModeSpecificTextures();
+    CreateTransientHeap();
+}
 
-    // Descriptor::TLAS_World
-    NRI.CreateAccelerationStructureDescriptor(*Get(AccelerationStructure::TLAS_World), GetDescriptor(Descriptor::TLAS_World));
+void Sample::CreateDescriptorSets() {
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::SharcUpdatePing), 2, 0));    // and pong
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::ConfidenceBlur), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::TraceOpaque), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::Composition), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::TraceTransparent), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::TaaPing), 2, 0)); // and pong
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::Final), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::DlssBefore), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::DlssAfter), 1, 0));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_RAY_TRACING, &Get(DescriptorSet::RayTracing), 1, uint32_t(m_Scene.materials.size() * TEXTURES_PER_MATERIAL)));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_SHARC, &Get(DescriptorSet::Sharc), 1, 0));
 
-    // Descriptor::TLAS_Emissive
-    NRI.CreateAccelerationStructureDescriptor(*Get(AccelerationStructure::TLAS_Emissive), GetDescriptor(Descriptor::TLAS_Emissive));
+    UpdateDescriptorSets();
 }
 
-void Sample::CreateDescriptorSets() {
+void Sample::UpdateDescriptorSets() {
+    // Descriptor sets are allocated once, views get recreated on resize
+
     // Ping
     const nri::Descriptor* SharcUpdatePing_Textures[] = {
         GetDescriptor(Texture::Gradient_StoredPing),
@@ -3042,14 +4911,6 @@ void Sample::CreateDescriptorSets() {
         GetStorageDescriptor(Texture::Gradient_Ping),
     };
 
-    const nri::Descriptor* ConfidenceBlurPing_Textures[] = {
-        GetDescriptor(Texture::Gradient_Ping),
-    };
-
-    const nri::Descriptor* ConfidenceBlurPing_StorageTextures[] = {
-        GetStorageDescriptor(Texture::Gradient_Pong),
-    };
-
     const nri::Descriptor* TaaPing_Textures[] = {
         GetDescriptor(Texture::Mv),
         GetDescriptor(Texture::Composed),
@@ -3070,14 +4931,6 @@ void Sample::CreateDescriptorSets() {
         GetStorageDescriptor(Texture::Gradient_Ping),
     };
 
-    const nri::Descriptor* ConfidenceBlurPong_Textures[] = {
-        GetDescriptor(Texture::Gradient_Pong),
-    };
-
-    const nri::Descriptor* ConfidenceBlurPong_StorageTextures[] = {
-        GetStorageDescriptor(Texture::Gradient_Ping),
-    };
-
     const nri::Descriptor* TaaPong_Textures[] = {
         GetDescriptor(Texture::Mv),
         GetDescriptor(Texture::Composed),
@@ -3089,6 +4942,14 @@ void Sample::CreateDescriptorSets() {
     };
 
     // Other
+    const nri::Descriptor* ConfidenceBlur_Textures[] = {
+        GetDescriptor(Texture::Gradient_Ping),
+    };
+
+    const nri::Descriptor* ConfidenceBlur_StorageTextures[] = {
+        GetStorageDescriptor(Texture::Gradient_Pong),
+    };
+
     const nri::Descriptor* TraceOpaque_Textures[] = {
         GetDescriptor(Texture::ComposedDiff),
         GetDescriptor(Texture::ComposedSpec_ViewZ),
@@ -3150,159 +5011,632 @@ void Sample::CreateDescriptorSets() {
         GetDescriptor(Texture::Validation),
     };
 
-    const nri::Descriptor* Final_StorageTextures[] = {
-        GetStorageDescriptor(Texture::Final),
-    };
+    const nri::Descriptor* Final_StorageTextures[] = {
+        GetStorageDescriptor(Texture::Final),
+    };
+
+    const nri::Descriptor* DlssBefore_Textures[] = {
+        GetDescriptor(Texture::Normal_Roughness),
+        GetDescriptor(Texture::BaseColor_Metalness),
+        GetDescriptor(Texture::Unfiltered_Spec),
+    };
+
+    const nri::Descriptor* DlssBefore_StorageTextures[] = {
+        GetStorageDescriptor(Texture::ViewZ),
+        GetStorageDescriptor(Texture::RRGuide_DiffAlbedo),
+        GetStorageDescriptor(Texture::RRGuide_SpecAlbedo),
+        GetStorageDescriptor(Texture::RRGuide_SpecHitDistance),
+        GetStorageDescriptor(Texture::RRGuide_Normal_Roughness),
+    };
+
+    const nri::Descriptor* DlssAfter_StorageTextures[] = {
+        GetStorageDescriptor(Texture::DlssOutput),
+    };
+
+    const nri::Descriptor* RayTracing_Textures[] = {
+        GetDescriptorForReadOnlyTexture(utils::StaticTexture::ScramblingRanking4),
+        GetDescriptorForReadOnlyTexture(utils::StaticTexture::ScramblingRanking8),
+        GetDescriptorForReadOnlyTexture(utils::StaticTexture::ScramblingRanking32),
+        GetDescriptorForReadOnlyTexture(utils::StaticTexture::SobolSequence),
+    };
+
+    std::vector<nri::Descriptor*> RayTracing_BindlessTextures(m_Scene.materials.size() * TEXTURES_PER_MATERIAL);
+    for (size_t i = 0; i < m_Scene.materials.size(); i++) {
+        const size_t index = i * TEXTURES_PER_MATERIAL;
+        const utils::Material& material = m_Scene.materials[i];
+
+        RayTracing_BindlessTextures[index] = GetDescriptorForReadOnlyTexture(material.baseColorTexIndex);
+        RayTracing_BindlessTextures[index + 1] = GetDescriptorForReadOnlyTexture(material.roughnessMetalnessTexIndex);
+        RayTracing_BindlessTextures[index + 2] = GetDescriptorForReadOnlyTexture(material.normalTexIndex);
+        RayTracing_BindlessTextures[index + 3] = GetDescriptorForReadOnlyTexture(material.emissiveTexIndex);
+    }
+
+    const nri::Descriptor* Sharc_StorageBuffers[] = {
+        GetStorageDescriptor(Buffer::SharcHashEntries),
+        GetStorageDescriptor(Buffer::SharcAccumulated),
+        GetStorageDescriptor(Buffer::SharcResolved),
+        GetStorageDescriptor(Buffer::SharcStats),
+        GetStorageDescriptor(Buffer::SharcActiveEntries),
+        GetStorageDescriptor(Buffer::SharcActiveArgs),
+    };
+
+    std::vector<nri::UpdateDescriptorRangeDesc> updateDescriptorRangeDescs;
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePing), 0, 0, SharcUpdatePing_Textures, helper::GetCountOf(SharcUpdatePing_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePing), 1, 0, SharcUpdatePing_StorageTextures, helper::GetCountOf(SharcUpdatePing_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePong), 0, 0, SharcUpdatePong_Textures, helper::GetCountOf(SharcUpdatePong_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePong), 1, 0, SharcUpdatePong_StorageTextures, helper::GetCountOf(SharcUpdatePong_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::ConfidenceBlur), 0, 0, ConfidenceBlur_Textures, helper::GetCountOf(ConfidenceBlur_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::ConfidenceBlur), 1, 0, ConfidenceBlur_StorageTextures, helper::GetCountOf(ConfidenceBlur_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceOpaque), 0, 0, TraceOpaque_Textures, helper::GetCountOf(TraceOpaque_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceOpaque), 1, 0, TraceOpaque_StorageTextures, helper::GetCountOf(TraceOpaque_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Composition), 0, 0, Composition_Textures, helper::GetCountOf(Composition_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Composition), 1, 0, Composition_StorageTextures, helper::GetCountOf(Composition_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceTransparent), 0, 0, TraceTransparent_Textures, helper::GetCountOf(TraceTransparent_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceTransparent), 1, 0, TraceTransparent_StorageTextures, helper::GetCountOf(TraceTransparent_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPing), 0, 0, TaaPing_Textures, helper::GetCountOf(TaaPing_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPing), 1, 0, TaaPing_StorageTextures, helper::GetCountOf(TaaPing_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPong), 0, 0, TaaPong_Textures, helper::GetCountOf(TaaPong_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPong), 1, 0, TaaPong_StorageTextures, helper::GetCountOf(TaaPong_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Final), 0, 0, Final_Textures, helper::GetCountOf(Final_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Final), 1, 0, Final_StorageTextures, helper::GetCountOf(Final_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::DlssBefore), 0, 0, DlssBefore_Textures, helper::GetCountOf(DlssBefore_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::DlssBefore), 1, 0, DlssBefore_StorageTextures, helper::GetCountOf(DlssBefore_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::DlssAfter), 1, 0, DlssAfter_StorageTextures, helper::GetCountOf(DlssAfter_StorageTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::RayTracing), 0, 0, RayTracing_Textures, helper::GetCountOf(RayTracing_Textures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::RayTracing), 1, 0, RayTracing_BindlessTextures.data(), helper::GetCountOf(RayTracing_BindlessTextures)});
+    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Sharc), 0, 0, Sharc_StorageBuffers, helper::GetCountOf(Sharc_StorageBuffers)});
+
+    NRI.UpdateDescriptorRanges(updateDescriptorRangeDescs.data(), helper::GetCountOf(updateDescriptorRangeDescs));
+}
+
+void Sample::CreateTexture(Texture texture, const char* debugName, nri::Format format, nri::Dim_t width, nri::Dim_t height, nri::Dim_t mipNum, nri::Dim_t arraySize, bool isReadOnly, nri::AccessBits initialAccess) {
+    nri::TextureDesc desc = {};
+    desc.type = nri::TextureType::TEXTURE_2D;
+    desc.usage = nri::TextureUsageBits::SHADER_RESOURCE | (isReadOnly ? nri::TextureUsageBits::NONE : nri::TextureUsageBits::SHADER_RESOURCE_STORAGE);
+    desc.format = format;
+    desc.width = width;
+    desc.height = height;
+    desc.depth = 1;
+    desc.mipNum = mipNum;
+    desc.layerNum = arraySize;
+    desc.sampleNum = 1;
+
+    // Transient textures get memory and views in "CreateTransientHeap"
+    nri::MemoryDesc memoryDesc = {};
+    if (IsTransient(texture)) {
+        NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, desc, Get(texture)));
+        NRI.SetDebugName((nri::Object*)Get(texture), debugName);
+
+        NRI.GetTextureMemoryDesc(*Get(texture), nri::MemoryLocation::DEVICE, memoryDesc);
+        AddVramLedgerEntry(Get(texture), debugName, GetVramCategory(texture), "transient", format, memoryDesc.size, true);
+
+        return;
+    }
+
+    NRI_ABORT_ON_FAILURE(NRI.CreatePlacedTexture(*m_Device, NriDeviceHeap, desc, Get(texture)));
+
+    NRI.SetDebugName((nri::Object*)Get(texture), debugName);
+
+    NRI.GetTextureMemoryDesc(*Get(texture), nri::MemoryLocation::DEVICE, memoryDesc);
+    AddVramLedgerEntry(Get(texture), debugName, GetVramCategory(texture), "device", format, memoryDesc.size, false);
+
+    CreateTextureViews(texture, initialAccess);
+}
+
+void Sample::CreateTextureViews(Texture texture, nri::AccessBits initialAccess) {
+    const nri::TextureDesc& desc = NRI.GetTextureDesc(*Get(texture));
+
+    int32_t index = (int32_t)texture - (int32_t)Texture::BaseReadOnlyTexture;
+    nri::TextureViewDesc viewDesc = {Get(texture), desc.layerNum > 1 ? nri::TextureView::TEXTURE_ARRAY : nri::TextureView::TEXTURE, desc.format};
+    NRI_ABORT_ON_FAILURE(NRI.CreateTextureView(viewDesc, index >= 0 ? GetDescriptorForReadOnlyTexture((uint32_t)index) : GetDescriptor(texture)));
+
+    if (desc.usage & nri::TextureUsageBits::SHADER_RESOURCE_STORAGE) {
+        const nri::FormatProps* formatProps = nriGetFormatProps(desc.format);
+
+        viewDesc.format = formatProps->isSrgb ? nri::Format((uint8_t)desc.format - 1) : desc.format; // demote sRGB to UNORM
+        viewDesc.type = desc.layerNum > 1 ? nri::TextureView::STORAGE_TEXTURE_ARRAY : nri::TextureView::STORAGE_TEXTURE;
+        NRI_ABORT_ON_FAILURE(NRI.CreateTextureView(viewDesc, GetStorageDescriptor(texture)));
+    }
+
+    if (initialAccess != nri::AccessBits::NONE) { // initial state
+        nri::Layout layout = nri::Layout::SHADER_RESOURCE;
+        if (initialAccess & nri::AccessBits::COPY_SOURCE)
+            layout = nri::Layout::COPY_SOURCE;
+        else if (initialAccess & nri::AccessBits::COPY_DESTINATION)
+            layout = nri::Layout::COPY_DESTINATION;
+        else if (initialAccess & nri::AccessBits::SHADER_RESOURCE_STORAGE)
+            layout = nri::Layout::SHADER_RESOURCE_STORAGE;
+
+        // Only the startup upload applies initial states, textures recreated later are left in "undefined" state
+        if (m_AreInitialStatesApplied)
+            GetState(texture) = TextureBarrierFromUnknown(Get(texture), {nri::AccessBits::NONE, nri::Layout::UNDEFINED});
+        else
+            GetState(texture) = TextureBarrierFromUnknown(Get(texture), {initialAccess, layout});
+    }
+}
+
+void Sample::CreateTransientHeap() {
+    struct Lifetime {
+        nri::MemoryDesc memoryDesc;
+        uint64_t offset;
+        Texture texture;
+        uint32_t firstPass;
+        uint32_t lastPass;
+    };
+
+    std::vector<Lifetime> lifetimes;
+    for (Texture texture : g_TransientTextures) {
+        Lifetime lifetime = {};
+        lifetime.texture = texture;
+        lifetime.firstPass = (uint32_t)Pass::MAX_NUM;
+        lifetime.lastPass = 0;
+        NRI.GetTextureMemoryDesc(*Get(texture), nri::MemoryLocation::DEVICE, lifetime.memoryDesc);
+
+        lifetimes.push_back(lifetime);
+    }
+
+    // Lifetime analysis: passes follow "Pass" order in all graph variants, thus a lifetime is the range of pass IDs accessing
+    // the texture in any variant. Graph declarations depend on the denoiser and DLSS settings, all their combinations are built
+    Settings settings = m_Settings;
+    bool isDenoisingCulled = m_IsDenoisingCulled;
+    bool forceHistoryReset = m_ForceHistoryReset;
+    bool printRenderGraph = m_PrintRenderGraph;
+    m_PrintRenderGraph = false;
+
+    for (uint32_t variant = 0; variant < 8; variant++) {
+        m_Settings.denoiser = (variant & 0x1) ? DENOISER_REFERENCE : settings.denoiser;
+        m_Settings.SR = (variant & 0x2) != 0;
+        m_Settings.RR = (variant & 0x4) != 0;
+
+        BuildRenderGraph(true);
+
+        // Culled passes keep their accesses
+        for (const RenderGraphPass& pass : m_RenderGraph.GetPasses()) {
+            const RenderGraphAccess* accesses = m_RenderGraph.GetAccesses(pass);
+
+            for (uint32_t i = 0; i < pass.accessNum; i++) {
+                for (Lifetime& lifetime : lifetimes) {
+                    if (accesses[i].resource == GetResource(lifetime.texture)) {
+                        lifetime.firstPass = min(lifetime.firstPass, pass.id);
+                        lifetime.lastPass = max(lifetime.lastPass, pass.id);
+                    }
+                }
+            }
+        }
+    }
+
+    m_Settings = settings;
+    m_IsDenoisingCulled = isDenoisingCulled;
+    m_ForceHistoryReset = forceHistoryReset;
+    m_PrintRenderGraph = printRenderGraph;
+
+    for (const Lifetime& lifetime : lifetimes)
+        NRI_ABORT_ON_FALSE(lifetime.firstPass <= lifetime.lastPass); // a transient texture must be accessed
+
+    // Placement: biggest first, at the lowest offset not intersecting textures with overlapping lifetimes
+    std::sort(lifetimes.begin(), lifetimes.end(), [](const Lifetime& a, const Lifetime& b) { return a.memoryDesc.size > b.memoryDesc.size; });
+
+    uint64_t heapSize = 0;
+    uint64_t unaliasedSize = 0;
+    for (size_t i = 0; i < lifetimes.size(); i++) {
+        Lifetime& lifetime = lifetimes[i];
+        NRI_ABORT_ON_FALSE(lifetime.memoryDesc.type == lifetimes[0].memoryDesc.type);
+
+        uint64_t offset = 0;
+        for (bool isMoved = true; isMoved;) {
+            isMoved = false;
+
+            for (size_t j = 0; j < i; j++) {
+                const Lifetime& placed = lifetimes[j];
+
+                bool isLifetimeOverlapped = lifetime.firstPass <= placed.lastPass && placed.firstPass <= lifetime.lastPass;
+                bool isMemoryOverlapped = offset < placed.offset + placed.memoryDesc.size && placed.offset < offset + lifetime.memoryDesc.size;
+                if (isLifetimeOverlapped && isMemoryOverlapped) {
+                    offset = helper::Align(placed.offset + placed.memoryDesc.size, lifetime.memoryDesc.alignment);
+                    isMoved = true;
+                }
+            }
+        }
+
+        lifetime.offset = offset;
+        heapSize = max(heapSize, offset + lifetime.memoryDesc.size);
+        unaliasedSize += lifetime.memoryDesc.size;
+    }
+
+    // Allocate and bind
+    nri::AllocateMemoryDesc allocateMemoryDesc = {};
+    allocateMemoryDesc.size = heapSize;
+    allocateMemoryDesc.type = lifetimes[0].memoryDesc.type;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_TransientHeap));
+
+    AddVramLedgerEntry(m_TransientHeap, "TransientHeap", VramCategory::RenderTargets, "transient", nri::Format::UNKNOWN, heapSize, false);
+
+    std::vector<nri::TextureMemoryBindingDesc> textureMemoryBindingDescs;
+    for (const Lifetime& lifetime : lifetimes)
+        textureMemoryBindingDescs.push_back({Get(lifetime.texture), m_TransientHeap, lifetime.offset});
+
+    NRI_ABORT_ON_FAILURE(NRI.BindTextureMemory(*m_Device, textureMemoryBindingDescs.data(), (uint32_t)textureMemoryBindingDescs.size()));
+
+    // Content is undefined at the beginning of each frame, the initial state doesn't matter
+    for (const Lifetime& lifetime : lifetimes)
+        CreateTextureViews(lifetime.texture, nri::AccessBits::SHADER_RESOURCE);
+
+    printf("Transient heap: %.2f Mb (%.2f Mb without aliasing)\n", heapSize / (1024.0f * 1024.0f), unaliasedSize / (1024.0f * 1024.0f));
+}
+
+void Sample::CreateBuffer(Buffer buffer, const char* debugName, uint64_t elements, uint32_t stride, nri::BufferUsageBits usage) {
+    if (!elements)
+        elements = 1;
+
+    nri::BufferDesc desc = {};
+    desc.size = elements * stride;
+    desc.structureStride = stride;
+    desc.usage = usage;
+
+    NRI_ABORT_ON_FAILURE(NRI.CreatePlacedBuffer(*m_Device, NriDeviceHeap, desc, Get(buffer)));
+
+    NRI.SetDebugName((nri::Object*)Get(buffer), debugName);
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetBufferMemoryDesc(*Get(buffer), nri::MemoryLocation::DEVICE, memoryDesc);
+    AddVramLedgerEntry(Get(buffer), debugName, GetVramCategory(buffer), "device", nri::Format::UNKNOWN, memoryDesc.size, false);
+
+    if (desc.usage & nri::BufferUsageBits::SHADER_RESOURCE) {
+        const nri::BufferViewDesc viewDesc = {Get(buffer), nri::BufferView::STRUCTURED_BUFFER};
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(viewDesc, GetDescriptor(buffer)));
+    }
+
+    if (desc.usage & nri::BufferUsageBits::SHADER_RESOURCE_STORAGE) {
+        const nri::BufferViewDesc viewDesc = {Get(buffer), nri::BufferView::STORAGE_STRUCTURED_BUFFER};
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(viewDesc, GetStorageDescriptor(buffer)));
+    }
+}
+
+void Sample::CreateDlss(nri::UpscalerType type, nri::Upscaler*& upscaler) {
+    nri::UpscalerBits upscalerFlags = nri::UpscalerBits::DEPTH_INFINITE;
+    upscalerFlags |= NRD_MODE < OCCLUSION ? nri::UpscalerBits::HDR : nri::UpscalerBits::NONE;
+    upscalerFlags |= m_ReversedZ ? nri::UpscalerBits::DEPTH_INVERTED : nri::UpscalerBits::NONE;
+
+    nri::UpscalerMode mode = nri::UpscalerMode::NATIVE;
+    if (m_DlssQuality == 0)
+        mode = nri::UpscalerMode::ULTRA_PERFORMANCE;
+    else if (m_DlssQuality == 1)
+        mode = nri::UpscalerMode::PERFORMANCE;
+    else if (m_DlssQuality == 2)
+        mode = nri::UpscalerMode::BALANCED;
+    else if (m_DlssQuality == 3)
+        mode = nri::UpscalerMode::QUALITY;
+
+    nri::VideoMemoryInfo videoMemoryInfo1 = {};
+    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo1);
+
+    nri::UpscalerDesc upscalerDesc = {};
+    upscalerDesc.upscaleResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
+    upscalerDesc.type = type;
+    upscalerDesc.mode = mode;
+    upscalerDesc.flags = upscalerFlags;
+    if (type != nri::UpscalerType::DLRR)
+        upscalerDesc.preset = DLSS_PRESET;
+    NRI_ABORT_ON_FAILURE(NRI.CreateUpscaler(*m_Device, upscalerDesc, upscaler));
+
+    nri::VideoMemoryInfo videoMemoryInfo2 = {};
+    NRI.QueryVideoMemoryInfo(*m_Device, nri::MemoryLocation::DEVICE, videoMemoryInfo2);
+
+    printf("%s: allocated %.2f Mb\n", type == nri::UpscalerType::DLRR ? "DLSS-RR" : "DLSS-SR", (videoMemoryInfo2.usageSize - videoMemoryInfo1.usageSize) / (1024.0f * 1024.0f));
+}
+
+void Sample::CreateModeSpecificTextures() {
+    const nri::Format criticalColorFormat = m_UseCompactColorFormats ? nri::Format::R11_G11_B10_UFLOAT : nri::Format::RGBA16_SFLOAT;
+
+    // Unused textures are kept as 1x1 placeholders to keep descriptor sets valid
+    m_IsDlssOutputAllocated = IsDlssEnabled();
+    m_IsRrGuidesAllocated = m_Settings.RR;
+
+    nri::Dim_t ow = m_IsDlssOutputAllocated ? (nri::Dim_t)GetOutputResolution().x : 1;
+    nri::Dim_t oh = m_IsDlssOutputAllocated ? (nri::Dim_t)GetOutputResolution().y : 1;
+    nri::Dim_t rrw = m_IsRrGuidesAllocated ? (nri::Dim_t)m_RenderResolution.x : 1;
+    nri::Dim_t rrh = m_IsRrGuidesAllocated ? (nri::Dim_t)m_RenderResolution.y : 1;
+
+    CreateTexture(Texture::DlssOutput, "DlssOutput", criticalColorFormat, ow, oh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE);
+    CreateTexture(Texture::RRGuide_DiffAlbedo, "RRGuide_DiffAlbedo", nri::Format::R10_G10_B10_A2_UNORM, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    CreateTexture(Texture::RRGuide_SpecAlbedo, "RRGuide_SpecAlbedo", nri::Format::R10_G10_B10_A2_UNORM, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    CreateTexture(Texture::RRGuide_SpecHitDistance, "RRGuide_SpecHitDistance", nri::Format::R16_SFLOAT, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    CreateTexture(Texture::RRGuide_Normal_Roughness, "RRGuide_Normal_Roughness", nri::Format::RGBA16_SFLOAT, rrw, rrh, 1, 1, false, nri::AccessBits::SHADER_RESOURCE_STORAGE);
+}
+
+void Sample::DestroyTexture(Texture texture) {
+    RemoveVramLedgerEntry(Get(texture));
+
+    NRI.DestroyDescriptor(GetDescriptor(texture));
+    NRI.DestroyDescriptor(GetStorageDescriptor(texture));
+    NRI.DestroyTexture(Get(texture));
+
+    GetDescriptor(texture) = nullptr;
+    GetStorageDescriptor(texture) = nullptr;
+    Get(texture) = nullptr;
+}
+
+void Sample::AddVramLedgerEntry(const void* resource, const char* name, VramCategory category, const char* heap, nri::Format format, uint64_t size, bool isAliased) {
+    m_VramLedger.push_back({resource, name, size, format, heap, category, isAliased});
+}
+
+void Sample::RemoveVramLedgerEntry(const void* resource) {
+    m_VramLedger.erase(std::remove_if(m_VramLedger.begin(), m_VramLedger.end(), [&](const VramLedgerEntry& x) { return x.resource == resource; }), m_VramLedger.end());
+}
+
+uint64_t Sample::GetVramLedgerSize() const {
+    // Aliased textures are covered by the transient heap entry
+    uint64_t size = 0;
+    for (const VramLedgerEntry& entry : m_VramLedger) {
+        if (!entry.isAliased)
+            size += entry.size;
+    }
+
+    return size;
+}
+
+void Sample::PrintVramLedger(bool isDetailed) {
+    constexpr double MB = 1.0 / (1024.0 * 1024.0);
+
+    std::array<uint64_t, (size_t)VramCategory::MAX_NUM> categorySizes = {};
+    for (const VramLedgerEntry& entry : m_VramLedger) {
+        if (!entry.isAliased)
+            categorySizes[(size_t)entry.category] += entry.size;
+    }
+
+    uint64_t totalSize = GetVramLedgerSize();
+
+    std::array<uint32_t, (size_t)VramCategory::MAX_NUM> categories;
+    for (uint32_t i = 0; i < (uint32_t)VramCategory::MAX_NUM; i++)
+        categories[i] = i;
+    std::stable_sort(categories.begin(), categories.end(), [&](uint32_t a, uint32_t b) { return categorySizes[a] > categorySizes[b]; });
+
+    std::vector<const VramLedgerEntry*> entries;
+    for (const VramLedgerEntry& entry : m_VramLedger)
+        entries.push_back(&entry);
+    std::stable_sort(entries.begin(), entries.end(), [](const VramLedgerEntry* a, const VramLedgerEntry* b) { return a->size > b->size; });
+
+    printf("VRAM ledger: %.2f Mb in %zu resources (NRD: %.2f Mb, DLSS and NIS are not included)\n", totalSize * MB, m_VramLedger.size(), m_NRD.GetTotalMemoryUsageInMb());
+
+    for (uint32_t category : categories) {
+        if (!categorySizes[category])
+            continue;
+
+        printf("  %-16s %9.2f Mb (%4.1f%%)\n", g_VramCategoryNames[category], categorySizes[category] * MB, 100.0 * categorySizes[category] / totalSize);
+
+        if (!isDetailed)
+            continue;
+
+        for (const VramLedgerEntry* entry : entries) {
+            if (entry->category != (VramCategory)category)
+                continue;
+
+            const char* formatName = entry->format == nri::Format::UNKNOWN ? "" : nriGetFormatProps(entry->format)->name;
+            printf("    %-32s %9.2f Mb  %-10s %s%s\n", entry->name.c_str(), entry->size * MB, entry->heap, formatName, entry->isAliased ? " (aliased)" : "");
+        }
+    }
+}
+
+uint32_t Sample::GetSceneTextureMipOffset(const utils::Texture& texture) const {
+    // Block compressed top mips must stay a multiple of the block size
+    const nri::FormatProps* formatProps = nriGetFormatProps(texture.GetFormat());
+
+    uint32_t mipOffset = 0;
+    while (mipOffset < m_SceneTextureMipBias && mipOffset + 1u < texture.GetMipNum()) {
+        uint32_t w = (uint32_t)texture.GetWidth() >> (mipOffset + 1);
+        uint32_t h = (uint32_t)texture.GetHeight() >> (mipOffset + 1);
+
+        if (min(w, h) < VRAM_MIN_SCENE_TEXTURE_SIZE || w % formatProps->blockWidth || h % formatProps->blockHeight)
+            break;
+
+        mipOffset++;
+    }
+
+    return mipOffset;
+}
+
+bool Sample::ApplyVramDegradation() {
+    if (m_SceneTextureMipBias < VRAM_MAX_SCENE_MIP_BIAS) {
+        m_SceneTextureMipBias++;
+        printf("VRAM budget: dropping %u top mip(s) of scene textures\n", m_SceneTextureMipBias);
+
+        return true;
+    }
+
+    if (!m_UseCompactColorFormats) {
+        m_UseCompactColorFormats = true;
+        printf("VRAM budget: R11_G11_B10_UFLOAT for 'Composed' and 'DlssOutput'\n");
+
+        return true;
+    }
+
+    if (m_SharcCapacity > SHARC_MIN_CAPACITY) {
+        m_SharcCapacity /= 2;
+        printf("VRAM budget: SHARC capacity reduced to %u entries\n", m_SharcCapacity);
+
+        return true;
+    }
+
+    return false;
+}
 
-    const nri::Descriptor* DlssBefore_Textures[] = {
-        GetDescriptor(Texture::Normal_Roughness),
-        GetDescriptor(Texture::BaseColor_Metalness),
-        GetDescriptor(Texture::Unfiltered_Spec),
-    };
+uint32_t Sample::GetRecommendedSharcCapacity() const {
+    // The cache mostly stores surfaces: the finest voxel size is "1 / SHARC_SCENE_SCALE" (in world units), further levels are coarser,
+    // thus the surface area of the bounding box at the finest level is a safe upper bound
+    float3 size = m_Scene.aabb.vMax - m_Scene.aabb.vMin;
+    double area = 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+    double entryNum = area * SHARC_SCENE_SCALE * SHARC_SCENE_SCALE * SHARC_CAPACITY_HEADROOM;
 
-    const nri::Descriptor* DlssBefore_StorageTextures[] = {
-        GetStorageDescriptor(Texture::ViewZ),
-        GetStorageDescriptor(Texture::RRGuide_DiffAlbedo),
-        GetStorageDescriptor(Texture::RRGuide_SpecAlbedo),
-        GetStorageDescriptor(Texture::RRGuide_SpecHitDistance),
-        GetStorageDescriptor(Texture::RRGuide_Normal_Roughness),
-    };
+    uint32_t capacity = SHARC_MIN_CAPACITY;
+    while (capacity < SHARC_CAPACITY && capacity < entryNum)
+        capacity <<= 1;
 
-    const nri::Descriptor* DlssAfter_StorageTextures[] = {
-        GetStorageDescriptor(Texture::DlssOutput),
-    };
+    return capacity;
+}
 
-    const nri::Descriptor* RayTracing_Textures[] = {
-        GetDescriptorForReadOnlyTexture(utils::StaticTexture::ScramblingRanking4),
-        GetDescriptorForReadOnlyTexture(utils::StaticTexture::ScramblingRanking8),
-        GetDescriptorForReadOnlyTexture(utils::StaticTexture::ScramblingRanking32),
-        GetDescriptorForReadOnlyTexture(utils::StaticTexture::SobolSequence),
-    };
+uint32_t Sample::GetSharcCapacity() const {
+    if (m_SharcCapacityTier == 0)
+        return GetRecommendedSharcCapacity();
 
-    std::vector<nri::Descriptor*> RayTracing_BindlessTextures(m_Scene.materials.size() * TEXTURES_PER_MATERIAL);
-    for (size_t i = 0; i < m_Scene.materials.size(); i++) {
-        const size_t index = i * TEXTURES_PER_MATERIAL;
-        const utils::Material& material = m_Scene.materials[i];
+    return SHARC_MIN_CAPACITY << (m_SharcCapacityTier - 1);
+}
 
-        RayTracing_BindlessTextures[index] = GetDescriptorForReadOnlyTexture(material.baseColorTexIndex);
-        RayTracing_BindlessTextures[index + 1] = GetDescriptorForReadOnlyTexture(material.roughnessMetalnessTexIndex);
-        RayTracing_BindlessTextures[index + 2] = GetDescriptorForReadOnlyTexture(material.normalTexIndex);
-        RayTracing_BindlessTextures[index + 3] = GetDescriptorForReadOnlyTexture(material.emissiveTexIndex);
+void Sample::CreateSharcBuffers() {
+    CreateBuffer(Buffer::SharcHashEntries, "SharcHashEntries", m_SharcCapacity, sizeof(uint64_t), nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
+    CreateBuffer(Buffer::SharcAccumulated, "SharcAccumulated", m_SharcCapacity, sizeof(uint32_t) * 4, nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
+    CreateBuffer(Buffer::SharcResolved, "SharcResolved", m_SharcCapacity, sizeof(uint32_t) * 4, nri::BufferUsageBits::SHADER_RESOURCE_STORAGE);
+    CreateBuffer(Buffer::SharcActiveEntries, "SharcActiveEntries", m_SharcCapacity * 3, sizeof(uint32_t), nri::BufferUsageBits::SHADER_RESOURCE_STORAGE); // stamps and 2 lists
+}
+
+void Sample::RecreateSharcBuffers(uint32_t frameIndex) {
+    NRI.DeviceWaitIdle(m_Device);
+
+    // Only SHARC buffers, their views and "DescriptorSet::Sharc" get recreated
+    constexpr Buffer sharcBuffers[] = {Buffer::SharcHashEntries, Buffer::SharcAccumulated, Buffer::SharcResolved, Buffer::SharcActiveEntries};
+    for (Buffer buffer : sharcBuffers) {
+        NRI.DestroyDescriptor(GetStorageDescriptor(buffer));
+        GetStorageDescriptor(buffer) = nullptr;
+
+        RemoveVramLedgerEntry(Get(buffer));
+        NRI.DestroyBuffer(Get(buffer));
+        Get(buffer) = nullptr;
     }
 
+    m_SharcCapacity = GetSharcCapacity();
+    CreateSharcBuffers();
+
     const nri::Descriptor* Sharc_StorageBuffers[] = {
         GetStorageDescriptor(Buffer::SharcHashEntries),
         GetStorageDescriptor(Buffer::SharcAccumulated),
         GetStorageDescriptor(Buffer::SharcResolved),
+        GetStorageDescriptor(Buffer::SharcStats),
+        GetStorageDescriptor(Buffer::SharcActiveEntries),
+        GetStorageDescriptor(Buffer::SharcActiveArgs),
     };
 
-    // Allocate and update everything in one go
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::SharcUpdatePing), 2, 0));    // and pong
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::ConfidenceBlurPing), 2, 0)); // and pong
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::TraceOpaque), 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::Composition), 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::TraceTransparent), 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::TaaPing), 2, 0)); // and pong
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::Final), 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::DlssBefore), 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_OTHER, &Get(DescriptorSet::DlssAfter), 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_RAY_TRACING, &Get(DescriptorSet::RayTracing), 1, helper::GetCountOf(RayTracing_BindlessTextures)));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, SET_SHARC, &Get(DescriptorSet::Sharc), 1, 0));
+    const nri::UpdateDescriptorRangeDesc updateDescriptorRangeDesc = {Get(DescriptorSet::Sharc), 0, 0, Sharc_StorageBuffers, helper::GetCountOf(Sharc_StorageBuffers)};
+    NRI.UpdateDescriptorRanges(&updateDescriptorRangeDesc, 1);
 
-    std::vector<nri::UpdateDescriptorRangeDesc> updateDescriptorRangeDescs;
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePing), 0, 0, SharcUpdatePing_Textures, helper::GetCountOf(SharcUpdatePing_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePing), 1, 0, SharcUpdatePing_StorageTextures, helper::GetCountOf(SharcUpdatePing_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePong), 0, 0, SharcUpdatePong_Textures, helper::GetCountOf(SharcUpdatePong_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::SharcUpdatePong), 1, 0, SharcUpdatePong_StorageTextures, helper::GetCountOf(SharcUpdatePong_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::ConfidenceBlurPing), 0, 0, ConfidenceBlurPing_Textures, helper::GetCountOf(ConfidenceBlurPing_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::ConfidenceBlurPing), 1, 0, ConfidenceBlurPing_StorageTextures, helper::GetCountOf(ConfidenceBlurPing_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::ConfidenceBlurPong), 0, 0, ConfidenceBlurPong_Textures, helper::GetCountOf(ConfidenceBlurPong_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::ConfidenceBlurPong), 1, 0, ConfidenceBlurPong_StorageTextures, helper::GetCountOf(ConfidenceBlurPong_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceOpaque), 0, 0, TraceOpaque_Textures, helper::GetCountOf(TraceOpaque_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceOpaque), 1, 0, TraceOpaque_StorageTextures, helper::GetCountOf(TraceOpaque_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Composition), 0, 0, Composition_Textures, helper::GetCountOf(Composition_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Composition), 1, 0, Composition_StorageTextures, helper::GetCountOf(Composition_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceTransparent), 0, 0, TraceTransparent_Textures, helper::GetCountOf(TraceTransparent_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TraceTransparent), 1, 0, TraceTransparent_StorageTextures, helper::GetCountOf(TraceTransparent_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPing), 0, 0, TaaPing_Textures, helper::GetCountOf(TaaPing_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPing), 1, 0, TaaPing_StorageTextures, helper::GetCountOf(TaaPing_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPong), 0, 0, TaaPong_Textures, helper::GetCountOf(TaaPong_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::TaaPong), 1, 0, TaaPong_StorageTextures, helper::GetCountOf(TaaPong_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Final), 0, 0, Final_Textures, helper::GetCountOf(Final_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Final), 1, 0, Final_StorageTextures, helper::GetCountOf(Final_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::DlssBefore), 0, 0, DlssBefore_Textures, helper::GetCountOf(DlssBefore_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::DlssBefore), 1, 0, DlssBefore_StorageTextures, helper::GetCountOf(DlssBefore_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::DlssAfter), 1, 0, DlssAfter_StorageTextures, helper::GetCountOf(DlssAfter_StorageTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::RayTracing), 0, 0, RayTracing_Textures, helper::GetCountOf(RayTracing_Textures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::RayTracing), 1, 0, RayTracing_BindlessTextures.data(), helper::GetCountOf(RayTracing_BindlessTextures)});
-    updateDescriptorRangeDescs.push_back({Get(DescriptorSet::Sharc), 0, 0, Sharc_StorageBuffers, helper::GetCountOf(Sharc_StorageBuffers)});
+    // New memory can contain anything (including SHARC data of the previous capacity)
+    m_SharcClearFrameIndex = frameIndex;
+    m_SharcOccupiedPrev = 0;
 
-    NRI.UpdateDescriptorRanges(updateDescriptorRangeDescs.data(), helper::GetCountOf(updateDescriptorRangeDescs));
+    printf("SHARC capacity: %u entries (%.1f Mb)\n", m_SharcCapacity, GetSharcMemorySize() / (1024.0 * 1024.0));
 }
 
-void Sample::CreateTexture(Texture texture, const char* debugName, nri::Format format, nri::Dim_t width, nri::Dim_t height, nri::Dim_t mipNum, nri::Dim_t arraySize, bool isReadOnly, nri::AccessBits initialAccess) {
-    nri::TextureDesc desc = {};
-    desc.type = nri::TextureType::TEXTURE_2D;
-    desc.usage = nri::TextureUsageBits::SHADER_RESOURCE | (isReadOnly ? nri::TextureUsageBits::NONE : nri::TextureUsageBits::SHADER_RESOURCE_STORAGE);
-    desc.format = format;
-    desc.width = width;
-    desc.height = height;
-    desc.depth = 1;
-    desc.mipNum = mipNum;
-    desc.layerNum = arraySize;
-    desc.sampleNum = 1;
+void Sample::FitVramBudget(uint64_t baselineSize, nri::Format swapChainFormat) {
+    constexpr double MB = 1.0 / (1024.0 * 1024.0);
+    const uint64_t budget = uint64_t(m_VramBudget) * 1024 * 1024;
 
-    NRI_ABORT_ON_FAILURE(NRI.CreatePlacedTexture(*m_Device, NriDeviceHeap, desc, Get(texture)));
+    // The ledger has exact sizes, unlike "QueryVideoMemoryInfo", which doesn't go down when placed resources are released
+    uint64_t size = baselineSize + GetVramLedgerSize();
+    while (size > budget) {
+        if (!ApplyVramDegradation()) {
+            printf("VRAM budget: %.2f Mb over %u Mb, nothing left to degrade!\n", (size - budget) * MB, m_VramBudget);
+            return;
+        }
 
-    NRI.SetDebugName((nri::Object*)Get(texture), debugName);
+        // Acceleration structures are kept, everything else from "CreateResourcesAndDescriptors" gets recreated (no data uploaded yet)
+        for (nri::Texture*& texture : m_Textures) {
+            RemoveVramLedgerEntry(texture);
+            NRI.DestroyTexture(texture);
+            texture = nullptr;
+        }
 
-    int32_t index = (int32_t)texture - (int32_t)Texture::BaseReadOnlyTexture;
-    nri::TextureViewDesc viewDesc = {Get(texture), arraySize > 1 ? nri::TextureView::TEXTURE_ARRAY : nri::TextureView::TEXTURE, desc.format};
-    NRI_ABORT_ON_FAILURE(NRI.CreateTextureView(viewDesc, index >= 0 ? GetDescriptorForReadOnlyTexture((uint32_t)index) : GetDescriptor(texture)));
+        RemoveVramLedgerEntry(m_TransientHeap);
+        NRI.FreeMemory(m_TransientHeap);
+        m_TransientHeap = nullptr;
 
-    if (desc.usage & nri::TextureUsageBits::SHADER_RESOURCE_STORAGE) {
-        const nri::FormatProps* formatProps = nriGetFormatProps(desc.format);
+        for (nri::Buffer*& buffer : m_Buffers) {
+            RemoveVramLedgerEntry(buffer);
+            NRI.DestroyBuffer(buffer);
+            buffer = nullptr;
+        }
 
-        viewDesc.format = formatProps->isSrgb ? nri::Format((uint8_t)desc.format - 1) : desc.format; // demote sRGB to UNORM
-        viewDesc.type = arraySize > 1 ? nri::TextureView::STORAGE_TEXTURE_ARRAY : nri::TextureView::STORAGE_TEXTURE;
-        NRI_ABORT_ON_FAILURE(NRI.CreateTextureView(viewDesc, GetStorageDescriptor(texture)));
-    }
+        for (nri::Descriptor*& descriptor : m_Descriptors) {
+            NRI.DestroyDescriptor(descriptor);
+            descriptor = nullptr;
+        }
 
-    if (initialAccess != nri::AccessBits::NONE) { // initial state
-        nri::Layout layout = nri::Layout::SHADER_RESOURCE;
-        if (initialAccess & nri::AccessBits::COPY_SOURCE)
-            layout = nri::Layout::COPY_SOURCE;
-        else if (initialAccess & nri::AccessBits::COPY_DESTINATION)
-            layout = nri::Layout::COPY_DESTINATION;
-        else if (initialAccess & nri::AccessBits::SHADER_RESOURCE_STORAGE)
-            layout = nri::Layout::SHADER_RESOURCE_STORAGE;
+        CreateResourcesAndDescriptors(swapChainFormat);
 
-        GetState(texture) = TextureBarrierFromUnknown(Get(texture), {initialAccess, layout});
+        size = baselineSize + GetVramLedgerSize();
     }
+
+    printf("VRAM budget: %.2f Mb of %u Mb\n", size * MB, m_VramBudget);
 }
 
-void Sample::CreateBuffer(Buffer buffer, const char* debugName, uint64_t elements, uint32_t stride, nri::BufferUsageBits usage) {
-    if (!elements)
-        elements = 1;
+void Sample::UpdateModeSpecificResources() {
+    // NIS ( only the variant matching the display is needed )
+    uint32_t nisIndex = m_SdrScale > 1.0f ? 1 : 0;
+    if (!m_NIS[nisIndex]) {
+        nri::UpscalerDesc upscalerDesc = {};
+        upscalerDesc.upscaleResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
+        upscalerDesc.type = nri::UpscalerType::NIS;
+        upscalerDesc.flags = nisIndex ? nri::UpscalerBits::HDR : nri::UpscalerBits::NONE;
 
-    nri::BufferDesc desc = {};
-    desc.size = elements * stride;
-    desc.structureStride = stride;
-    desc.usage = usage;
+        NRI_ABORT_ON_FAILURE(NRI.CreateUpscaler(*m_Device, upscalerDesc, m_NIS[nisIndex]));
+    }
 
-    NRI_ABORT_ON_FAILURE(NRI.CreatePlacedBuffer(*m_Device, NriDeviceHeap, desc, Get(buffer)));
+    // DLSS
+    bool isDlsrNeeded = m_IsDlsrSupported && m_Settings.SR && !m_Settings.RR;
+    bool isDlrrNeeded = m_IsDlrrSupported && m_Settings.RR;
+    bool isDlsrChanged = isDlsrNeeded != (m_DLSR != nullptr);
+    bool isDlrrChanged = isDlrrNeeded != (m_DLRR != nullptr);
+    bool areTexturesChanged = IsDlssEnabled() != m_IsDlssOutputAllocated || m_Settings.RR != m_IsRrGuidesAllocated;
 
-    NRI.SetDebugName((nri::Object*)Get(buffer), debugName);
+    if (!isDlsrChanged && !isDlrrChanged && !areTexturesChanged)
+        return;
 
-    if (desc.usage & nri::BufferUsageBits::SHADER_RESOURCE) {
-        const nri::BufferViewDesc viewDesc = {Get(buffer), nri::BufferView::STRUCTURED_BUFFER};
-        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(viewDesc, GetDescriptor(buffer)));
+    NRI.DeviceWaitIdle(m_Device);
+
+    // Release first to lower the peak
+    if (isDlsrChanged && !isDlsrNeeded) {
+        NRI.DestroyUpscaler(m_DLSR);
+        m_DLSR = nullptr;
     }
 
-    if (desc.usage & nri::BufferUsageBits::SHADER_RESOURCE_STORAGE) {
-        const nri::BufferViewDesc viewDesc = {Get(buffer), nri::BufferView::STORAGE_STRUCTURED_BUFFER};
-        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(viewDesc, GetStorageDescriptor(buffer)));
+    if (isDlrrChanged && !isDlrrNeeded) {
+        NRI.DestroyUpscaler(m_DLRR);
+        m_DLRR = nullptr;
     }
+
+    if (areTexturesChanged) {
+        DestroyTexture(Texture::DlssOutput);
+        DestroyTexture(Texture::RRGuide_DiffAlbedo);
+        DestroyTexture(Texture::RRGuide_SpecAlbedo);
+        DestroyTexture(Texture::RRGuide_SpecHitDistance);
+        DestroyTexture(Texture::RRGuide_Normal_Roughness);
+
+        // Recreated textures are tracked in "undefined" state (see "CreateTextureViews"), all of them are fully overwritten every frame
+        CreateModeSpecificTextures();
+
+        // Patch descriptor sets referencing these textures
+        const nri::Descriptor* DlssBefore_StorageTextures[] = {
+            GetStorageDescriptor(Texture::ViewZ),
+            GetStorageDescriptor(Texture::RRGuide_DiffAlbedo),
+            GetStorageDescriptor(Texture::RRGuide_SpecAlbedo),
+            GetStorageDescriptor(Texture::RRGuide_SpecHitDistance),
+            GetStorageDescriptor(Texture::RRGuide_Normal_Roughness),
+        };
+
+        const nri::Descriptor* DlssAfter_StorageTextures[] = {
+            GetStorageDescriptor(Texture::DlssOutput),
+        };
+
+        const nri::UpdateDescriptorRangeDesc updateDescriptorRangeDescs[] = {
+            {Get(DescriptorSet::DlssBefore), 1, 0, DlssBefore_StorageTextures, helper::GetCountOf(DlssBefore_StorageTextures)},
+            {Get(DescriptorSet::DlssAfter), 1, 0, DlssAfter_StorageTextures, helper::GetCountOf(DlssAfter_StorageTextures)},
+        };
+
+        NRI.UpdateDescriptorRanges(updateDescriptorRangeDescs, helper::GetCountOf(updateDescriptorRangeDescs));
+    }
+
+    if (isDlsrChanged && isDlsrNeeded)
+        CreateDlss(upscalerType, m_DLSR);
+
+    if (isDlrrChanged && isDlrrNeeded)
+        CreateDlss(nri::UpscalerType::DLRR, m_DLRR);
 }
 
 void Sample::UploadStaticData() {
@@ -3331,89 +5665,295 @@ void Sample::UploadStaticData() {
             PrimitiveData& data = primitiveData[meshInstance.primitiveOffset + j];
             const utils::Primitive& primitive = m_Scene.primitives[staticPrimitiveIndex];
 
-            data.uv0 = float16_t2(float2(v0.uv[0], v0.uv[1]));
-            data.uv1 = float16_t2(float2(v1.uv[0], v1.uv[1]));
-            data.uv2 = float16_t2(float2(v2.uv[0], v2.uv[1]));
-            data.worldArea = primitive.worldArea;
+            data.uv0 = float16_t2(float2(v0.uv[0], v0.uv[1]));
+            data.uv1 = float16_t2(float2(v1.uv[0], v1.uv[1]));
+            data.uv2 = float16_t2(float2(v2.uv[0], v2.uv[1]));
+            data.worldArea = primitive.worldArea;
+
+            data.n0 = float16_t2(float2(n0.x, n0.y));
+            data.n1 = float16_t2(float2(n1.x, n1.y));
+            data.n2 = float16_t2(float2(n2.x, n2.y));
+            data.uvArea = primitive.uvArea;
+
+            data.t0 = float16_t2(float2(t0.x, t0.y));
+            data.t1 = float16_t2(float2(t1.x, t1.y));
+            data.t2 = float16_t2(float2(t2.x, t2.y));
+            data.bitangentSign = v0.T[3];
+        }
+    }
+
+    // Gather subresources for read-only textures
+    std::vector<nri::TextureSubresourceUploadDesc> subresources;
+    for (const utils::Texture* texture : m_Scene.textures) {
+        uint32_t mipOffset = GetSceneTextureMipOffset(*texture);
+
+        for (uint32_t layer = 0; layer < texture->GetArraySize(); layer++) {
+            for (uint32_t mip = mipOffset; mip < texture->GetMipNum(); mip++) {
+                nri::TextureSubresourceUploadDesc subresource;
+                texture->GetSubresource(subresource, mip, layer);
+
+                subresources.push_back(subresource);
+            }
+        }
+    }
+
+    // Gather upload data for read-only textures
+    std::vector<nri::TextureUploadDesc> textureUploadDescs;
+    size_t subresourceOffset = 0;
+
+    for (size_t i = 0; i < m_Scene.textures.size(); i++) {
+        const utils::Texture* texture = m_Scene.textures[i];
+        textureUploadDescs.push_back({&subresources[subresourceOffset], Get((Texture)((size_t)Texture::BaseReadOnlyTexture + i)), {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}});
+
+        nri::Dim_t mipNum = texture->GetMipNum() - (nri::Dim_t)GetSceneTextureMipOffset(*texture);
+        nri::Dim_t arraySize = texture->GetArraySize();
+        subresourceOffset += size_t(arraySize) * size_t(mipNum);
+    }
+
+    // Append textures without data to initialize initial state
+    for (const nri::TextureBarrierDesc& state : m_TextureStates) {
+        nri::TextureUploadDesc desc = {};
+        desc.after = {state.after.access, state.after.layout};
+        desc.texture = (nri::Texture*)state.texture;
+
+        textureUploadDescs.push_back(desc);
+    }
+
+    // Buffer data
+    nri::BufferUploadDesc bufferUploadDescs[] = {
+        {primitiveData.data(), Get(Buffer::PrimitiveData), {nri::AccessBits::SHADER_RESOURCE}},
+    };
+
+    // Upload data and apply states
+    NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, textureUploadDescs.data(), helper::GetCountOf(textureUploadDescs), bufferUploadDescs, helper::GetCountOf(bufferUploadDescs)));
+
+    m_AreInitialStatesApplied = true;
+}
+
+void Sample::FillSimulationInput(uint32_t frameIndex, bool useInputDevices) {
+    SimulationInput& input = m_SimulationInput;
+    input.settings = m_Settings;
+    input.settingsPrev = m_SettingsPrev;
+    input.camera = m_Camera;
+    input.timeStamp = m_Timer.GetTimeStamp();
+    input.frameTime = m_Timer.GetFrameTime();
+    input.frameIndex = frameIndex;
+    input.glassObjects = m_GlassObjects;
+
+    cBoxf cameraLimits = m_Scene.aabb;
+    cameraLimits.Scale(4.0f);
+
+    CameraDesc& desc = input.cameraDesc;
+    desc = {};
+    desc.limits = cameraLimits;
+    desc.aspectRatio = float(GetOutputResolution().x) / float(GetOutputResolution().y);
+    desc.horizontalFov = degrees(atan(tan(radians(m_Settings.camFov) * 0.5f) * desc.aspectRatio * 9.0f / 16.0f) * 2.0f); // recalculate to ultra-wide if needed
+    desc.nearZ = NEAR_Z * m_Settings.meterToUnitsMultiplier;
+    desc.farZ = 10000.0f * m_Settings.meterToUnitsMultiplier;
+    desc.isCustomMatrixSet = false; // No camera animation hooked up
+    desc.isPositiveZ = m_PositiveZ;
+    desc.isReversedZ = m_ReversedZ;
+    desc.orthoRange = m_Settings.ortho ? tan(radians(m_Settings.camFov) * 0.5f) * 3.0f * m_Settings.meterToUnitsMultiplier : 0.0f;
+    desc.backwardOffset = CAMERA_BACKWARD_OFFSET;
+
+    if (useInputDevices)
+        GetCameraDescFromInputDevices(desc);
+}
+
+void Sample::Simulate(const SimulationInput& input, FrameSnapshot& snapshot) {
+    // Only "snapshot" and the scene are modified, "settings" fields updated here are consumed in "ApplySimulation"
+    Settings& settings = snapshot.settings;
+    settings = input.settings;
+
+    const Settings& settingsPrev = input.settingsPrev;
+
+    Camera& camera = snapshot.camera;
+    camera = input.camera;
+    camera.SavePreviousState();
+
+    snapshot.inputTimeStamp = input.timeStamp;
+
+    // Update camera
+    CameraDesc desc = input.cameraDesc;
+
+    if (settings.motionStartTime > 0.0) {
+        float time = float(input.timeStamp - settings.motionStartTime);
+        float amplitude = 40.0f * camera.state.motionScale;
+        float period = 0.0003f * time * (settings.emulateMotionSpeed < 0.0f ? 1.0f / (1.0f + abs(settings.emulateMotionSpeed)) : (1.0f + settings.emulateMotionSpeed));
+
+        float3 localPos = camera.state.mWorldToView.Row(0).xyz;
+        if (settings.motionMode == 1)
+            localPos = camera.state.mWorldToView.Row(1).xyz;
+        else if (settings.motionMode == 2)
+            localPos = camera.state.mWorldToView.Row(2).xyz;
+        else if (settings.motionMode == 3) {
+            float3 rows[3] = {camera.state.mWorldToView.Row(0).xyz, camera.state.mWorldToView.Row(1).xyz, camera.state.mWorldToView.Row(2).xyz};
+            float f = sin(Pi(period * 3.0f));
+            localPos = normalize(f < 0.0f ? lerp(rows[1], rows[0], float3(abs(f))) : lerp(rows[1], rows[2], float3(f)));
+        }
+
+        if (settings.motionMode == 4) {
+            float f = fmod(Pi(period * 2.0f), Pi(2.0f));
+            float3 axisX = camera.state.mWorldToView.Row(0).xyz;
+            float3 axisY = camera.state.mWorldToView.Row(1).xyz;
+            float2 v = Rotate(float2(1.0f, 0.0f), f);
+            localPos = (axisX * v.x + axisY * v.y) * amplitude / Pi(1.0f);
+        } else
+            localPos *= amplitude * (settings.linearMotion ? WaveTriangle(period) - 0.5f : sin(Pi(period)) * 0.5f);
+
+        desc.dUser = localPos - m_PrevLocalPos;
+        m_PrevLocalPos = localPos;
+    } else if (settings.motionStartTime == -1.0) {
+        settings.motionStartTime = input.timeStamp;
+        m_PrevLocalPos = float3::Zero();
+    }
+
+    camera.Update(desc, input.frameIndex);
+
+    // Animate scene
+    const float animationSpeed = settings.pauseAnimation ? 0.0f : (settings.animationSpeed < 0.0f ? 1.0f / (1.0f + abs(settings.animationSpeed)) : (1.0f + settings.animationSpeed));
+    const float animationDelta = animationSpeed * input.frameTime * 0.001f;
+
+    for (size_t i = 0; i < m_Scene.animations.size(); i++)
+        m_Scene.Animate(animationSpeed, input.frameTime, settings.animationProgress, (int32_t)i);
+
+    // Animate sun
+    if (settings.animateSun) {
+        static float sunAzimuthPrev = 0.0f;
+        static double sunMotionStartTime = 0.0;
+        if (settings.animateSun != settingsPrev.animateSun) {
+            sunAzimuthPrev = settings.sunAzimuth;
+            sunMotionStartTime = input.timeStamp;
+        }
+        double t = input.timeStamp - sunMotionStartTime;
+        if (!settings.pauseAnimation)
+            settings.sunAzimuth = sunAzimuthPrev + (float)sin(t * animationSpeed * 0.0003) * 10.0f;
+    }
+
+    // Animate objects
+    const float scale = settings.animatedObjectScale * settings.meterToUnitsMultiplier / 2.0f;
+    if (settings.nineBrothers) {
+        const float3& vRight = camera.state.mViewToWorld[0].xyz;
+        const float3& vTop = camera.state.mViewToWorld[1].xyz;
+        const float3& vForward = camera.state.mViewToWorld[2].xyz;
+
+        float3 basePos = float3(camera.state.globalPosition);
+
+#if (USE_CAMERA_ATTACHED_REFLECTION_TEST == 1)
+        settings.animatedObjectNum = 3;
+
+        for (int32_t i = -1; i <= 1; i++) {
+            const uint32_t index = i + 1;
+
+            float x = float(i) * 3.0f;
+            float y = (i == 0) ? -1.5f : 0.0f;
+            float z = (i == 0) ? 1.0f : 3.0f;
+
+            x *= scale;
+            y *= scale;
+            z *= desc.isPositiveZ ? scale : -scale;
 
-            data.n0 = float16_t2(float2(n0.x, n0.y));
-            data.n1 = float16_t2(float2(n1.x, n1.y));
-            data.n2 = float16_t2(float2(n2.x, n2.y));
-            data.uvArea = primitive.uvArea;
+            float3 pos = basePos + vRight * x + vTop * y + vForward * z;
 
-            data.t0 = float16_t2(float2(t0.x, t0.y));
-            data.t1 = float16_t2(float2(t1.x, t1.y));
-            data.t2 = float16_t2(float2(t2.x, t2.y));
-            data.bitangentSign = v0.T[3];
+            utils::Instance& instance = m_Scene.instances[m_AnimatedInstances[index].instanceID];
+            instance.position = double3(pos);
+            instance.rotation = camera.state.mViewToWorld;
+            instance.rotation.SetTranslation(float3::Zero());
+            instance.rotation.AddScale(scale);
         }
-    }
+#else
+        settings.animatedObjectNum = 9;
 
-    // Gather subresources for read-only textures
-    std::vector<nri::TextureSubresourceUploadDesc> subresources;
-    for (const utils::Texture* texture : m_Scene.textures) {
-        for (uint32_t layer = 0; layer < texture->GetArraySize(); layer++) {
-            for (uint32_t mip = 0; mip < texture->GetMipNum(); mip++) {
-                nri::TextureSubresourceUploadDesc subresource;
-                texture->GetSubresource(subresource, mip, layer);
+        for (int32_t i = -1; i <= 1; i++) {
+            for (int32_t j = -1; j <= 1; j++) {
+                const uint32_t index = (i + 1) * 3 + (j + 1);
 
-                subresources.push_back(subresource);
+                float x = float(i) * scale * 4.0f;
+                float y = float(j) * scale * 4.0f;
+                float z = 10.0f * (desc.isPositiveZ ? scale : -scale);
+
+                float3 pos = basePos + vRight * x + vTop * y + vForward * z;
+
+                utils::Instance& instance = m_Scene.instances[m_AnimatedInstances[index].instanceID];
+                instance.position = double3(pos);
+                instance.rotation = camera.state.mViewToWorld;
+                instance.rotation.SetTranslation(float3::Zero());
+                instance.rotation.AddScale(scale);
             }
         }
+#endif
+    } else if (settings.animatedObjects) {
+        for (int32_t i = 0; i < settings.animatedObjectNum; i++) {
+            float3 position;
+            float4x4 transform = m_AnimatedInstances[i].Animate(animationDelta, scale, position);
+
+            utils::Instance& instance = m_Scene.instances[m_AnimatedInstances[i].instanceID];
+            instance.rotation = transform;
+            instance.position = double3(position);
+        }
     }
 
-    // Gather upload data for read-only textures
-    std::vector<nri::TextureUploadDesc> textureUploadDescs;
-    size_t subresourceOffset = 0;
+    GatherInstanceData(input, snapshot);
+}
 
-    for (size_t i = 0; i < m_Scene.textures.size(); i++) {
-        const utils::Texture* texture = m_Scene.textures[i];
-        textureUploadDescs.push_back({&subresources[subresourceOffset], Get((Texture)((size_t)Texture::BaseReadOnlyTexture + i)), {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}});
+void Sample::ApplySimulation() {
+    m_FrameSnapshotIndex = 1 - m_FrameSnapshotIndex;
 
-        nri::Dim_t mipNum = texture->GetMipNum();
-        nri::Dim_t arraySize = texture->GetArraySize();
-        subresourceOffset += size_t(arraySize) * size_t(mipNum);
-    }
+    const FrameSnapshot& snapshot = m_FrameSnapshots[m_FrameSnapshotIndex];
+    m_Camera = snapshot.camera;
 
-    // Append textures without data to initialize initial state
-    for (const nri::TextureBarrierDesc& state : m_TextureStates) {
-        nri::TextureUploadDesc desc = {};
-        desc.after = {state.after.access, state.after.layout};
-        desc.texture = (nri::Texture*)state.texture;
+    // Settings animated by the simulation
+    m_Settings.motionStartTime = snapshot.settings.motionStartTime;
+    m_Settings.sunAzimuth = snapshot.settings.sunAzimuth;
+    m_Settings.animationProgress = snapshot.settings.animationProgress;
+    m_Settings.animatedObjectNum = snapshot.settings.animatedObjectNum;
+}
 
-        textureUploadDescs.push_back(desc);
-    }
+void Sample::SimulationThread() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_SimulationMutex);
+            m_SimulationStart.wait(lock, [&] { return m_IsSimulationExitRequested || m_IsSimulationRunning; });
 
-    // Buffer data
-    nri::BufferUploadDesc bufferUploadDescs[] = {
-        {primitiveData.data(), Get(Buffer::PrimitiveData), {nri::AccessBits::SHADER_RESOURCE}},
-    };
+            if (m_IsSimulationExitRequested)
+                return;
+        }
 
-    // Upload data and apply states
-    NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, textureUploadDescs.data(), helper::GetCountOf(textureUploadDescs), bufferUploadDescs, helper::GetCountOf(bufferUploadDescs)));
+        Simulate(m_SimulationInput, m_FrameSnapshots[1 - m_FrameSnapshotIndex]);
+
+        {
+            std::lock_guard<std::mutex> lock(m_SimulationMutex);
+            m_IsSimulationRunning = false;
+        }
+        m_SimulationFinish.notify_one();
+    }
 }
 
-void Sample::GatherInstanceData() {
-    bool isAnimatedObjects = m_Settings.animatedObjects;
-    if (m_Settings.blink) {
-        double period = 0.0003 * m_Timer.GetTimeStamp() * (m_Settings.animationSpeed < 0.0f ? 1.0f / (1.0f + abs(m_Settings.animationSpeed)) : (1.0f + m_Settings.animationSpeed));
+void Sample::GatherInstanceData(const SimulationInput& input, FrameSnapshot& snapshot) {
+    const Settings& settings = snapshot.settings;
+    const Camera& camera = snapshot.camera;
+
+    bool isAnimatedObjects = settings.animatedObjects;
+    if (settings.blink) {
+        double period = 0.0003 * input.timeStamp * (settings.animationSpeed < 0.0f ? 1.0f / (1.0f + abs(settings.animationSpeed)) : (1.0f + settings.animationSpeed));
         isAnimatedObjects &= WaveTriangle(period) > 0.5;
     }
 
     uint64_t staticInstanceCount = m_Scene.instances.size() - m_AnimatedInstances.size();
-    uint64_t instanceCount = staticInstanceCount + (isAnimatedObjects ? m_Settings.animatedObjectNum : 0);
+    uint64_t instanceCount = staticInstanceCount + (isAnimatedObjects ? settings.animatedObjectNum : 0);
     uint32_t instanceIndex = 0;
 
-    m_InstanceData.clear();
-    m_WorldTlasData.clear();
-    m_LightTlasData.clear();
+    snapshot.instanceData.clear();
+    snapshot.worldTlasData.clear();
+    snapshot.lightTlasData.clear();
 
     float4x4 mCameraTranslation = float4x4::Identity();
-    mCameraTranslation.AddTranslation(m_Camera.GetRelative(double3::Zero()));
+    mCameraTranslation.AddTranslation(camera.GetRelative(double3::Zero()));
     mCameraTranslation.Transpose3x4();
 
     // Add static opaque (includes emissives)
     if (m_OpaqueObjectsNum) {
-        nri::TopLevelInstance& topLevelInstance = m_WorldTlasData.emplace_back();
+        nri::TopLevelInstance& topLevelInstance = snapshot.worldTlasData.emplace_back();
         topLevelInstance = {};
         memcpy(topLevelInstance.transform, mCameraTranslation.a, sizeof(topLevelInstance.transform));
         topLevelInstance.instanceId = instanceIndex;
@@ -3427,7 +5967,7 @@ void Sample::GatherInstanceData() {
 
     // Add static transparent
     if (m_TransparentObjectsNum) {
-        nri::TopLevelInstance& topLevelInstance = m_WorldTlasData.emplace_back();
+        nri::TopLevelInstance& topLevelInstance = snapshot.worldTlasData.emplace_back();
         topLevelInstance = {};
         memcpy(topLevelInstance.transform, mCameraTranslation.a, sizeof(topLevelInstance.transform));
         topLevelInstance.instanceId = instanceIndex;
@@ -3441,7 +5981,7 @@ void Sample::GatherInstanceData() {
 
     // Add static emissives (only emissives in a separate TLAS)
     if (m_EmissiveObjectsNum) {
-        nri::TopLevelInstance& topLevelInstance = m_LightTlasData.emplace_back();
+        nri::TopLevelInstance& topLevelInstance = snapshot.lightTlasData.emplace_back();
         topLevelInstance = {};
         memcpy(topLevelInstance.transform, mCameraTranslation.a, sizeof(topLevelInstance.transform));
         topLevelInstance.instanceId = instanceIndex;
@@ -3503,8 +6043,8 @@ void Sample::GatherInstanceData() {
                     mObjectToWorldPrev = mObjectToWorldPrev * transform;
                 }
 
-                mObjectToWorld.AddTranslation(m_Camera.GetRelative(instance.position));
-                mObjectToWorldPrev.AddTranslation(m_Camera.GetRelative(instance.positionPrev));
+                mObjectToWorld.AddTranslation(camera.GetRelative(instance.position));
+                mObjectToWorldPrev.AddTranslation(camera.GetRelative(instance.positionPrev));
 
                 // World to world (previous state) transform
                 // FP64 used to avoid imprecision problems on close up views (InvertOrtho can't be used due to scaling factors)
@@ -3534,7 +6074,7 @@ void Sample::GatherInstanceData() {
             const utils::MeshInstance& meshInstance = m_Scene.meshInstances[instance.meshInstanceIndex];
             uint32_t baseTextureIndex = instance.materialIndex * TEXTURES_PER_MATERIAL;
             float3 scale = instance.rotation.GetScale();
-            bool isForcedEmission = m_Settings.emission && m_Settings.emissiveObjects && (i % 3 == 0);
+            bool isForcedEmission = settings.emission && settings.emissiveObjects && (i % 3 == 0);
 
             uint32_t flags = 0;
             if (!instance.allowUpdate)
@@ -3550,14 +6090,14 @@ void Sample::GatherInstanceData() {
             if (i >= staticInstanceCount) {
                 if (isForcedEmission)
                     flags |= FLAG_FORCED_EMISSION;
-                else if (m_GlassObjects && (i % 4 == 0))
+                else if (input.glassObjects && (i % 4 == 0))
                     flags |= FLAG_TRANSPARENT;
             }
 
             if (!(flags & FLAG_TRANSPARENT))
                 flags |= FLAG_NON_TRANSPARENT;
 
-            InstanceData& instanceData = m_InstanceData.emplace_back();
+            InstanceData& instanceData = snapshot.instanceData.emplace_back();
             instanceData = {};
             instanceData.mOverloadedMatrix0 = mOverloadedMatrix.Col(0);
             instanceData.mOverloadedMatrix1 = mOverloadedMatrix.Col(1);
@@ -3579,20 +6119,22 @@ void Sample::GatherInstanceData() {
                 topLevelInstance.flags = nri::TopLevelInstanceBits::TRIANGLE_CULL_DISABLE | (material.IsAlphaOpaque() ? nri::TopLevelInstanceBits::NONE : nri::TopLevelInstanceBits::FORCE_OPAQUE);
                 topLevelInstance.accelerationStructureHandle = NRI.GetAccelerationStructureHandle(*m_AccelerationStructures[meshInstance.blasIndex]);
 
-                m_WorldTlasData.push_back(topLevelInstance);
+                snapshot.worldTlasData.push_back(topLevelInstance);
 
                 if (isForcedEmission || material.IsEmissive())
-                    m_LightTlasData.push_back(topLevelInstance);
+                    snapshot.lightTlasData.push_back(topLevelInstance);
             }
         }
     }
+}
 
+void Sample::StreamInstanceData(const FrameSnapshot& snapshot) {
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
 
     {
         nri::DataSize dataChunk = {};
-        dataChunk.data = m_InstanceData.data();
-        dataChunk.size = m_InstanceData.size() * sizeof(InstanceData);
+        dataChunk.data = snapshot.instanceData.data();
+        dataChunk.size = snapshot.instanceData.size() * sizeof(InstanceData);
 
         nri::StreamBufferDataDesc streamBufferDataDesc = {};
         streamBufferDataDesc.dataChunks = &dataChunk;
@@ -3604,28 +6146,28 @@ void Sample::GatherInstanceData() {
 
     {
         nri::DataSize dataChunk = {};
-        dataChunk.data = m_WorldTlasData.data();
-        dataChunk.size = m_WorldTlasData.size() * sizeof(nri::TopLevelInstance);
+        dataChunk.data = snapshot.worldTlasData.data();
+        dataChunk.size = snapshot.worldTlasData.size() * sizeof(nri::TopLevelInstance);
 
         nri::StreamBufferDataDesc streamBufferDataDesc = {};
         streamBufferDataDesc.dataChunks = &dataChunk;
         streamBufferDataDesc.dataChunkNum = 1;
         streamBufferDataDesc.placementAlignment = deviceDesc.memoryAlignment.accelerationStructureOffset;
 
-        m_WorldTlasDataLocation = NRI.StreamBufferData(*m_Streamer, streamBufferDataDesc);
+        snapshot.worldTlasDataLocation = NRI.StreamBufferData(*m_Streamer, streamBufferDataDesc);
     }
 
     {
         nri::DataSize dataChunk = {};
-        dataChunk.data = m_LightTlasData.data();
-        dataChunk.size = m_LightTlasData.size() * sizeof(nri::TopLevelInstance);
+        dataChunk.data = snapshot.lightTlasData.data();
+        dataChunk.size = snapshot.lightTlasData.size() * sizeof(nri::TopLevelInstance);
 
         nri::StreamBufferDataDesc streamBufferDataDesc = {};
         streamBufferDataDesc.dataChunks = &dataChunk;
         streamBufferDataDesc.dataChunkNum = 1;
         streamBufferDataDesc.placementAlignment = deviceDesc.memoryAlignment.accelerationStructureOffset;
 
-        m_LightTlasDataLocation = NRI.StreamBufferData(*m_Streamer, streamBufferDataDesc);
+        snapshot.lightTlasDataLocation = NRI.StreamBufferData(*m_Streamer, streamBufferDataDesc);
     }
 }
 
@@ -3762,26 +6304,393 @@ void Sample::UpdateConstantBuffer(uint32_t frameIndex, uint32_t maxAccumulatedFr
         constants.gPSR = m_Settings.PSR;
         constants.gSHARC = m_Settings.SHARC;
         constants.gTrimLobe = m_Settings.specularLobeTrimming ? 1 : 0;
+        constants.gSharcCapacity = m_SharcCapacity;
+        constants.gSharcUpdatePeriod = 1 << m_SharcUpdateFraction;
         constants.gMinProbability = minProbability;
     }
 
     m_GlobalConstantBufferOffset = NRI.StreamConstantData(*m_Streamer, &constants, sizeof(constants));
 }
 
-uint32_t Sample::BuildOptimizedTransitions(const TextureState* states, uint32_t stateNum, std::array<nri::TextureBarrierDesc, MAX_TEXTURE_TRANSITIONS_NUM>& transitions) {
-    uint32_t n = 0;
+void Sample::BuildRenderGraph(bool isEven) {
+    uint32_t onScreen = m_Settings.onScreen + (NRD_MODE >= OCCLUSION ? SHOW_AMBIENT_OCCLUSION : 0); // preserve original mapping
+    bool isDenoisedOutputVisible = onScreen < SHOW_BASE_COLOR || onScreen == SHOW_MIP_SPECULAR;
+    bool isValidationVisible = m_ShowValidationOverlay && m_Settings.denoiser != DENOISER_REFERENCE && m_Settings.separator != 1.0f;
+
+    const Texture taaHistoryInput = isEven ? Texture::TaaHistoryPong : Texture::TaaHistoryPing;
+    const Texture taaHistoryOutput = isEven ? Texture::TaaHistoryPing : Texture::TaaHistoryPong;
+    const Texture prevRadiance = isEven ? Texture::Gradient_StoredPong : Texture::Gradient_StoredPing;
+    const Texture currRadiance = isEven ? Texture::Gradient_StoredPing : Texture::Gradient_StoredPong;
+
+    RenderGraph& graph = m_RenderGraph;
+    graph.Reset((uint32_t)Texture::BaseReadOnlyTexture, (uint32_t)Buffer::MAX_NUM);
+
+    // Resources
+    for (Texture texture : g_TransientTextures)
+        graph.SetTransient(GetResource(texture));
+
+    graph.SetPersistent(GetResource(Texture::ComposedDiff));
+    graph.SetPersistent(GetResource(Texture::ComposedSpec_ViewZ));
+    graph.SetPersistent(GetResource(Texture::Gradient_StoredPing));
+    graph.SetPersistent(GetResource(Texture::Gradient_StoredPong));
+    graph.SetPersistent(GetResource(Texture::TaaHistoryPing));
+    graph.SetPersistent(GetResource(Texture::TaaHistoryPong));
+    graph.SetPersistent(GetResource(Buffer::SharcHashEntries));
+    graph.SetPersistent(GetResource(Buffer::SharcAccumulated));
+    graph.SetPersistent(GetResource(Buffer::SharcResolved));
+    graph.SetPersistent(GetResource(Buffer::SharcActiveEntries));
+    graph.SetPersistent(GetResource(Buffer::SharcActiveArgs));
+
+    // SHARC and history confidence (optionally on the compute queue)
+    if (IsAsyncComputeEnabled())
+        graph.SetQueue(ASYNC_COMPUTE_QUEUE);
+
+    graph.AddPass((uint32_t)Pass::SharcUpdate, g_PassNames[(uint32_t)Pass::SharcUpdate]);
+    graph.Read(GetResource(prevRadiance));
+    graph.Write(GetResource(currRadiance));
+    graph.Write(GetResource(Texture::Gradient_Ping));
+    graph.Write(GetResource(Buffer::SharcHashEntries));
+    graph.Write(GetResource(Buffer::SharcAccumulated));
+    graph.Write(GetResource(Buffer::SharcResolved));
+    graph.Write(GetResource(Buffer::SharcActiveEntries));
+    graph.Write(GetResource(Buffer::SharcActiveArgs));
+
+    if (IsSharcTelemetryEnabled()) {
+        graph.AddPass((uint32_t)Pass::SharcStats, g_PassNames[(uint32_t)Pass::SharcStats], false, true);
+        graph.Read(GetResource(Buffer::SharcHashEntries), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+        graph.Read(GetResource(Buffer::SharcAccumulated), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+        graph.Read(GetResource(Buffer::SharcResolved), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+        graph.Write(GetResource(Buffer::SharcStats));
+    }
+
+    graph.AddPass((uint32_t)Pass::SharcResolve, g_PassNames[(uint32_t)Pass::SharcResolve]);
+    graph.Write(GetResource(Buffer::SharcHashEntries));
+    graph.Write(GetResource(Buffer::SharcAccumulated));
+    graph.Write(GetResource(Buffer::SharcResolved));
+    graph.Write(GetResource(Buffer::SharcActiveEntries));
+    graph.Write(GetResource(Buffer::SharcActiveArgs));
+    graph.Write(GetResource(Buffer::SharcResolveArgs), nri::AccessBits::COPY_DESTINATION); // filled from "SharcActiveArgs" in the pass
+
+    // History confidence
+    graph.AddPass((uint32_t)Pass::ConfidenceBlur, g_PassNames[(uint32_t)Pass::ConfidenceBlur]);
+    graph.Read(GetResource(Texture::Gradient_Ping));
+    graph.Write(GetResource(Texture::Gradient_Pong));
+
+    graph.SetQueue(0);
+
+    // Trace opaque
+    graph.AddPass((uint32_t)Pass::TraceOpaque, g_PassNames[(uint32_t)Pass::TraceOpaque]);
+    graph.Read(GetResource(Texture::ComposedDiff));
+    graph.Read(GetResource(Texture::ComposedSpec_ViewZ));
+    graph.Read(GetResource(Buffer::SharcHashEntries), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    graph.Read(GetResource(Buffer::SharcResolved), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    graph.Write(GetResource(Texture::Mv));
+    graph.Write(GetResource(Texture::ViewZ));
+    graph.Write(GetResource(Texture::Normal_Roughness));
+    graph.Write(GetResource(Texture::BaseColor_Metalness));
+    graph.Write(GetResource(Texture::DirectLighting));
+    graph.Write(GetResource(Texture::DirectEmission));
+    graph.Write(GetResource(Texture::PsrThroughput));
+    graph.Write(GetResource(Texture::Unfiltered_Penumbra));
+    graph.Write(GetResource(Texture::Unfiltered_Translucency));
+    graph.Write(GetResource(Texture::Unfiltered_Diff));
+    graph.Write(GetResource(Texture::Unfiltered_Spec));
+#if (NRD_MODE == SH)
+    graph.Write(GetResource(Texture::Unfiltered_DiffSh));
+    graph.Write(GetResource(Texture::Unfiltered_SpecSh));
+#endif
+
+    // Denoising (NRD manages barriers on its own)
+#if (NRD_MODE < OCCLUSION)
+    graph.AddPass((uint32_t)Pass::ShadowDenoising, g_PassNames[(uint32_t)Pass::ShadowDenoising], true);
+    graph.Read(GetResource(Texture::Mv));
+    graph.Read(GetResource(Texture::Normal_Roughness));
+    graph.Read(GetResource(Texture::ViewZ));
+    graph.Read(GetResource(Texture::Unfiltered_Penumbra));
+    graph.Read(GetResource(Texture::Unfiltered_Translucency));
+    graph.Write(GetResource(Texture::Shadow));
+    if (m_ShowValidationOverlay)
+        graph.Write(GetResource(Texture::Validation));
+#endif
+
+    graph.AddPass((uint32_t)Pass::OpaqueDenoising, g_PassNames[(uint32_t)Pass::OpaqueDenoising], true);
+    graph.Read(GetResource(Texture::Mv));
+    graph.Read(GetResource(Texture::Normal_Roughness));
+    graph.Read(GetResource(Texture::ViewZ));
+    graph.Read(GetResource(Texture::Unfiltered_Diff));
+    graph.Read(GetResource(Texture::Unfiltered_Spec));
+    graph.Read(GetResource(Texture::Gradient_Pong));
+    graph.Write(GetResource(Texture::Diff));
+    graph.Write(GetResource(Texture::Spec));
+#if (NRD_MODE == SH)
+    graph.Read(GetResource(Texture::Unfiltered_DiffSh));
+    graph.Read(GetResource(Texture::Unfiltered_SpecSh));
+    graph.Write(GetResource(Texture::DiffSh));
+    graph.Write(GetResource(Texture::SpecSh));
+#endif
+    if (m_ShowValidationOverlay)
+        graph.Write(GetResource(Texture::Validation));
+
+    // Composition (denoised signals are ignored in G-buffer debug views)
+    graph.AddPass((uint32_t)Pass::Composition, g_PassNames[(uint32_t)Pass::Composition]);
+    graph.Read(GetResource(Texture::ViewZ));
+    graph.Read(GetResource(Texture::Normal_Roughness));
+    graph.Read(GetResource(Texture::BaseColor_Metalness));
+    graph.Read(GetResource(Texture::DirectLighting));
+    graph.Read(GetResource(Texture::DirectEmission));
+    graph.Read(GetResource(Texture::PsrThroughput));
+    if (isDenoisedOutputVisible) {
+        graph.Read(GetResource(Texture::Shadow));
+        graph.Read(GetResource(Texture::Diff));
+        graph.Read(GetResource(Texture::Spec));
+#if (NRD_MODE == SH)
+        graph.Read(GetResource(Texture::DiffSh));
+        graph.Read(GetResource(Texture::SpecSh));
+#endif
+    } else {
+        graph.ReadWeak(GetResource(Texture::Shadow));
+        graph.ReadWeak(GetResource(Texture::Diff));
+        graph.ReadWeak(GetResource(Texture::Spec));
+#if (NRD_MODE == SH)
+        graph.ReadWeak(GetResource(Texture::DiffSh));
+        graph.ReadWeak(GetResource(Texture::SpecSh));
+#endif
+    }
+    graph.Write(GetResource(Texture::ComposedDiff));
+    graph.Write(GetResource(Texture::ComposedSpec_ViewZ));
+
+    // Trace transparent
+    graph.AddPass((uint32_t)Pass::TraceTransparent, g_PassNames[(uint32_t)Pass::TraceTransparent]);
+    graph.Read(GetResource(Texture::ComposedDiff));
+    graph.Read(GetResource(Texture::ComposedSpec_ViewZ));
+    graph.Read(GetResource(Buffer::SharcHashEntries), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    graph.Read(GetResource(Buffer::SharcResolved), nri::AccessBits::SHADER_RESOURCE_STORAGE);
+    graph.Write(GetResource(Texture::Composed));
+    graph.Write(GetResource(Texture::Mv));
+    graph.Write(GetResource(Texture::Normal_Roughness));
+
+    // Reference
+    if (m_Settings.denoiser == DENOISER_REFERENCE) {
+        graph.AddPass((uint32_t)Pass::ReferenceAccumulation, g_PassNames[(uint32_t)Pass::ReferenceAccumulation], true);
+        graph.Write(GetResource(Texture::Composed));
+    }
+
+    // Upscaling
+    if (IsDlssEnabled()) {
+        if (m_Settings.SR) {
+            graph.AddPass((uint32_t)Pass::DlssBefore, g_PassNames[(uint32_t)Pass::DlssBefore]);
+            graph.Read(GetResource(Texture::Normal_Roughness));
+            graph.Read(GetResource(Texture::BaseColor_Metalness));
+            graph.Read(GetResource(Texture::Unfiltered_Spec));
+            graph.Write(GetResource(Texture::ViewZ));
+            graph.Write(GetResource(Texture::RRGuide_DiffAlbedo));
+            graph.Write(GetResource(Texture::RRGuide_SpecAlbedo));
+            graph.Write(GetResource(Texture::RRGuide_SpecHitDistance));
+            graph.Write(GetResource(Texture::RRGuide_Normal_Roughness));
+        }
+
+        graph.AddPass((uint32_t)Pass::Dlss, g_PassNames[(uint32_t)Pass::Dlss]);
+        graph.Read(GetResource(Texture::ViewZ));
+        graph.Read(GetResource(Texture::Mv));
+        graph.Read(GetResource(Texture::Normal_Roughness));
+        graph.Read(GetResource(Texture::RRGuide_DiffAlbedo));
+        graph.Read(GetResource(Texture::RRGuide_SpecAlbedo));
+        graph.Read(GetResource(Texture::RRGuide_SpecHitDistance));
+        graph.Read(GetResource(Texture::RRGuide_Normal_Roughness));
+        graph.Read(GetResource(Texture::Composed));
+        graph.Write(GetResource(Texture::DlssOutput));
+
+        graph.AddPass((uint32_t)Pass::DlssAfter, g_PassNames[(uint32_t)Pass::DlssAfter]);
+        graph.Write(GetResource(Texture::DlssOutput));
+    } else {
+        graph.AddPass((uint32_t)Pass::Taa, g_PassNames[(uint32_t)Pass::Taa]);
+        graph.Read(GetResource(Texture::Mv));
+        graph.Read(GetResource(Texture::Composed));
+        graph.Read(GetResource(taaHistoryInput));
+        graph.Write(GetResource(taaHistoryOutput));
+    }
+
+    graph.AddPass((uint32_t)Pass::Nis, g_PassNames[(uint32_t)Pass::Nis]);
+    graph.Read(GetResource(IsDlssEnabled() ? Texture::DlssOutput : taaHistoryOutput));
+    graph.Write(GetResource(Texture::PreFinal));
+
+    // Final
+    graph.AddPass((uint32_t)Pass::Final, g_PassNames[(uint32_t)Pass::Final]);
+    graph.Read(GetResource(Texture::PreFinal));
+    graph.Read(GetResource(Texture::Composed));
+    if (isValidationVisible)
+        graph.Read(GetResource(Texture::Validation));
+    else
+        graph.ReadWeak(GetResource(Texture::Validation));
+    graph.Write(GetResource(Texture::Final));
+
+    graph.AddPass((uint32_t)Pass::CopyToBackBuffer, g_PassNames[(uint32_t)Pass::CopyToBackBuffer], true, true);
+    graph.Read(GetResource(Texture::Final), nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE);
+
+    graph.Compile(m_HoistBarriers);
+
+    // Denoisers resuming after being culled have outdated history
+    bool isDenoisingCulled = false;
+    for (const RenderGraphPass& pass : m_RenderGraph.GetPasses()) {
+        if (pass.id == (uint32_t)Pass::OpaqueDenoising)
+            isDenoisingCulled = pass.isCulled;
+    }
+
+    if (m_IsDenoisingCulled && !isDenoisingCulled)
+        m_ForceHistoryReset = true;
+    m_IsDenoisingCulled = isDenoisingCulled;
+
+    if (m_PrintRenderGraph) {
+        m_RenderGraph.Print();
+        printf("Barriers in the previous frame: %u (%u flushes)\n", m_BarrierNum, m_BarrierFlushNum);
+
+        m_PrintRenderGraph = false;
+    }
+}
+
+void Sample::PrepareStageContexts(const QueuedFrame& queuedFrame) {
+    // Current states
+    uint32_t textureNum = (uint32_t)Texture::BaseReadOnlyTexture;
+    m_SimulatedStates.resize(textureNum + (uint32_t)Buffer::MAX_NUM);
+
+    for (uint32_t i = 0; i < textureNum; i++)
+        m_SimulatedStates[i] = {m_TextureStates[i].after.access, m_TextureStates[i].after.layout};
+
+    for (uint32_t i = 0; i < (uint32_t)Buffer::MAX_NUM; i++)
+        m_SimulatedStates[textureNum + i] = {m_BufferStates[i], nri::Layout::UNDEFINED};
+
+    // Replay the graph up to the beginning of each stage
+    const std::vector<RenderGraphPass>& passes = m_RenderGraph.GetPasses();
+
+    uint32_t passBegin = 0;
+    for (uint32_t i = 0; i < (uint32_t)Stage::MAX_NUM; i++) {
+        uint32_t passEnd = passBegin;
+        while (passEnd < (uint32_t)passes.size() && (uint32_t)GetStage((Pass)passes[passEnd].id) < i)
+            passEnd++;
+
+        m_RenderGraph.Simulate(m_SimulatedStates.data(), passBegin, passEnd);
+        passBegin = passEnd;
+
+        StageContext& context = m_StageContexts[i];
+        context.textureStates = m_TextureStates;
+        context.commandBuffer = IsAsyncComputeEnabled() && IsAsyncComputeStage((Stage)i) ? queuedFrame.computeCommandBuffers[i] : queuedFrame.stageCommandBuffers[i];
+        context.externalPass = nullptr;
+        context.passCursor = passEnd;
+        context.barrierNum = 0;
+        context.barrierFlushNum = 0;
+
+        for (uint32_t j = 0; j < textureNum; j++) {
+            const RenderGraphState& state = m_SimulatedStates[j];
+            nri::TextureBarrierDesc& textureState = context.textureStates[j];
+
+            // "ALL" stages are needed, since the previous access can be in another command buffer
+            if (textureState.after.access != state.access || textureState.after.layout != state.layout)
+                textureState.after = {state.access, state.layout, nri::StageBits::ALL};
+        }
+
+        for (uint32_t j = 0; j < (uint32_t)Buffer::MAX_NUM; j++)
+            context.bufferStates[j] = m_SimulatedStates[textureNum + j].access;
+    }
+}
+
+bool Sample::BeginPass(StageContext& context, Pass pass) {
+    const RenderGraphPass* node = m_RenderGraph.Advance((uint32_t)pass, context.passCursor);
+    if (!node || node->isCulled)
+        return false;
+
+    context.externalPass = node->isExternal ? node : nullptr;
+
+    std::array<nri::TextureBarrierDesc, (size_t)Texture::BaseReadOnlyTexture> textureBarriers; // a texture can't be in a batch twice
+    std::array<nri::BufferBarrierDesc, (size_t)Buffer::MAX_NUM> bufferBarriers;
+
+    nri::BarrierDesc barrierDesc = {};
+    barrierDesc.textures = textureBarriers.data();
+    barrierDesc.buffers = bufferBarriers.data();
+
+    const RenderGraphBarrier* barriers = m_RenderGraph.GetBarriers(*node);
+    for (uint32_t i = 0; i < node->barrierNum; i++) {
+        const RenderGraphBarrier& barrier = barriers[i];
+
+        if (m_RenderGraph.IsBuffer(barrier.resource)) {
+            Buffer buffer = (Buffer)(barrier.resource - GetResource((Buffer)0));
+            nri::AccessBits& access = context.bufferStates[(uint32_t)buffer];
+
+            if (RenderGraph::IsBarrierNeeded({access, nri::Layout::UNDEFINED}, barrier, true)) {
+                bufferBarriers[barrierDesc.bufferNum++] = {Get(buffer), {access}, {barrier.state.access}};
+                access = barrier.state.access;
+            }
+        } else {
+            nri::TextureBarrierDesc& state = context.textureStates[barrier.resource];
+
+            if (RenderGraph::IsBarrierNeeded({state.after.access, state.after.layout}, barrier, false))
+                textureBarriers[barrierDesc.textureNum++] = TextureBarrierFromState(state, {barrier.state.access, barrier.state.layout});
+        }
+    }
+
+    if (barrierDesc.textureNum || barrierDesc.bufferNum) {
+        NRI.CmdBarrier(*context.commandBuffer, barrierDesc);
+
+        context.barrierFlushNum++;
+        context.barrierNum += barrierDesc.textureNum + barrierDesc.bufferNum;
+    }
+
+    return true;
+}
+
+void Sample::EndExternalPass(StageContext& context) {
+    // An external pass (NRD) leaves textures in whatever states it likes. Following stages have been recorded assuming declared states
+    const RenderGraphPass* node = context.externalPass;
+    if (!node)
+        return;
+
+    std::array<nri::TextureBarrierDesc, (size_t)Texture::BaseReadOnlyTexture> textureBarriers;
+
+    nri::BarrierDesc barrierDesc = {};
+    barrierDesc.textures = textureBarriers.data();
 
-    for (uint32_t i = 0; i < stateNum; i++) {
-        const TextureState& state = states[i];
-        nri::TextureBarrierDesc& transition = GetState(state.texture);
+    const RenderGraphAccess* accesses = m_RenderGraph.GetAccesses(*node);
+    for (uint32_t i = 0; i < node->accessNum; i++) {
+        const RenderGraphAccess& access = accesses[i];
+        if (m_RenderGraph.IsBuffer(access.resource))
+            continue;
+
+        nri::TextureBarrierDesc& state = context.textureStates[access.resource];
+        if (state.after.access != access.state.access || state.after.layout != access.state.layout)
+            textureBarriers[barrierDesc.textureNum++] = TextureBarrierFromState(state, {access.state.access, access.state.layout});
+    }
+
+    if (barrierDesc.textureNum) {
+        NRI.CmdBarrier(*context.commandBuffer, barrierDesc);
 
-        bool isStateChanged = transition.after.access != state.after.access || transition.after.layout != state.after.layout;
-        bool isStorageBarrier = transition.after.access == nri::AccessBits::SHADER_RESOURCE_STORAGE && state.after.access == nri::AccessBits::SHADER_RESOURCE_STORAGE;
-        if (isStateChanged || isStorageBarrier)
-            transitions[n++] = TextureBarrierFromState(transition, {state.after.access, state.after.layout});
+        context.barrierFlushNum++;
+        context.barrierNum += barrierDesc.textureNum;
     }
 
-    return n;
+    context.externalPass = nullptr;
+}
+
+void Sample::RecordingThread(Stage stage) {
+    uint64_t generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_RecordingMutex);
+            m_RecordingStart.wait(lock, [&] { return m_IsRecordingExitRequested || m_RecordingGeneration != generation; });
+
+            if (m_IsRecordingExitRequested)
+                return;
+
+            generation = m_RecordingGeneration;
+        }
+
+        RecordStage(stage);
+
+        {
+            std::lock_guard<std::mutex> lock(m_RecordingMutex);
+            m_RecordingPendingNum--;
+        }
+        m_RecordingFinish.notify_one();
+    }
 }
 
 void Sample::RestoreBindings(nri::CommandBuffer& commandBuffer) {
@@ -3811,18 +6720,14 @@ void Sample::RestoreBindings(nri::CommandBuffer& commandBuffer) {
     NRI.CmdSetRootDescriptor(commandBuffer, root4);
 }
 
-void Sample::RenderFrame(uint32_t frameIndex) {
-    nri::nriBeginAnnotation("Render frame", nri::BGRA_UNUSED);
+void Sample::RecordStage(Stage stage) {
+    StageContext& context = m_StageContexts[(uint32_t)stage];
+    nri::CommandBuffer& commandBuffer = *context.commandBuffer;
 
-    std::array<nri::TextureBarrierDesc, MAX_TEXTURE_TRANSITIONS_NUM> optimizedTransitions = {};
-
-    bool wantPrintf = IsButtonPressed(Button::Middle) || IsKeyToggled(Key::P);
+    const nrd::CommonSettings& commonSettings = m_CommonSettings;
+    uint32_t frameIndex = m_RecordedFrameIndex;
     bool isEven = !(frameIndex & 0x1);
 
-    uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
-    nri::CommandBuffer& commandBuffer = *queuedFrame.commandBuffer;
-
     // Sizes
     uint32_t rectW = uint32_t(m_RenderResolution.x * m_Settings.resolutionScale + 0.5f);
     uint32_t rectH = uint32_t(m_RenderResolution.y * m_Settings.resolutionScale + 0.5f);
@@ -3831,583 +6736,506 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     uint32_t outputGridW = (GetOutputResolution().x + 15) / 16;
     uint32_t outputGridH = (GetOutputResolution().y + 15) / 16;
 
-    // NRD common settings
-    nrd::CommonSettings commonSettings = {};
-    memcpy(commonSettings.viewToClipMatrix, &m_Camera.state.mViewToClip, sizeof(m_Camera.state.mViewToClip));
-    memcpy(commonSettings.viewToClipMatrixPrev, &m_Camera.statePrev.mViewToClip, sizeof(m_Camera.statePrev.mViewToClip));
-    memcpy(commonSettings.worldToViewMatrix, &m_Camera.state.mWorldToView, sizeof(m_Camera.state.mWorldToView));
-    memcpy(commonSettings.worldToViewMatrixPrev, &m_Camera.statePrev.mWorldToView, sizeof(m_Camera.statePrev.mWorldToView));
-    commonSettings.motionVectorScale[0] = 1.0f / float(rectW);
-    commonSettings.motionVectorScale[1] = 1.0f / float(rectH);
-    commonSettings.motionVectorScale[2] = m_Settings.mvType != MV_2D ? 1.0f : 0.0f;
-    commonSettings.cameraJitter[0] = m_Settings.cameraJitter ? m_Camera.state.viewportJitter.x : 0.0f;
-    commonSettings.cameraJitter[1] = m_Settings.cameraJitter ? m_Camera.state.viewportJitter.y : 0.0f;
-    commonSettings.cameraJitterPrev[0] = m_Settings.cameraJitter ? m_Camera.statePrev.viewportJitter.x : 0.0f;
-    commonSettings.cameraJitterPrev[1] = m_Settings.cameraJitter ? m_Camera.statePrev.viewportJitter.y : 0.0f;
-    commonSettings.resourceSize[0] = (uint16_t)m_RenderResolution.x;
-    commonSettings.resourceSize[1] = (uint16_t)m_RenderResolution.y;
-    commonSettings.resourceSizePrev[0] = (uint16_t)m_RenderResolution.x;
-    commonSettings.resourceSizePrev[1] = (uint16_t)m_RenderResolution.y;
-    commonSettings.rectSize[0] = (uint16_t)(m_RenderResolution.x * m_Settings.resolutionScale + 0.5f);
-    commonSettings.rectSize[1] = (uint16_t)(m_RenderResolution.y * m_Settings.resolutionScale + 0.5f);
-    commonSettings.rectSizePrev[0] = (uint16_t)(m_RenderResolution.x * m_SettingsPrev.resolutionScale + 0.5f);
-    commonSettings.rectSizePrev[1] = (uint16_t)(m_RenderResolution.y * m_SettingsPrev.resolutionScale + 0.5f);
-    commonSettings.viewZScale = 1.0f;
-    commonSettings.denoisingRange = GetDenoisingRange();
-    commonSettings.disocclusionThreshold = 0.01f;
-    commonSettings.disocclusionThresholdAlternate = 0.1f; // for hair
-    commonSettings.splitScreen = (m_Settings.denoiser == DENOISER_REFERENCE || m_Settings.RR || USE_SHARC_DEBUG != 0) ? 1.0f : m_Settings.separator;
-    commonSettings.printfAt[0] = wantPrintf ? (uint16_t)ImGui::GetIO().MousePos.x : 9999;
-    commonSettings.printfAt[1] = wantPrintf ? (uint16_t)ImGui::GetIO().MousePos.y : 9999;
-    commonSettings.debug = m_Settings.debug;
-    commonSettings.frameIndex = frameIndex;
-    commonSettings.accumulationMode = m_ForceHistoryReset ? nrd::AccumulationMode::CLEAR_AND_RESTART : nrd::AccumulationMode::CONTINUE;
-    commonSettings.isMotionVectorInWorldSpace = false;
-    commonSettings.isHistoryConfidenceAvailable = m_Settings.confidence;
-    commonSettings.enableValidation = m_ShowValidationOverlay;
+    NRI.BeginCommandBuffer(commandBuffer, nullptr);
 
-    const nrd::LibraryDesc& nrdLibraryDesc = *nrd::GetLibraryDesc();
-    if (nrdLibraryDesc.normalEncoding == nrd::NormalEncoding::R10_G10_B10_A2_UNORM) {
-        commonSettings.strandMaterialID = MATERIAL_ID_HAIR;
-        commonSettings.strandThickness = STRAND_THICKNESS * m_Settings.meterToUnitsMultiplier;
-#if (USE_CAMERA_ATTACHED_REFLECTION_TEST == 1)
-        commonSettings.cameraAttachedReflectionMaterialID = MATERIAL_ID_SELF_REFLECTION;
-#endif
-    }
+    if (stage == Stage::Acceleration) {
+        { // GPU start
+            uint32_t queryOffset = (frameIndex % GetQueuedFrameNum()) * (uint32_t)Timestamp::MAX_NUM;
 
-    m_NRD.NewFrame();
-    m_NRD.SetCommonSettings(commonSettings);
+            NRI.CmdResetQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, (uint32_t)Timestamp::MAX_NUM);
+            NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + (uint32_t)Timestamp::FrameBegin);
+        }
 
-    // RECORDING START
-    NRI.BeginCommandBuffer(commandBuffer, nullptr);
+        //======================================================================================================================================
+        // Resolution independent
+        //======================================================================================================================================
+
+        { // Copy upload requests to destinations
+            helper::Annotation annotation(NRI, commandBuffer, "Streamer");
+
+            { // Transitions
+                const nri::BufferBarrierDesc transitions[] = {
+                    {Get(Buffer::InstanceData), {nri::AccessBits::SHADER_RESOURCE}, {nri::AccessBits::COPY_DESTINATION}},
+                    {Get(Buffer::SharcAccumulated), {nri::AccessBits::NONE}, {nri::AccessBits::COPY_DESTINATION}},
+                    {Get(Buffer::SharcHashEntries), {nri::AccessBits::NONE}, {nri::AccessBits::COPY_DESTINATION}},
+                    {Get(Buffer::SharcStats), {nri::AccessBits::NONE}, {nri::AccessBits::COPY_DESTINATION}},
+                    {Get(Buffer::SharcActiveEntries), {nri::AccessBits::NONE}, {nri::AccessBits::COPY_DESTINATION}},
+                    {Get(Buffer::SharcActiveArgs), {nri::AccessBits::NONE}, {nri::AccessBits::COPY_DESTINATION}},
+                };
 
-    //======================================================================================================================================
-    // Resolution independent
-    //======================================================================================================================================
+                nri::BarrierDesc barrierDesc = {};
+                barrierDesc.buffers = transitions;
+                barrierDesc.bufferNum = frameIndex == m_SharcClearFrameIndex ? helper::GetCountOf(transitions) : 1;
 
-    { // Copy upload requests to destinations
-        helper::Annotation annotation(NRI, commandBuffer, "Streamer");
+                NRI.CmdBarrier(commandBuffer, barrierDesc);
+            }
 
-        { // Transitions
-            const nri::BufferBarrierDesc transitions[] = {
-                {Get(Buffer::InstanceData), {nri::AccessBits::SHADER_RESOURCE}, {nri::AccessBits::COPY_DESTINATION}},
-                {Get(Buffer::SharcAccumulated), {nri::AccessBits::NONE}, {nri::AccessBits::COPY_DESTINATION}},
-            };
+            NRI.CmdCopyStreamedData(commandBuffer, *m_Streamer);
+        }
 
-            nri::BarrierDesc barrierDesc = {};
-            barrierDesc.buffers = transitions;
-            barrierDesc.bufferNum = frameIndex == 0 ? 2 : 1;
+        { // TLAS and SHARC clear
+            helper::Annotation annotation(NRI, commandBuffer, "TLAS");
 
-            NRI.CmdBarrier(commandBuffer, barrierDesc);
+            const FrameSnapshot& snapshot = m_FrameSnapshots[m_FrameSnapshotIndex];
+
+            nri::BuildTopLevelAccelerationStructureDesc buildTopLevelAccelerationStructureDescs[2] = {};
+            {
+                buildTopLevelAccelerationStructureDescs[0].dst = Get(AccelerationStructure::TLAS_World);
+                buildTopLevelAccelerationStructureDescs[0].instanceNum = (uint32_t)snapshot.worldTlasData.size();
+                buildTopLevelAccelerationStructureDescs[0].instanceBuffer = m_WorldTlasDataLocation.buffer;
+                buildTopLevelAccelerationStructureDescs[0].instanceOffset = m_WorldTlasDataLocation.offset;
+                buildTopLevelAccelerationStructureDescs[0].scratchBuffer = Get(Buffer::WorldScratch);
+                buildTopLevelAccelerationStructureDescs[0].scratchOffset = 0;
+
+                buildTopLevelAccelerationStructureDescs[1].dst = Get(AccelerationStructure::TLAS_Emissive);
+                buildTopLevelAccelerationStructureDescs[1].instanceNum = (uint32_t)snapshot.lightTlasData.size();
+                buildTopLevelAccelerationStructureDescs[1].instanceBuffer = m_LightTlasDataLocation.buffer;
+                buildTopLevelAccelerationStructureDescs[1].instanceOffset = m_LightTlasDataLocation.offset;
+                buildTopLevelAccelerationStructureDescs[1].scratchBuffer = Get(Buffer::LightScratch);
+                buildTopLevelAccelerationStructureDescs[1].scratchOffset = 0;
+            }
+
+            NRI.CmdBuildTopLevelAccelerationStructures(commandBuffer, buildTopLevelAccelerationStructureDescs, helper::GetCountOf(buildTopLevelAccelerationStructureDescs));
+
+            if (frameIndex == m_SharcClearFrameIndex) {
+                NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcAccumulated), 0, nri::WHOLE_SIZE);
+                NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcHashEntries), 0, nri::WHOLE_SIZE);
+                NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcStats), 0, nri::WHOLE_SIZE);
+                NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcActiveEntries), 0, nri::WHOLE_SIZE);
+                NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcActiveArgs), 0, nri::WHOLE_SIZE);
+            }
+
+            { // Transitions
+                const nri::BufferBarrierDesc transitions[] = {
+                    {Get(Buffer::InstanceData), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE}},
+                    {Get(Buffer::SharcAccumulated), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
+                    {Get(Buffer::SharcHashEntries), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
+                    {Get(Buffer::SharcStats), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
+                    {Get(Buffer::SharcActiveEntries), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
+                    {Get(Buffer::SharcActiveArgs), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
+                };
+
+                nri::BarrierDesc barrierDesc = {};
+                barrierDesc.buffers = transitions;
+                barrierDesc.bufferNum = frameIndex == m_SharcClearFrameIndex ? helper::GetCountOf(transitions) : 1;
+
+                NRI.CmdBarrier(commandBuffer, barrierDesc);
+            }
         }
 
-        NRI.CmdCopyStreamedData(commandBuffer, *m_Streamer);
-    }
+    } else if (stage == Stage::Sharc) {
+        //======================================================================================================================================
+        // Render resolution
+        //======================================================================================================================================
+
+        RestoreBindings(commandBuffer);
 
-    { // TLAS and SHARC clear
-        helper::Annotation annotation(NRI, commandBuffer, "TLAS");
+        helper::Annotation sharc(NRI, commandBuffer, "SHARC");
 
-        nri::BuildTopLevelAccelerationStructureDesc buildTopLevelAccelerationStructureDescs[2] = {};
-        {
-            buildTopLevelAccelerationStructureDescs[0].dst = Get(AccelerationStructure::TLAS_World);
-            buildTopLevelAccelerationStructureDescs[0].instanceNum = (uint32_t)m_WorldTlasData.size();
-            buildTopLevelAccelerationStructureDescs[0].instanceBuffer = m_WorldTlasDataLocation.buffer;
-            buildTopLevelAccelerationStructureDescs[0].instanceOffset = m_WorldTlasDataLocation.offset;
-            buildTopLevelAccelerationStructureDescs[0].scratchBuffer = Get(Buffer::WorldScratch);
-            buildTopLevelAccelerationStructureDescs[0].scratchOffset = 0;
-
-            buildTopLevelAccelerationStructureDescs[1].dst = Get(AccelerationStructure::TLAS_Emissive);
-            buildTopLevelAccelerationStructureDescs[1].instanceNum = (uint32_t)m_LightTlasData.size();
-            buildTopLevelAccelerationStructureDescs[1].instanceBuffer = m_LightTlasDataLocation.buffer;
-            buildTopLevelAccelerationStructureDescs[1].instanceOffset = m_LightTlasDataLocation.offset;
-            buildTopLevelAccelerationStructureDescs[1].scratchBuffer = Get(Buffer::LightScratch);
-            buildTopLevelAccelerationStructureDescs[1].scratchOffset = 0;
+        if (BeginPass(context, Pass::SharcUpdate)) { // Update
+            helper::Annotation annotation(NRI, commandBuffer, "SHARC - Update");
+
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(isEven ? DescriptorSet::SharcUpdatePing : DescriptorSet::SharcUpdatePong)};
+            NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::SharcUpdate));
+            NRI.CmdDispatch(commandBuffer, {GetSharcDims().x / 16, GetSharcDims().y / 16, 1});
         }
 
-        NRI.CmdBuildTopLevelAccelerationStructures(commandBuffer, buildTopLevelAccelerationStructureDescs, helper::GetCountOf(buildTopLevelAccelerationStructureDescs));
+        if (BeginPass(context, Pass::SharcStats)) { // Telemetry
+            helper::Annotation annotation(NRI, commandBuffer, "SHARC - Stats");
 
-        if (frameIndex == 0)
-            NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcAccumulated), 0, nri::WHOLE_SIZE);
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::SharcStats));
+            NRI.CmdDispatch(commandBuffer, {(m_SharcCapacity + LINEAR_BLOCK_SIZE - 1) / LINEAR_BLOCK_SIZE, 1, 1});
 
-        { // Transitions
-            const nri::BufferBarrierDesc transitions[] = {
-                {Get(Buffer::InstanceData), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE}},
-                {Get(Buffer::SharcAccumulated), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
-            };
+            // Copy counters to the readback buffer and clear them for the next frame, leaving the buffer in the declared state
+            nri::BufferBarrierDesc bufferBarrier = {Get(Buffer::SharcStats), {nri::AccessBits::SHADER_RESOURCE_STORAGE}, {nri::AccessBits::COPY_SOURCE}};
 
             nri::BarrierDesc barrierDesc = {};
-            barrierDesc.buffers = transitions;
-            barrierDesc.bufferNum = frameIndex == 0 ? 2 : 1;
+            barrierDesc.buffers = &bufferBarrier;
+            barrierDesc.bufferNum = 1;
 
             NRI.CmdBarrier(commandBuffer, barrierDesc);
-        }
-    }
 
-    //======================================================================================================================================
-    // Render resolution
-    //======================================================================================================================================
+            uint64_t statsSize = SHARC_STAT_NUM * sizeof(uint32_t);
+            NRI.CmdCopyBuffer(commandBuffer, *m_SharcStatsReadbackBuffer, (frameIndex % GetQueuedFrameNum()) * statsSize, *Get(Buffer::SharcStats), 0, statsSize);
 
-    RestoreBindings(commandBuffer);
-
-    { // SHARC
-        helper::Annotation sharc(NRI, commandBuffer, "SHARC & History confidence");
+            bufferBarrier.before = bufferBarrier.after;
+            bufferBarrier.after = {nri::AccessBits::COPY_DESTINATION};
+            NRI.CmdBarrier(commandBuffer, barrierDesc);
 
-        const nri::BufferBarrierDesc bufferTransitions[] = {
-            {Get(Buffer::SharcHashEntries), {nri::AccessBits::SHADER_RESOURCE_STORAGE}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
-            {Get(Buffer::SharcAccumulated), {nri::AccessBits::SHADER_RESOURCE_STORAGE}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
-            {Get(Buffer::SharcResolved), {nri::AccessBits::SHADER_RESOURCE_STORAGE}, {nri::AccessBits::SHADER_RESOURCE_STORAGE}},
-        };
+            NRI.CmdZeroBuffer(commandBuffer, *Get(Buffer::SharcStats), 0, nri::WHOLE_SIZE);
 
-        nri::BarrierDesc bufferBarrierDesc = {};
-        bufferBarrierDesc.buffers = bufferTransitions;
-        bufferBarrierDesc.bufferNum = helper::GetCountOf(bufferTransitions);
+            bufferBarrier.before = bufferBarrier.after;
+            bufferBarrier.after = {nri::AccessBits::SHADER_RESOURCE_STORAGE};
+            NRI.CmdBarrier(commandBuffer, barrierDesc);
+        }
 
-        { // Update
-            helper::Annotation annotation(NRI, commandBuffer, "SHARC - Update");
+        if (BeginPass(context, Pass::SharcResolve)) { // Resolve
+            helper::Annotation annotation(NRI, commandBuffer, "SHARC - Resolve");
 
-            const Texture prevRadiance = isEven ? Texture::Gradient_StoredPong : Texture::Gradient_StoredPing;
-            const Texture currRadiance = isEven ? Texture::Gradient_StoredPing : Texture::Gradient_StoredPong;
-            const TextureState transitions[] = {
-                // Input
-                {prevRadiance, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                // Output
-                {currRadiance, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-                {Texture::Gradient_Ping, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
+            // Only the active list of this frame, i.e. the cost scales with visible content rather than with capacity
+            nri::BufferBarrierDesc bufferBarriers[] = {
+                {Get(Buffer::SharcActiveArgs), {nri::AccessBits::SHADER_RESOURCE_STORAGE}, {nri::AccessBits::COPY_SOURCE}},
+                {Get(Buffer::SharcResolveArgs), {nri::AccessBits::COPY_DESTINATION}, {nri::AccessBits::ARGUMENT_BUFFER}},
             };
 
             nri::BarrierDesc barrierDesc = {};
-            barrierDesc.textures = optimizedTransitions.data();
-            barrierDesc.textureNum = BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions);
-            NRI.CmdBarrier(commandBuffer, barrierDesc);
+            barrierDesc.buffers = bufferBarriers;
+            barrierDesc.bufferNum = 1;
 
-            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(isEven ? DescriptorSet::SharcUpdatePing : DescriptorSet::SharcUpdatePong)};
-            NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+            NRI.CmdBarrier(commandBuffer, barrierDesc);
 
-            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::SharcUpdate));
-            NRI.CmdDispatch(commandBuffer, {GetSharcDims().x / 16, GetSharcDims().y / 16, 1});
-            NRI.CmdBarrier(commandBuffer, bufferBarrierDesc);
-        }
+            uint64_t argsSize = SHARC_ACTIVE_ARGS_STRIDE * sizeof(uint32_t);
+            NRI.CmdCopyBuffer(commandBuffer, *Get(Buffer::SharcResolveArgs), 0, *Get(Buffer::SharcActiveArgs), isEven ? 0 : argsSize, argsSize);
 
-        { // Resolve
-            helper::Annotation annotation(NRI, commandBuffer, "SHARC - Resolve");
+            bufferBarriers[0].before = bufferBarriers[0].after;
+            bufferBarriers[0].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE};
+            barrierDesc.bufferNum = helper::GetCountOf(bufferBarriers);
+            NRI.CmdBarrier(commandBuffer, barrierDesc);
 
             NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::SharcResolve));
-            NRI.CmdDispatch(commandBuffer, {(SHARC_CAPACITY + LINEAR_BLOCK_SIZE - 1) / LINEAR_BLOCK_SIZE, 1, 1});
-            NRI.CmdBarrier(commandBuffer, bufferBarrierDesc);
-        }
-
-        { // History confidence
-            helper::Annotation annotation(NRI, commandBuffer, "History confidence - Blur");
+            NRI.CmdDispatchIndirect(commandBuffer, *Get(Buffer::SharcResolveArgs), 0);
 
-            // Blur
-            for (uint32_t i = 0; i < 5u; i++) { // must be odd
-                const TextureState transitions[] = {
-                    // Input
-                    {i % 2 == 0 ? Texture::Gradient_Ping : Texture::Gradient_Pong, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                    // Output
-                    {i % 2 == 0 ? Texture::Gradient_Pong : Texture::Gradient_Ping, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-                };
-
-                nri::BarrierDesc barrierDesc = {};
-                barrierDesc.textures = optimizedTransitions.data();
-                barrierDesc.textureNum = BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions);
-                NRI.CmdBarrier(commandBuffer, barrierDesc);
+            // Leave the arguments buffer in the declared state
+            bufferBarriers[1].before = bufferBarriers[1].after;
+            bufferBarriers[1].after = {nri::AccessBits::COPY_DESTINATION};
+            barrierDesc.buffers = &bufferBarriers[1];
+            barrierDesc.bufferNum = 1;
+            NRI.CmdBarrier(commandBuffer, barrierDesc);
+        }
+    } else if (stage == Stage::Confidence) {
+        RestoreBindings(commandBuffer);
 
-                nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(i % 2 == 0 ? DescriptorSet::ConfidenceBlurPing : DescriptorSet::ConfidenceBlurPong)};
-                NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+        helper::Annotation annotation(NRI, commandBuffer, "History confidence - Blur");
 
-                uint32_t step = 1 + i;
-                nri::SetRootConstantsDesc rootConstants = {0, &step, 4};
-                NRI.CmdSetRootConstants(commandBuffer, rootConstants);
+        // Blur (all steps in one dispatch)
+        if (BeginPass(context, Pass::ConfidenceBlur)) {
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::ConfidenceBlur)};
+            NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-                NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::ConfidenceBlur));
-                NRI.CmdDispatch(commandBuffer, {GetSharcDims().x / 16, GetSharcDims().y / 16, 1});
-            }
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::ConfidenceBlur));
+            NRI.CmdDispatch(commandBuffer, {GetSharcDims().x / 16, GetSharcDims().y / 16, 1});
         }
-    }
+    } else if (stage == Stage::Tracing) {
+        RestoreBindings(commandBuffer);
 
-    { // Trace opaque
-        helper::Annotation annotation(NRI, commandBuffer, "Trace opaque");
-
-        const TextureState transitions[] = {
-            // Input
-            {Texture::ComposedDiff, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::ComposedSpec_ViewZ, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            // Output
-            {Texture::Mv, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::ViewZ, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::BaseColor_Metalness, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::DirectLighting, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::DirectEmission, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::PsrThroughput, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Unfiltered_Penumbra, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Unfiltered_Translucency, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Unfiltered_Diff, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Unfiltered_Spec, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-#if (NRD_MODE == SH)
-            {Texture::Unfiltered_DiffSh, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Unfiltered_SpecSh, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-#endif
-        };
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+        if (BeginPass(context, Pass::TraceOpaque)) { // Trace opaque
+            helper::Annotation annotation(NRI, commandBuffer, "Trace opaque");
 
-        nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::TraceOpaque)};
-        NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::TraceOpaque)};
+            NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-        uint32_t rectWmod = uint32_t(m_RenderResolution.x * m_Settings.resolutionScale + 0.5f);
-        uint32_t rectHmod = uint32_t(m_RenderResolution.y * m_Settings.resolutionScale + 0.5f);
-        uint32_t rectGridWmod = (rectWmod + 15) / 16;
-        uint32_t rectGridHmod = (rectHmod + 15) / 16;
+            uint32_t rectWmod = uint32_t(m_RenderResolution.x * m_Settings.resolutionScale + 0.5f);
+            uint32_t rectHmod = uint32_t(m_RenderResolution.y * m_Settings.resolutionScale + 0.5f);
+            uint32_t rectGridWmod = (rectWmod + 15) / 16;
+            uint32_t rectGridHmod = (rectHmod + 15) / 16;
 
-        NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::TraceOpaque));
-        NRI.CmdDispatch(commandBuffer, {rectGridWmod, rectGridHmod, 1});
-    }
+            NRI.CmdSetPipeline(commandBuffer, *Get(GetTraceOpaquePipeline()));
+            NRI.CmdDispatch(commandBuffer, {rectGridWmod, rectGridHmod, 1});
+        }
+    } else if (stage == Stage::Denoising) {
+        uint32_t queryOffset = (frameIndex % GetQueuedFrameNum()) * (uint32_t)Timestamp::MAX_NUM;
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + (uint32_t)Timestamp::DenoisingBegin);
 
 #if (NRD_MODE < OCCLUSION)
-    { // Shadow denoising
-        helper::Annotation annotation(NRI, commandBuffer, "Shadow denoising");
+        if (BeginPass(context, Pass::ShadowDenoising)) { // Shadow denoising
+            helper::Annotation annotation(NRI, commandBuffer, "Shadow denoising");
 
-        float3 sunDir = GetSunDirection();
+            float3 sunDir = GetSunDirection();
 
-        m_SigmaSettings.lightDirection[0] = sunDir.x;
-        m_SigmaSettings.lightDirection[1] = sunDir.y;
-        m_SigmaSettings.lightDirection[2] = sunDir.z;
+            m_SigmaSettings.lightDirection[0] = sunDir.x;
+            m_SigmaSettings.lightDirection[1] = sunDir.y;
+            m_SigmaSettings.lightDirection[2] = sunDir.z;
 
-        nrd::Identifier denoiser = NRD_ID(SIGMA_SHADOW);
+            nrd::Identifier denoiser = NRD_ID(SIGMA_SHADOW);
 
-        m_NRD.SetDenoiserSettings(denoiser, &m_SigmaSettings);
+            m_NRD.SetDenoiserSettings(denoiser, &m_SigmaSettings);
 
-        Denoise(&denoiser, 1, commandBuffer);
-    }
+            Denoise(&denoiser, 1, context);
+        }
 #endif
 
-    { // Opaque denoising
-        helper::Annotation annotation(NRI, commandBuffer, "Opaque denoising");
+        if (BeginPass(context, Pass::OpaqueDenoising)) { // Opaque denoising
+            helper::Annotation annotation(NRI, commandBuffer, "Opaque denoising");
 
-        if (m_Settings.denoiser == DENOISER_REBLUR || m_Settings.denoiser == DENOISER_REFERENCE) {
-            nrd::ReblurHitDistanceParameters hitDistanceParameters = {};
-            hitDistanceParameters.A = m_Settings.hitDistScale * m_Settings.meterToUnitsMultiplier;
-            m_ReblurSettings.hitDistanceParameters = hitDistanceParameters;
+            if (m_Settings.denoiser == DENOISER_REBLUR || m_Settings.denoiser == DENOISER_REFERENCE) {
+                nrd::ReblurHitDistanceParameters hitDistanceParameters = {};
+                hitDistanceParameters.A = m_Settings.hitDistScale * m_Settings.meterToUnitsMultiplier;
+                m_ReblurSettings.hitDistanceParameters = hitDistanceParameters;
 
-            nrd::ReblurSettings settings = m_ReblurSettings;
+                nrd::ReblurSettings settings = m_ReblurSettings;
 #if (NRD_MODE == SH || NRD_MODE == DIRECTIONAL_OCCLUSION)
-            // High quality SG resolve allows to use more relaxed normal weights
-            if (m_Resolve)
-                settings.lobeAngleFraction *= 1.333f;
+                // High quality SG resolve allows to use more relaxed normal weights
+                if (m_Resolve)
+                    settings.lobeAngleFraction *= 1.333f;
 #endif
 
-#if (NRD_MODE == OCCLUSION)
-#    if (NRD_COMBINED == 1)
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE_SPECULAR_OCCLUSION)};
-#    else
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE_OCCLUSION), NRD_ID(REBLUR_SPECULAR_OCCLUSION)};
-#    endif
-#elif (NRD_MODE == SH)
-#    if (NRD_COMBINED == 1)
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE_SPECULAR_SH)};
-#    else
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE_SH), NRD_ID(REBLUR_SPECULAR_SH)};
-#    endif
-#elif (NRD_MODE == DIRECTIONAL_OCCLUSION)
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE_DIRECTIONAL_OCCLUSION)};
-#else
-#    if (NRD_COMBINED == 1)
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE_SPECULAR)};
-#    else
-            const nrd::Identifier denoisers[] = {NRD_ID(REBLUR_DIFFUSE), NRD_ID(REBLUR_SPECULAR)};
-#    endif
-#endif
+                nrd::Identifier denoisers[MAX_OPAQUE_DENOISER_NUM];
+                uint32_t denoiserNum = GetOpaqueDenoisers(DENOISER_REBLUR, denoisers);
 
-            for (uint32_t i = 0; i < helper::GetCountOf(denoisers); i++)
-                m_NRD.SetDenoiserSettings(denoisers[i], &settings);
+                for (uint32_t i = 0; i < denoiserNum; i++)
+                    m_NRD.SetDenoiserSettings(denoisers[i], &settings);
 
-            Denoise(denoisers, helper::GetCountOf(denoisers), commandBuffer);
-        } else if (m_Settings.denoiser == DENOISER_RELAX) {
-            nrd::RelaxSettings settings = m_RelaxSettings;
+                Denoise(denoisers, denoiserNum, context);
+            } else if (m_Settings.denoiser == DENOISER_RELAX) {
+                nrd::RelaxSettings settings = m_RelaxSettings;
 #if (NRD_MODE == SH || NRD_MODE == DIRECTIONAL_OCCLUSION)
-            // High quality SG resolve allows to use more relaxed normal weights
-            if (m_Resolve)
-                settings.lobeAngleFraction *= 1.333f;
+                // High quality SG resolve allows to use more relaxed normal weights
+                if (m_Resolve)
+                    settings.lobeAngleFraction *= 1.333f;
 #endif
 
-#if (NRD_COMBINED == 1)
-#    if (NRD_MODE == SH)
-            const nrd::Identifier denoisers[] = {NRD_ID(RELAX_DIFFUSE_SPECULAR_SH)};
-#    else
-            const nrd::Identifier denoisers[] = {NRD_ID(RELAX_DIFFUSE_SPECULAR)};
-#    endif
-#else
-#    if (NRD_MODE == SH)
-            const nrd::Identifier denoisers[] = {NRD_ID(RELAX_DIFFUSE_SH), NRD_ID(RELAX_SPECULAR_SH)};
-#    else
-            const nrd::Identifier denoisers[] = {NRD_ID(RELAX_DIFFUSE), NRD_ID(RELAX_SPECULAR)};
-#    endif
-#endif
+                nrd::Identifier denoisers[MAX_OPAQUE_DENOISER_NUM];
+                uint32_t denoiserNum = GetOpaqueDenoisers(DENOISER_RELAX, denoisers);
 
-            for (uint32_t i = 0; i < helper::GetCountOf(denoisers); i++)
-                m_NRD.SetDenoiserSettings(denoisers[i], &settings);
+                for (uint32_t i = 0; i < denoiserNum; i++)
+                    m_NRD.SetDenoiserSettings(denoisers[i], &settings);
 
-            Denoise(denoisers, helper::GetCountOf(denoisers), commandBuffer);
+                Denoise(denoisers, denoiserNum, context);
+            }
         }
-    }
 
-    RestoreBindings(commandBuffer);
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + (uint32_t)Timestamp::DenoisingEnd);
+    } else {
+        RestoreBindings(commandBuffer);
 
-    { // Composition
-        helper::Annotation annotation(NRI, commandBuffer, "Composition");
+        if (BeginPass(context, Pass::Composition)) { // Composition
+            helper::Annotation annotation(NRI, commandBuffer, "Composition");
 
-        const TextureState transitions[] = {
-            // Input
-            {Texture::ViewZ, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::BaseColor_Metalness, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::DirectLighting, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::DirectEmission, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::PsrThroughput, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Shadow, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Diff, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Spec, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-#if (NRD_MODE == SH)
-            {Texture::DiffSh, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::SpecSh, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-#endif
-            // Output
-            {Texture::ComposedDiff, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::ComposedSpec_ViewZ, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-        };
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::Composition)};
+            NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-        nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::Composition)};
-        NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::Composition));
+            NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
+        }
 
-        NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::Composition));
-        NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
-    }
+        if (BeginPass(context, Pass::TraceTransparent)) { // Trace transparent
+            helper::Annotation annotation(NRI, commandBuffer, "Trace transparent");
 
-    { // Trace transparent
-        helper::Annotation annotation(NRI, commandBuffer, "Trace transparent");
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::TraceTransparent)};
+            NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-        const TextureState transitions[] = {
-            // Input
-            {Texture::ComposedDiff, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::ComposedSpec_ViewZ, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            // Output
-            {Texture::Composed, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Mv, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            {Texture::Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-        };
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::TraceTransparent));
+            NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
+        }
 
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+        // Written even if the pass is culled, since queries are copied for all frames
+        uint32_t queryOffset = (frameIndex % GetQueuedFrameNum()) * (uint32_t)Timestamp::MAX_NUM;
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + (uint32_t)Timestamp::ReferenceBegin);
 
-        nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::TraceTransparent)};
-        NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+        if (BeginPass(context, Pass::ReferenceAccumulation)) { // Reference
+            helper::Annotation annotation(NRI, commandBuffer, "Reference accumulation");
 
-        NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::TraceTransparent));
-        NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
-    }
+            nrd::CommonSettings modifiedCommonSettings = commonSettings;
+            modifiedCommonSettings.splitScreen = m_Settings.separator;
 
-    if (m_Settings.denoiser == DENOISER_REFERENCE) { // Reference
-        helper::Annotation annotation(NRI, commandBuffer, "Reference accumulation");
+            nrd::Identifier denoiser = NRD_ID(REFERENCE);
 
-        nrd::CommonSettings modifiedCommonSettings = commonSettings;
-        modifiedCommonSettings.splitScreen = m_Settings.separator;
+            m_NRD.SetCommonSettings(modifiedCommonSettings);
+            m_NRD.SetDenoiserSettings(denoiser, &m_ReferenceSettings);
 
-        nrd::Identifier denoiser = NRD_ID(REFERENCE);
+            Denoise(&denoiser, 1, context);
 
-        m_NRD.SetCommonSettings(modifiedCommonSettings);
-        m_NRD.SetDenoiserSettings(denoiser, &m_ReferenceSettings);
+            RestoreBindings(commandBuffer);
+        }
 
-        Denoise(&denoiser, 1, commandBuffer);
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + (uint32_t)Timestamp::ReferenceEnd);
 
-        RestoreBindings(commandBuffer);
-    }
+        //======================================================================================================================================
+        // Output resolution
+        //======================================================================================================================================
 
-    //======================================================================================================================================
-    // Output resolution
-    //======================================================================================================================================
+        const Texture taaHistoryOutput = isEven ? Texture::TaaHistoryPing : Texture::TaaHistoryPong;
 
-    const Texture taaHistoryInput = isEven ? Texture::TaaHistoryPong : Texture::TaaHistoryPing;
-    const Texture taaHistoryOutput = isEven ? Texture::TaaHistoryPing : Texture::TaaHistoryPong;
+        if (IsDlssEnabled()) {
+            // Before DLSS
+            if (BeginPass(context, Pass::DlssBefore)) {
+                helper::Annotation annotation(NRI, commandBuffer, "Before DLSS");
 
-    if (IsDlssEnabled()) {
-        // Before DLSS
-        if (m_Settings.SR) {
-            helper::Annotation annotation(NRI, commandBuffer, "Before DLSS");
-
-            const TextureState transitions[] = {
-                // Input
-                {Texture::Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::BaseColor_Metalness, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::Unfiltered_Spec, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                // Output
-                {Texture::ViewZ, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-                {Texture::RRGuide_DiffAlbedo, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-                {Texture::RRGuide_SpecAlbedo, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-                {Texture::RRGuide_SpecHitDistance, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-                {Texture::RRGuide_Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            };
-            nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-            NRI.CmdBarrier(commandBuffer, transitionBarriers);
+                nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::DlssBefore)};
+                NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::DlssBefore)};
+                NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::DlssBefore));
+                NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
+            }
+
+            if (BeginPass(context, Pass::Dlss)) { // DLSS
+                helper::Annotation annotation(NRI, commandBuffer, "DLSS");
+
+                bool resetHistory = m_ForceHistoryReset || m_Settings.SR != m_SettingsPrev.SR || m_Settings.RR != m_SettingsPrev.RR;
+
+                nri::DispatchUpscaleDesc dispatchUpscaleDesc = {};
+                dispatchUpscaleDesc.output = {Get(Texture::DlssOutput), GetStorageDescriptor(Texture::DlssOutput)};
+                dispatchUpscaleDesc.input = {Get(Texture::Composed), GetDescriptor(Texture::Composed)};
+                dispatchUpscaleDesc.currentResolution = {(nri::Dim_t)rectW, (nri::Dim_t)rectH};
+                dispatchUpscaleDesc.cameraJitter = {-m_Camera.state.viewportJitter.x, -m_Camera.state.viewportJitter.y};
+                dispatchUpscaleDesc.mvScale = {1.0f, 1.0f};
+                dispatchUpscaleDesc.flags = resetHistory ? nri::DispatchUpscaleBits::RESET_HISTORY : nri::DispatchUpscaleBits::NONE;
+
+                if (m_Settings.RR) {
+                    dispatchUpscaleDesc.guides.denoiser.mv = {Get(Texture::Mv), GetDescriptor(Texture::Mv)};
+                    dispatchUpscaleDesc.guides.denoiser.depth = {Get(Texture::ViewZ), GetDescriptor(Texture::ViewZ)};
+                    dispatchUpscaleDesc.guides.denoiser.diffuseAlbedo = {Get(Texture::RRGuide_DiffAlbedo), GetDescriptor(Texture::RRGuide_DiffAlbedo)};
+                    dispatchUpscaleDesc.guides.denoiser.specularAlbedo = {Get(Texture::RRGuide_SpecAlbedo), GetDescriptor(Texture::RRGuide_SpecAlbedo)};
+                    dispatchUpscaleDesc.guides.denoiser.normalRoughness = {Get(Texture::RRGuide_Normal_Roughness), GetDescriptor(Texture::RRGuide_Normal_Roughness)};
+                    dispatchUpscaleDesc.guides.denoiser.specularMvOrHitT = {Get(Texture::RRGuide_SpecHitDistance), GetDescriptor(Texture::RRGuide_SpecHitDistance)};
+
+                    memcpy(&dispatchUpscaleDesc.settings.dlrr.worldToViewMatrix, &m_Camera.state.mWorldToView, sizeof(m_Camera.state.mWorldToView));
+                    memcpy(&dispatchUpscaleDesc.settings.dlrr.viewToClipMatrix, &m_Camera.state.mViewToClip, sizeof(m_Camera.state.mViewToClip));
+
+                    NRI.CmdDispatchUpscale(commandBuffer, *m_DLRR, dispatchUpscaleDesc);
+                } else {
+                    dispatchUpscaleDesc.guides.upscaler.mv = {Get(Texture::Mv), GetDescriptor(Texture::Mv)};
+                    dispatchUpscaleDesc.guides.upscaler.depth = {Get(Texture::ViewZ), GetDescriptor(Texture::ViewZ)};
+
+                    if (m_DLSR && upscalerType == nri::UpscalerType::FSR) // workaround for "conditional expression is constant"
+                    {
+                        dispatchUpscaleDesc.settings.fsr.zNear = 0.1f;
+                        dispatchUpscaleDesc.settings.fsr.verticalFov = radians(m_Settings.camFov);
+                        dispatchUpscaleDesc.settings.fsr.frameTime = m_Timer.GetSmoothedFrameTime();
+                        dispatchUpscaleDesc.settings.fsr.viewSpaceToMetersFactor = 1.0f;
+                        dispatchUpscaleDesc.settings.fsr.sharpness = 0.0f;
+                    }
+
+                    NRI.CmdDispatchUpscale(commandBuffer, *m_DLSR, dispatchUpscaleDesc);
+                }
+
+                RestoreBindings(commandBuffer);
+            }
+
+            if (BeginPass(context, Pass::DlssAfter)) { // After DLSS
+                helper::Annotation annotation(NRI, commandBuffer, "After Dlss");
+
+                nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::DlssAfter)};
+                NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+
+                NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::DlssAfter));
+                NRI.CmdDispatch(commandBuffer, {outputGridW, outputGridH, 1});
+            }
+        } else if (BeginPass(context, Pass::Taa)) { // TAA
+            helper::Annotation annotation(NRI, commandBuffer, "TAA");
+
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(isEven ? DescriptorSet::TaaPing : DescriptorSet::TaaPong)};
             NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::DlssBefore));
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::Taa));
             NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
         }
 
-        { // DLSS
-            helper::Annotation annotation(NRI, commandBuffer, "DLSS");
-
-            const TextureState transitions[] = {
-                // Input
-                {Texture::ViewZ, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::Mv, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::RRGuide_DiffAlbedo, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::RRGuide_SpecAlbedo, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::RRGuide_SpecHitDistance, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::RRGuide_Normal_Roughness, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                {Texture::Composed, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-                // Output
-                {Texture::DlssOutput, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            };
-            nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-            NRI.CmdBarrier(commandBuffer, transitionBarriers);
-
-            bool resetHistory = m_ForceHistoryReset || m_Settings.SR != m_SettingsPrev.SR || m_Settings.RR != m_SettingsPrev.RR;
+        if (BeginPass(context, Pass::Nis)) { // NIS
+            helper::Annotation annotation(NRI, commandBuffer, "NIS");
 
             nri::DispatchUpscaleDesc dispatchUpscaleDesc = {};
-            dispatchUpscaleDesc.output = {Get(Texture::DlssOutput), GetStorageDescriptor(Texture::DlssOutput)};
-            dispatchUpscaleDesc.input = {Get(Texture::Composed), GetDescriptor(Texture::Composed)};
-            dispatchUpscaleDesc.currentResolution = {(nri::Dim_t)rectW, (nri::Dim_t)rectH};
-            dispatchUpscaleDesc.cameraJitter = {-m_Camera.state.viewportJitter.x, -m_Camera.state.viewportJitter.y};
-            dispatchUpscaleDesc.mvScale = {1.0f, 1.0f};
-            dispatchUpscaleDesc.flags = resetHistory ? nri::DispatchUpscaleBits::RESET_HISTORY : nri::DispatchUpscaleBits::NONE;
-
-            if (m_Settings.RR) {
-                dispatchUpscaleDesc.guides.denoiser.mv = {Get(Texture::Mv), GetDescriptor(Texture::Mv)};
-                dispatchUpscaleDesc.guides.denoiser.depth = {Get(Texture::ViewZ), GetDescriptor(Texture::ViewZ)};
-                dispatchUpscaleDesc.guides.denoiser.diffuseAlbedo = {Get(Texture::RRGuide_DiffAlbedo), GetDescriptor(Texture::RRGuide_DiffAlbedo)};
-                dispatchUpscaleDesc.guides.denoiser.specularAlbedo = {Get(Texture::RRGuide_SpecAlbedo), GetDescriptor(Texture::RRGuide_SpecAlbedo)};
-                dispatchUpscaleDesc.guides.denoiser.normalRoughness = {Get(Texture::RRGuide_Normal_Roughness), GetDescriptor(Texture::RRGuide_Normal_Roughness)};
-                dispatchUpscaleDesc.guides.denoiser.specularMvOrHitT = {Get(Texture::RRGuide_SpecHitDistance), GetDescriptor(Texture::RRGuide_SpecHitDistance)};
-
-                memcpy(&dispatchUpscaleDesc.settings.dlrr.worldToViewMatrix, &m_Camera.state.mWorldToView, sizeof(m_Camera.state.mWorldToView));
-                memcpy(&dispatchUpscaleDesc.settings.dlrr.viewToClipMatrix, &m_Camera.state.mViewToClip, sizeof(m_Camera.state.mViewToClip));
-
-                NRI.CmdDispatchUpscale(commandBuffer, *m_DLRR, dispatchUpscaleDesc);
-            } else {
-                dispatchUpscaleDesc.guides.upscaler.mv = {Get(Texture::Mv), GetDescriptor(Texture::Mv)};
-                dispatchUpscaleDesc.guides.upscaler.depth = {Get(Texture::ViewZ), GetDescriptor(Texture::ViewZ)};
-
-                if (m_DLSR && upscalerType == nri::UpscalerType::FSR) // workaround for "conditional expression is constant"
-                {
-                    dispatchUpscaleDesc.settings.fsr.zNear = 0.1f;
-                    dispatchUpscaleDesc.settings.fsr.verticalFov = radians(m_Settings.camFov);
-                    dispatchUpscaleDesc.settings.fsr.frameTime = m_Timer.GetSmoothedFrameTime();
-                    dispatchUpscaleDesc.settings.fsr.viewSpaceToMetersFactor = 1.0f;
-                    dispatchUpscaleDesc.settings.fsr.sharpness = 0.0f;
-                }
+            dispatchUpscaleDesc.settings.nis.sharpness = NIS_SHARPNESS;
+            dispatchUpscaleDesc.output = {Get(Texture::PreFinal), GetStorageDescriptor(Texture::PreFinal)};
 
-                NRI.CmdDispatchUpscale(commandBuffer, *m_DLSR, dispatchUpscaleDesc);
+            if (IsDlssEnabled()) {
+                dispatchUpscaleDesc.input = {Get(Texture::DlssOutput), GetDescriptor(Texture::DlssOutput)};
+                dispatchUpscaleDesc.currentResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
+            } else {
+                dispatchUpscaleDesc.input = {Get(taaHistoryOutput), GetDescriptor(isEven ? Texture::TaaHistoryPing : Texture::TaaHistoryPong)};
+                dispatchUpscaleDesc.currentResolution = {(nri::Dim_t)rectW, (nri::Dim_t)rectH};
             }
 
+            NRI.CmdDispatchUpscale(commandBuffer, *m_NIS[m_SdrScale > 1.0f ? 1 : 0], dispatchUpscaleDesc);
+
             RestoreBindings(commandBuffer);
         }
 
-        { // After DLSS
-            helper::Annotation annotation(NRI, commandBuffer, "After Dlss");
-
-            const TextureState transitions[] = {
-                // Output
-                {Texture::DlssOutput, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-            };
-            nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-            NRI.CmdBarrier(commandBuffer, transitionBarriers);
+        if (BeginPass(context, Pass::Final)) { // Final
+            helper::Annotation annotation(NRI, commandBuffer, "Final");
 
-            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::DlssAfter)};
+            nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::Final)};
             NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::DlssAfter));
+            NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::Final));
             NRI.CmdDispatch(commandBuffer, {outputGridW, outputGridH, 1});
         }
-    } else { // TAA
-        helper::Annotation annotation(NRI, commandBuffer, "TAA");
-
-        const TextureState transitions[] = {
-            // Input
-            {Texture::Mv, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Composed, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {taaHistoryInput, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            // Output
-            {taaHistoryOutput, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-        };
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
-
-        nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(isEven ? DescriptorSet::TaaPing : DescriptorSet::TaaPong)};
-        NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
 
-        NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::Taa));
-        NRI.CmdDispatch(commandBuffer, {rectGridW, rectGridH, 1});
-    }
+        const SwapChainTexture& swapChainTexture = m_SwapChainTextures[m_SwapChainTextureIndex];
 
-    { // NIS
-        helper::Annotation annotation(NRI, commandBuffer, "NIS");
+        if (BeginPass(context, Pass::CopyToBackBuffer)) { // Copy to back-buffer
+            helper::Annotation annotation(NRI, commandBuffer, "Copy to back buffer");
 
-        const TextureState transitions[] = {
-            // Input
-            {IsDlssEnabled() ? Texture::DlssOutput : taaHistoryOutput, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            // Output
-            {Texture::PreFinal, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-        };
+            const nri::TextureBarrierDesc transitions[] = {
+                TextureBarrierFromState(context.textureStates[(uint32_t)Texture::Final], {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE}),
+                TextureBarrierFromUnknown(swapChainTexture.texture, {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION}),
+            };
+            nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, transitions, (uint16_t)helper::GetCountOf(transitions)};
+            NRI.CmdBarrier(commandBuffer, transitionBarriers);
 
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+            NRI.CmdCopyTexture(commandBuffer, *swapChainTexture.texture, nullptr, *Get(Texture::Final), nullptr);
+        }
+    }
 
-        nri::DispatchUpscaleDesc dispatchUpscaleDesc = {};
-        dispatchUpscaleDesc.settings.nis.sharpness = NIS_SHARPNESS;
-        dispatchUpscaleDesc.output = {Get(Texture::PreFinal), GetStorageDescriptor(Texture::PreFinal)};
+    NRI.EndCommandBuffer(commandBuffer);
+}
 
-        if (IsDlssEnabled()) {
-            dispatchUpscaleDesc.input = {Get(Texture::DlssOutput), GetDescriptor(Texture::DlssOutput)};
-            dispatchUpscaleDesc.currentResolution = {(nri::Dim_t)GetOutputResolution().x, (nri::Dim_t)GetOutputResolution().y};
-        } else {
-            dispatchUpscaleDesc.input = {Get(taaHistoryOutput), GetDescriptor(isEven ? Texture::TaaHistoryPing : Texture::TaaHistoryPong)};
-            dispatchUpscaleDesc.currentResolution = {(nri::Dim_t)rectW, (nri::Dim_t)rectH};
-        }
+void Sample::RenderFrame(uint32_t frameIndex) {
+    nri::nriBeginAnnotation("Render frame", nri::BGRA_UNUSED);
 
-        NRI.CmdDispatchUpscale(commandBuffer, *m_NIS[m_SdrScale > 1.0f ? 1 : 0], dispatchUpscaleDesc);
+    bool wantPrintf = IsButtonPressed(Button::Middle) || IsKeyToggled(Key::P);
+    bool isEven = !(frameIndex & 0x1);
 
-        RestoreBindings(commandBuffer);
-    }
+    // Declare passes and resolve ping-pong resources, must be done before "m_ForceHistoryReset" usage
+    BuildRenderGraph(isEven);
 
-    { // Final
-        helper::Annotation annotation(NRI, commandBuffer, "Final");
+    uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
+    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
 
-        const TextureState transitions[] = {
-            // Input
-            {Texture::PreFinal, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Composed, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            {Texture::Validation, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE}},
-            // Output
-            {Texture::Final, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE}},
-        };
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, optimizedTransitions.data(), BuildOptimizedTransitions(transitions, helper::GetCountOf(transitions), optimizedTransitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+    // Sizes
+    uint32_t rectW = uint32_t(m_RenderResolution.x * m_Settings.resolutionScale + 0.5f);
+    uint32_t rectH = uint32_t(m_RenderResolution.y * m_Settings.resolutionScale + 0.5f);
 
-        nri::SetDescriptorSetDesc otherSet = {SET_OTHER, Get(DescriptorSet::Final)};
-        NRI.CmdSetDescriptorSet(commandBuffer, otherSet);
+    // NRD common settings
+    nrd::CommonSettings& commonSettings = m_CommonSettings;
+    commonSettings = {};
+    memcpy(commonSettings.viewToClipMatrix, &m_Camera.state.mViewToClip, sizeof(m_Camera.state.mViewToClip));
+    memcpy(commonSettings.viewToClipMatrixPrev, &m_Camera.statePrev.mViewToClip, sizeof(m_Camera.statePrev.mViewToClip));
+    memcpy(commonSettings.worldToViewMatrix, &m_Camera.state.mWorldToView, sizeof(m_Camera.state.mWorldToView));
+    memcpy(commonSettings.worldToViewMatrixPrev, &m_Camera.statePrev.mWorldToView, sizeof(m_Camera.statePrev.mWorldToView));
+    commonSettings.motionVectorScale[0] = 1.0f / float(rectW);
+    commonSettings.motionVectorScale[1] = 1.0f / float(rectH);
+    commonSettings.motionVectorScale[2] = m_Settings.mvType != MV_2D ? 1.0f : 0.0f;
+    commonSettings.cameraJitter[0] = m_Settings.cameraJitter ? m_Camera.state.viewportJitter.x : 0.0f;
+    commonSettings.cameraJitter[1] = m_Settings.cameraJitter ? m_Camera.state.viewportJitter.y : 0.0f;
+    commonSettings.cameraJitterPrev[0] = m_Settings.cameraJitter ? m_Camera.statePrev.viewportJitter.x : 0.0f;
+    commonSettings.cameraJitterPrev[1] = m_Settings.cameraJitter ? m_Camera.statePrev.viewportJitter.y : 0.0f;
+    commonSettings.resourceSize[0] = (uint16_t)m_RenderResolution.x;
+    commonSettings.resourceSize[1] = (uint16_t)m_RenderResolution.y;
+    commonSettings.resourceSizePrev[0] = (uint16_t)m_RenderResolution.x;
+    commonSettings.resourceSizePrev[1] = (uint16_t)m_RenderResolution.y;
+    commonSettings.rectSize[0] = (uint16_t)(m_RenderResolution.x * m_Settings.resolutionScale + 0.5f);
+    commonSettings.rectSize[1] = (uint16_t)(m_RenderResolution.y * m_Settings.resolutionScale + 0.5f);
+    commonSettings.rectSizePrev[0] = (uint16_t)(m_RenderResolution.x * m_SettingsPrev.resolutionScale + 0.5f);
+    commonSettings.rectSizePrev[1] = (uint16_t)(m_RenderResolution.y * m_SettingsPrev.resolutionScale + 0.5f);
+    commonSettings.viewZScale = 1.0f;
+    commonSettings.denoisingRange = GetDenoisingRange();
+    commonSettings.disocclusionThreshold = 0.01f;
+    commonSettings.disocclusionThresholdAlternate = 0.1f; // for hair
+    commonSettings.splitScreen = (m_Settings.denoiser == DENOISER_REFERENCE || m_Settings.RR || USE_SHARC_DEBUG != 0) ? 1.0f : m_Settings.separator;
+    commonSettings.printfAt[0] = wantPrintf ? (uint16_t)ImGui::GetIO().MousePos.x : 9999;
+    commonSettings.printfAt[1] = wantPrintf ? (uint16_t)ImGui::GetIO().MousePos.y : 9999;
+    commonSettings.debug = m_Settings.debug;
+    commonSettings.frameIndex = frameIndex;
+    commonSettings.accumulationMode = m_ForceHistoryReset ? nrd::AccumulationMode::CLEAR_AND_RESTART : nrd::AccumulationMode::CONTINUE;
+    commonSettings.isMotionVectorInWorldSpace = false;
+    commonSettings.isHistoryConfidenceAvailable = m_Settings.confidence;
+    commonSettings.enableValidation = m_ShowValidationOverlay;
 
-        NRI.CmdSetPipeline(commandBuffer, *Get(Pipeline::Final));
-        NRI.CmdDispatch(commandBuffer, {outputGridW, outputGridH, 1});
+    const nrd::LibraryDesc& nrdLibraryDesc = *nrd::GetLibraryDesc();
+    if (nrdLibraryDesc.normalEncoding == nrd::NormalEncoding::R10_G10_B10_A2_UNORM) {
+        commonSettings.strandMaterialID = MATERIAL_ID_HAIR;
+        commonSettings.strandThickness = STRAND_THICKNESS * m_Settings.meterToUnitsMultiplier;
+#if (USE_CAMERA_ATTACHED_REFLECTION_TEST == 1)
+        commonSettings.cameraAttachedReflectionMaterialID = MATERIAL_ID_SELF_REFLECTION;
+#endif
     }
 
+    m_NRD.NewFrame();
+    m_NRD.SetCommonSettings(commonSettings);
+
     // Acquire a swap chain texture
     uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
     nri::Fence* swapChainAcquireSemaphore = m_SwapChainTextures[recycledSemaphoreIndex].acquireSemaphore;
@@ -4417,21 +7245,62 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     if (result == nri::Result::OUT_OF_DATE)
         printf("Oops, unhandled out of date!\n");
 
+    m_SwapChainTextureIndex = currentSwapChainTextureIndex;
     const SwapChainTexture& swapChainTexture = m_SwapChainTextures[currentSwapChainTextureIndex];
 
-    { // Copy to back-buffer
-        helper::Annotation annotation(NRI, commandBuffer, "Copy to back buffer");
+    // Transient textures: discard previous content. The first transition acts as an aliasing barrier,
+    // "ALL" stages guarantee that work on textures previously occupying the same memory is finished
+    for (Texture texture : g_TransientTextures)
+        GetState(texture).after = {nri::AccessBits::NONE, nri::Layout::UNDEFINED, nri::StageBits::ALL};
 
-        const nri::TextureBarrierDesc transitions[] = {
-            TextureBarrierFromState(GetState(Texture::Final), {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE}),
-            TextureBarrierFromUnknown(swapChainTexture.texture, {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION}),
-        };
-        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, transitions, (uint16_t)helper::GetCountOf(transitions)};
-        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+    // SHARC accumulation, hash, stats and active list buffers are left in "storage" state by "TLAS" (where they get cleared on the first frame and after recreation)
+    m_BufferStates[(uint32_t)Buffer::SharcAccumulated] = nri::AccessBits::SHADER_RESOURCE_STORAGE;
+    m_BufferStates[(uint32_t)Buffer::SharcHashEntries] = nri::AccessBits::SHADER_RESOURCE_STORAGE;
+    m_BufferStates[(uint32_t)Buffer::SharcStats] = nri::AccessBits::SHADER_RESOURCE_STORAGE;
+    m_BufferStates[(uint32_t)Buffer::SharcActiveEntries] = nri::AccessBits::SHADER_RESOURCE_STORAGE;
+    m_BufferStates[(uint32_t)Buffer::SharcActiveArgs] = nri::AccessBits::SHADER_RESOURCE_STORAGE;
+
+    // Telemetry counters of this frame are read back when the queued frame is recycled
+    m_IsSharcStatsPending[queuedFrameIndex] = IsSharcTelemetryEnabled();
+
+    // RECORDING START
+    PrepareStageContexts(queuedFrame);
+    m_RecordedFrameIndex = frameIndex;
+
+    // NRD integration is not thread safe, "Reference accumulation" uses it in "Post"
+    if (m_MultithreadedRecording && m_Settings.denoiser != DENOISER_REFERENCE) {
+        {
+            std::lock_guard<std::mutex> lock(m_RecordingMutex);
+            m_RecordingPendingNum = (uint32_t)m_RecordingThreads.size();
+            m_RecordingGeneration++;
+        }
+        m_RecordingStart.notify_all();
 
-        NRI.CmdCopyTexture(commandBuffer, *swapChainTexture.texture, nullptr, *Get(Texture::Final), nullptr);
+        RecordStage(Stage::Acceleration);
+
+        std::unique_lock<std::mutex> lock(m_RecordingMutex);
+        m_RecordingFinish.wait(lock, [&] { return m_RecordingPendingNum == 0; });
+    } else {
+        for (uint32_t i = 0; i < (uint32_t)Stage::MAX_NUM; i++)
+            RecordStage((Stage)i);
+    }
+
+    // The last stage knows final states
+    const StageContext& lastContext = m_StageContexts.back();
+    m_TextureStates = lastContext.textureStates;
+    m_BufferStates = lastContext.bufferStates;
+
+    m_BarrierNum = 0;
+    m_BarrierFlushNum = 0;
+    for (const StageContext& context : m_StageContexts) {
+        m_BarrierNum += context.barrierNum;
+        m_BarrierFlushNum += context.barrierFlushNum;
     }
 
+    // UI (uses the streamer, thus recorded after stages)
+    nri::CommandBuffer& commandBuffer = *queuedFrame.commandBuffer;
+    NRI.BeginCommandBuffer(commandBuffer, nullptr);
+
     { // UI
         nri::TextureBarrierDesc before = {};
         before.texture = swapChainTexture.texture;
@@ -4461,9 +7330,42 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.CmdBarrier(commandBuffer, transitionBarriers);
     }
 
-    // RECORDING END
+    // Tuner readback ("CopyToBackBuffer" is the last pass, thus "Final" is already in "COPY_SOURCE")
+    if (m_TunerReadbackFrameIndex == frameIndex) {
+        const nri::TextureDesc& textureDesc = NRI.GetTextureDesc(*Get(Texture::Final));
+
+        const nri::TextureBarrierDesc transition = TextureBarrierFromState(m_TextureStates[(uint32_t)Texture::Final], {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE});
+        nri::BarrierDesc transitionBarriers = {nullptr, 0, nullptr, 0, &transition, 1};
+        NRI.CmdBarrier(commandBuffer, transitionBarriers);
+
+        nri::TextureRegionDesc srcRegion = {};
+        srcRegion.width = textureDesc.width;
+        srcRegion.height = textureDesc.height;
+        srcRegion.depth = 1;
+
+        nri::TextureDataLayoutDesc dstDataLayout = {};
+        dstDataLayout.rowPitch = m_TunerReadbackRowPitch;
+        dstDataLayout.slicePitch = m_TunerReadbackRowPitch * textureDesc.height;
+
+        NRI.CmdReadbackTextureToBuffer(commandBuffer, *m_TunerReadbackBuffer, dstDataLayout, *Get(Texture::Final), srcRegion);
+    }
+
+    { // GPU end
+        uint32_t queryOffset = queuedFrameIndex * (uint32_t)Timestamp::MAX_NUM;
+
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + (uint32_t)Timestamp::FrameEnd);
+        NRI.CmdCopyQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, (uint32_t)Timestamp::MAX_NUM, *m_TimestampReadbackBuffer, queryOffset * sizeof(uint64_t));
+    }
+
     NRI.EndCommandBuffer(commandBuffer);
 
+    // RECORDING END
+
+    LatencyMarkers& latencyMarkers = m_LatencyMarkers[queuedFrameIndex];
+    latencyMarkers.input = m_FrameSnapshots[m_FrameSnapshotIndex].inputTimeStamp;
+    latencyMarkers.submit = m_Timer.GetTimeStamp();
+    latencyMarkers.resolutionScale = m_Settings.resolutionScale;
+
     { // Submit
         nri::FenceSubmitDesc frameFence = {};
         frameFence.fence = m_FrameFence;
@@ -4478,11 +7380,77 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
         nri::FenceSubmitDesc signalFences[] = {renderingFinishedFence, frameFence};
 
+        nri::FenceSubmitDesc waitFences[2] = {textureAcquiredFence};
+        uint32_t waitFenceNum = 1;
+
+        std::array<nri::CommandBuffer*, (size_t)Stage::MAX_NUM + 1> commandBuffers;
+        uint32_t commandBufferNum = 0;
+
+        if (IsAsyncComputeEnabled()) {
+            // TLAS -> SHARC (compute) -> trace opaque
+            //      -> history confidence (compute) -> denoising and the rest
+            nri::FenceSubmitDesc tlasBuilt = {};
+            tlasBuilt.fence = m_AsyncComputeFence;
+            tlasBuilt.value = ++m_AsyncComputeFenceValue;
+
+            nri::FenceSubmitDesc sharcFinished = {};
+            sharcFinished.fence = m_AsyncComputeFence;
+            sharcFinished.value = ++m_AsyncComputeFenceValue;
+
+            nri::FenceSubmitDesc confidenceFinished = {};
+            confidenceFinished.fence = m_AsyncComputeFence;
+            confidenceFinished.value = ++m_AsyncComputeFenceValue;
+
+            nri::QueueSubmitDesc queueSubmitDesc = {};
+            queueSubmitDesc.commandBuffers = &queuedFrame.stageCommandBuffers[(uint32_t)Stage::Acceleration];
+            queueSubmitDesc.commandBufferNum = 1;
+            queueSubmitDesc.signalFences = &tlasBuilt;
+            queueSubmitDesc.signalFenceNum = 1;
+
+            NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
+
+            queueSubmitDesc = {};
+            queueSubmitDesc.waitFences = &tlasBuilt;
+            queueSubmitDesc.waitFenceNum = 1;
+            queueSubmitDesc.commandBuffers = &queuedFrame.computeCommandBuffers[(uint32_t)Stage::Sharc];
+            queueSubmitDesc.commandBufferNum = 1;
+            queueSubmitDesc.signalFences = &sharcFinished;
+            queueSubmitDesc.signalFenceNum = 1;
+
+            NRI.QueueSubmit(*m_ComputeQueue, queueSubmitDesc);
+
+            queueSubmitDesc = {};
+            queueSubmitDesc.commandBuffers = &queuedFrame.computeCommandBuffers[(uint32_t)Stage::Confidence];
+            queueSubmitDesc.commandBufferNum = 1;
+            queueSubmitDesc.signalFences = &confidenceFinished;
+            queueSubmitDesc.signalFenceNum = 1;
+
+            NRI.QueueSubmit(*m_ComputeQueue, queueSubmitDesc);
+
+            queueSubmitDesc = {};
+            queueSubmitDesc.waitFences = &sharcFinished;
+            queueSubmitDesc.waitFenceNum = 1;
+            queueSubmitDesc.commandBuffers = &queuedFrame.stageCommandBuffers[(uint32_t)Stage::Tracing];
+            queueSubmitDesc.commandBufferNum = 1;
+
+            NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
+
+            waitFences[waitFenceNum++] = confidenceFinished;
+
+            for (uint32_t i = (uint32_t)Stage::Denoising; i < (uint32_t)Stage::MAX_NUM; i++)
+                commandBuffers[commandBufferNum++] = queuedFrame.stageCommandBuffers[i];
+        } else {
+            for (uint32_t i = 0; i < (uint32_t)Stage::MAX_NUM; i++)
+                commandBuffers[commandBufferNum++] = queuedFrame.stageCommandBuffers[i];
+        }
+
+        commandBuffers[commandBufferNum++] = queuedFrame.commandBuffer;
+
         nri::QueueSubmitDesc queueSubmitDesc = {};
-        queueSubmitDesc.waitFences = &textureAcquiredFence;
-        queueSubmitDesc.waitFenceNum = 1;
-        queueSubmitDesc.commandBuffers = &queuedFrame.commandBuffer;
-        queueSubmitDesc.commandBufferNum = 1;
+        queueSubmitDesc.waitFences = waitFences;
+        queueSubmitDesc.waitFenceNum = waitFenceNum;
+        queueSubmitDesc.commandBuffers = commandBuffers.data();
+        queueSubmitDesc.commandBufferNum = commandBufferNum;
         queueSubmitDesc.signalFences = signalFences;
         queueSubmitDesc.signalFenceNum = helper::GetCountOf(signalFences);
 
@@ -4500,16 +7468,65 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     }
     nri::nriEndAnnotation();
 
+    latencyMarkers.present = m_Timer.GetTimeStamp();
+    latencyMarkers.isValid = true;
+
     // Cap FPS if requested
     nri::nriBeginAnnotation("FPS cap", nri::BGRA_UNUSED);
 
-    float msLimit = m_Settings.limitFps ? 1000.0f / m_Settings.maxFps : 0.0f;
-    double lastFrameTimeStamp = m_Timer.GetLastFrameTimeStamp();
+    if (m_Settings.limitFps)
+        PaceFrame();
+    else
+        m_PacingTargetTimeStamp = 0.0;
+
+    nri::nriEndAnnotation();
+}
+
+void Sample::WaitUntil(double timeStamp) {
+    // Sleep most of the time, spin the rest. The spinning part covers the worst recent sleep overshoot (OS timer granularity, scheduling)
+    double spinThreshold = std::max(m_SleepOvershoot * 1.5, PACING_SPIN_THRESHOLD);
+    double sleepStart = m_Timer.GetTimeStamp();
+    double remaining = timeStamp - sleepStart;
+
+    if (remaining > spinThreshold) {
+        double sleepTime = remaining - spinThreshold;
+        std::this_thread::sleep_for(std::chrono::microseconds(int64_t(sleepTime * 1000.0)));
+
+        // Fast attack, slow decay
+        double overshoot = m_Timer.GetTimeStamp() - sleepStart - sleepTime;
+        m_SleepOvershoot = overshoot > m_SleepOvershoot ? overshoot : m_SleepOvershoot + (overshoot - m_SleepOvershoot) * 0.01;
+    }
 
-    while (m_Timer.GetTimeStamp() - lastFrameTimeStamp < msLimit)
+    while (m_Timer.GetTimeStamp() < timeStamp)
         ;
+}
 
-    nri::nriEndAnnotation();
+void Sample::PaceFrame() {
+    double period = 1000.0 / m_Settings.maxFps;
+    double timeStamp = m_Timer.GetTimeStamp();
+
+    // Targets are spaced by exactly one period (no accumulated drift). A late frame restarts the schedule instead of
+    // catching up with short frames, which would look like jitter to temporal accumulation
+    double target = m_PacingTargetTimeStamp + period;
+    if (m_PacingTargetTimeStamp == 0.0 || target < timeStamp)
+        m_PacingTargetTimeStamp = timeStamp;
+    else {
+        WaitUntil(target);
+        m_PacingTargetTimeStamp = target;
+    }
+
+    // Pacing error: wake up overshoot or lateness
+    float error = m_PacingSampleNum == 0 ? 0.0f : float(m_Timer.GetTimeStamp() - target);
+    m_PacingErrors[m_PacingSampleNum++ % TIMING_HISTORY_SIZE] = error;
 }
 
+// "SAMPLE_MAIN" treats any "Initialize" stop as a failure, thus runs, which intentionally don't render, report their status via "g_ExitCode"
+#define main SampleMain
 SAMPLE_MAIN(Sample, 0);
+#undef main
+
+int main(int argc, char** argv) {
+    int result = SampleMain(argc, argv);
+
+    return g_ExitCode == -1 ? result : g_ExitCode;
+}
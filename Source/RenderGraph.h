@@ -0,0 +1,315 @@
+// © 2022 NVIDIA Corporation
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "NRI.h"
+
+// A tiny frame graph. Passes declare which resources they read and write (and in which state), "Compile" culls
+// passes not contributing to the frame and computes per-pass barrier batches. A barrier is hoisted to the earliest
+// legal point, i.e. into the batch of the pass following the previous access, so it gets merged with other barriers
+// instead of draining the pipeline right before the consumer. Resources are plain indices and the graph doesn't talk
+// to the device, so graphs can be built and validated on the CPU ("Simulate" replays the schedule against given states).
+// Usage per frame: Reset -> AddPass / Read / Write ... -> Compile -> Advance (for each executed pass). After "Compile"
+// the graph is read-only, i.e. can be used by several recording threads, each with its own cursor. Passes can be assigned
+// to different queues ("SetQueue"), barriers are never hoisted across a queue boundary (synchronization is up to the caller)
+
+struct RenderGraphState {
+    nri::AccessBits access;
+    nri::Layout layout;
+};
+
+struct RenderGraphAccess {
+    uint32_t resource;
+    RenderGraphState state;
+    bool isWrite;
+    bool isWeak;
+};
+
+struct RenderGraphBarrier {
+    uint32_t resource;
+    RenderGraphState state;
+    uint32_t consumer;    // pass index, which requires this state
+    bool isStorageHazard; // the previous access is a write (or unknown) or this access is a write, i.e. "storage -> storage" needs a barrier
+};
+
+struct RenderGraphTransition {
+    uint32_t pass; // pass index, in front of which the transition is executed
+    uint32_t resource;
+    RenderGraphState before;
+    RenderGraphState after;
+};
+
+struct RenderGraphPass {
+    const char* name;
+    uint32_t id;
+    uint32_t accessOffset;
+    uint32_t accessNum;
+    uint32_t barrierOffset;
+    uint32_t barrierNum;
+    uint32_t queue;
+    bool isExternal;     // barriers are managed by the pass itself (NRD), declared accesses only affect culling and merging
+    bool hasSideEffects; // never culled
+    bool isCulled;
+};
+
+class RenderGraph {
+public:
+    static inline bool IsBarrierNeeded(const RenderGraphState& current, const RenderGraphBarrier& barrier, bool ignoreLayout) {
+        bool isStateChanged = current.access != barrier.state.access || (!ignoreLayout && current.layout != barrier.state.layout);
+        bool isStorageBarrier = current.access == nri::AccessBits::SHADER_RESOURCE_STORAGE && barrier.state.access == nri::AccessBits::SHADER_RESOURCE_STORAGE;
+
+        return isStateChanged || (isStorageBarrier && barrier.isStorageHazard);
+    }
+
+    // Resources are "[0; textureNum)" textures, followed by "bufferNum" buffers. Memory is reused across frames
+    inline void Reset(uint32_t textureNum, uint32_t bufferNum) {
+        m_TextureNum = textureNum;
+        m_Queue = 0;
+        m_Passes.clear();
+        m_Accesses.clear();
+        m_Barriers.clear();
+        m_Resources.assign(textureNum + bufferNum, {});
+    }
+
+    inline bool IsBuffer(uint32_t resource) const {
+        return resource >= m_TextureNum;
+    }
+
+    // Content is fully overwritten before the first use (can be aliased), the first barrier can't be moved
+    inline void SetTransient(uint32_t resource) {
+        m_Resources[resource].isTransient = true;
+    }
+
+    // Content is consumed outside of the graph (next frame, presentation), writers are never culled
+    inline void SetPersistent(uint32_t resource) {
+        m_Resources[resource].isPersistent = true;
+    }
+
+    // Following passes are executed on the given queue (an index meaningful for the caller)
+    inline void SetQueue(uint32_t queue) {
+        m_Queue = queue;
+    }
+
+    inline void AddPass(uint32_t id, const char* name, bool isExternal = false, bool hasSideEffects = false) {
+        RenderGraphPass pass = {};
+        pass.name = name;
+        pass.id = id;
+        pass.accessOffset = (uint32_t)m_Accesses.size();
+        pass.queue = m_Queue;
+        pass.isExternal = isExternal;
+        pass.hasSideEffects = hasSideEffects;
+
+        m_Passes.push_back(pass);
+    }
+
+    // IMPORTANT: one access per resource per pass, "read & write" is a "write"
+    inline void Read(uint32_t resource, nri::AccessBits access = nri::AccessBits::SHADER_RESOURCE, nri::Layout layout = nri::Layout::SHADER_RESOURCE) {
+        m_Accesses.push_back({resource, {access, layout}, false, false});
+        m_Passes.back().accessNum++;
+    }
+
+    // The resource is bound and must be in a valid state, but its content is ignored in the current mode (writers can be culled)
+    inline void ReadWeak(uint32_t resource, nri::AccessBits access = nri::AccessBits::SHADER_RESOURCE, nri::Layout layout = nri::Layout::SHADER_RESOURCE) {
+        m_Accesses.push_back({resource, {access, layout}, false, true});
+        m_Passes.back().accessNum++;
+    }
+
+    inline void Write(uint32_t resource, nri::AccessBits access = nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout layout = nri::Layout::SHADER_RESOURCE_STORAGE) {
+        m_Accesses.push_back({resource, {access, layout}, true, false});
+        m_Passes.back().accessNum++;
+    }
+
+    // "hoistBarriers = false" emits barriers right before consumers (for comparison)
+    void Compile(bool hoistBarriers = true);
+
+    // Returns the next pass with the given ID (in declaration order) or "nullptr". Skipped passes must be culled
+    inline const RenderGraphPass* Advance(uint32_t id, uint32_t& cursor) const {
+        for (uint32_t i = cursor; i < (uint32_t)m_Passes.size(); i++) {
+            if (m_Passes[i].id == id) {
+                cursor = i + 1;
+                return &m_Passes[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    inline const RenderGraphAccess* GetAccesses(const RenderGraphPass& pass) const {
+        return m_Accesses.data() + pass.accessOffset;
+    }
+
+    inline const RenderGraphBarrier* GetBarriers(const RenderGraphPass& pass) const {
+        return m_Barriers.data() + pass.barrierOffset;
+    }
+
+    inline const std::vector<RenderGraphPass>& GetPasses() const {
+        return m_Passes;
+    }
+
+    // Replays the compiled schedule for passes "[passBegin; passEnd)", "states" (one per resource) are in/out. External passes
+    // are assumed to leave resources in declared states. Emitted transitions are appended to "transitions", if provided
+    void Simulate(RenderGraphState* states, uint32_t passBegin, uint32_t passEnd, std::vector<RenderGraphTransition>* transitions = nullptr) const;
+
+    void Print() const;
+
+private:
+    struct Resource {
+        uint32_t lastAlivePass; // index in "m_AlivePasses"
+        bool isTransient;
+        bool isPersistent;
+        bool isAccessed;
+        bool isLastAccessWrite;
+        bool isNeeded;
+    };
+
+    std::vector<RenderGraphPass> m_Passes;
+    std::vector<RenderGraphAccess> m_Accesses;
+    std::vector<RenderGraphBarrier> m_Barriers;
+    std::vector<RenderGraphBarrier> m_PendingBarriers;
+    std::vector<uint32_t> m_PendingTargets;
+    std::vector<uint32_t> m_AlivePasses;
+    std::vector<Resource> m_Resources;
+    uint32_t m_TextureNum = 0;
+    uint32_t m_Queue = 0;
+};
+
+inline void RenderGraph::Compile(bool hoistBarriers) {
+    // Culling: walk backwards, a pass is alive if it has side effects or writes something needed later. Writes can be partial,
+    // thus all resources touched by an alive pass become needed
+    for (size_t i = m_Passes.size(); i > 0; i--) {
+        RenderGraphPass& pass = m_Passes[i - 1];
+        const RenderGraphAccess* accesses = m_Accesses.data() + pass.accessOffset;
+
+        bool isAlive = pass.hasSideEffects;
+        for (uint32_t j = 0; j < pass.accessNum && !isAlive; j++) {
+            const Resource& resource = m_Resources[accesses[j].resource];
+            if (accesses[j].isWrite && (resource.isNeeded || resource.isPersistent))
+                isAlive = true;
+        }
+
+        pass.isCulled = !isAlive;
+        if (isAlive) {
+            for (uint32_t j = 0; j < pass.accessNum; j++) {
+                if (!accesses[j].isWeak)
+                    m_Resources[accesses[j].resource].isNeeded = true;
+            }
+        }
+    }
+
+    // Barriers: a requested state goes to the batch of the first alive pass after the previous access. Exception: the first access
+    // of a transient resource, since a barrier can't be moved above passes using memory aliased with this resource
+    m_PendingBarriers.clear();
+    m_PendingTargets.clear();
+    m_AlivePasses.clear();
+
+    for (uint32_t i = 0; i < (uint32_t)m_Passes.size(); i++) {
+        RenderGraphPass& pass = m_Passes[i];
+        if (pass.isCulled)
+            continue;
+
+        uint32_t alivePass = (uint32_t)m_AlivePasses.size();
+        m_AlivePasses.push_back(i);
+
+        const RenderGraphAccess* accesses = m_Accesses.data() + pass.accessOffset;
+        for (uint32_t j = 0; j < pass.accessNum; j++) {
+            const RenderGraphAccess& access = accesses[j];
+            Resource& resource = m_Resources[access.resource];
+
+            if (!pass.isExternal) {
+                // Read-after-write and write-after-read/write are hazards, only read-after-read is not
+                bool isStorageHazard = !resource.isAccessed || resource.isLastAccessWrite || access.isWrite;
+                RenderGraphBarrier barrier = {access.resource, access.state, i, isStorageHazard};
+
+                uint32_t target = alivePass;
+                if (hoistBarriers) {
+                    if (resource.isAccessed)
+                        target = resource.lastAlivePass + 1;
+                    else if (!resource.isTransient)
+                        target = 0;
+
+                    // Stay on the queue of the consumer
+                    while (m_Passes[m_AlivePasses[target]].queue != pass.queue)
+                        target++;
+                }
+
+                m_PendingBarriers.push_back(barrier);
+                m_PendingTargets.push_back(m_AlivePasses[target]);
+            }
+
+            resource.lastAlivePass = alivePass;
+            resource.isAccessed = true;
+            resource.isLastAccessWrite = access.isWrite;
+        }
+    }
+
+    // Group by target pass, preserving the declaration order inside a batch
+    m_Barriers.resize(m_PendingBarriers.size());
+
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < (uint32_t)m_Passes.size(); i++) {
+        RenderGraphPass& pass = m_Passes[i];
+        pass.barrierOffset = offset;
+        pass.barrierNum = 0;
+
+        for (size_t j = 0; j < m_PendingBarriers.size(); j++) {
+            if (m_PendingTargets[j] == i)
+                m_Barriers[offset + pass.barrierNum++] = m_PendingBarriers[j];
+        }
+
+        offset += pass.barrierNum;
+    }
+}
+
+inline void RenderGraph::Simulate(RenderGraphState* states, uint32_t passBegin, uint32_t passEnd, std::vector<RenderGraphTransition>* transitions) const {
+    passEnd = passEnd < (uint32_t)m_Passes.size() ? passEnd : (uint32_t)m_Passes.size();
+
+    for (uint32_t i = passBegin; i < passEnd; i++) {
+        const RenderGraphPass& pass = m_Passes[i];
+        if (pass.isCulled)
+            continue;
+
+        const RenderGraphBarrier* barriers = GetBarriers(pass);
+        for (uint32_t j = 0; j < pass.barrierNum; j++) {
+            const RenderGraphBarrier& barrier = barriers[j];
+            RenderGraphState& state = states[barrier.resource];
+
+            if (IsBarrierNeeded(state, barrier, IsBuffer(barrier.resource))) {
+                if (transitions)
+                    transitions->push_back({i, barrier.resource, state, barrier.state});
+
+                state = barrier.state;
+            }
+        }
+
+        if (pass.isExternal) {
+            const RenderGraphAccess* accesses = m_Accesses.data() + pass.accessOffset;
+            for (uint32_t j = 0; j < pass.accessNum; j++)
+                states[accesses[j].resource] = accesses[j].state;
+        }
+    }
+}
+
+inline void RenderGraph::Print() const {
+    printf("Render graph: %u passes\n", (uint32_t)m_Passes.size());
+
+    for (uint32_t i = 0; i < (uint32_t)m_Passes.size(); i++) {
+        const RenderGraphPass& pass = m_Passes[i];
+        if (pass.isCulled) {
+            printf("  %2u %-24s culled\n", i, pass.name);
+            continue;
+        }
+
+        printf("  %2u %-24s queue = %u, accesses = %2u, barriers = %2u%s", i, pass.name, pass.queue, pass.accessNum, pass.barrierNum, pass.isExternal ? " (external)" : "");
+
+        const RenderGraphBarrier* barriers = GetBarriers(pass);
+        for (uint32_t j = 0; j < pass.barrierNum; j++) {
+            if (barriers[j].consumer != i)
+                printf(" [%u for %u]", barriers[j].resource, barriers[j].consumer);
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,269 @@
+// © 2022 NVIDIA Corporation
+
+// CPU tests for "RenderGraph": small graphs are compiled and emitted barriers, hoisting, culling and simulated transitions are checked
+
+#include "RenderGraph.h"
+
+static uint32_t g_FailedNum = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s(%d): FAILED '%s'\n", __FILE__, __LINE__, #condition); \
+            g_FailedNum++; \
+        } \
+    } while (0)
+
+constexpr nri::AccessBits SR = nri::AccessBits::SHADER_RESOURCE;
+constexpr nri::AccessBits STORAGE = nri::AccessBits::SHADER_RESOURCE_STORAGE;
+constexpr nri::Layout SR_LAYOUT = nri::Layout::SHADER_RESOURCE;
+constexpr nri::Layout STORAGE_LAYOUT = nri::Layout::SHADER_RESOURCE_STORAGE;
+
+// Returns the barrier for "resource" in the batch of "pass" or "nullptr"
+static const RenderGraphBarrier* FindBarrier(const RenderGraph& graph, uint32_t pass, uint32_t resource) {
+    const RenderGraphPass& node = graph.GetPasses()[pass];
+    const RenderGraphBarrier* barriers = graph.GetBarriers(node);
+
+    for (uint32_t i = 0; i < node.barrierNum; i++) {
+        if (barriers[i].resource == resource)
+            return &barriers[i];
+    }
+
+    return nullptr;
+}
+
+static std::vector<RenderGraphTransition> Simulate(const RenderGraph& graph, std::vector<RenderGraphState> states) {
+    std::vector<RenderGraphTransition> transitions;
+    graph.Simulate(states.data(), 0, (uint32_t)graph.GetPasses().size(), &transitions);
+
+    return transitions;
+}
+
+static void TestReadAfterWrite() {
+    // 0: A writes T0, 1: B writes T1, 2: C writes T2, 3: D reads T0
+    RenderGraph graph;
+    graph.Reset(3, 0);
+    graph.SetPersistent(1);
+    graph.SetPersistent(2);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.AddPass(1, "B");
+    graph.Write(1);
+    graph.AddPass(2, "C");
+    graph.Write(2);
+    graph.AddPass(3, "D", false, true);
+    graph.Read(0);
+
+    // Hoisted right after the writer
+    graph.Compile(true);
+
+    const RenderGraphBarrier* barrier = FindBarrier(graph, 1, 0);
+    CHECK(barrier && barrier->consumer == 3 && barrier->state.access == SR);
+    CHECK(!FindBarrier(graph, 2, 0) && !FindBarrier(graph, 3, 0));
+
+    // First accesses of persistent resources are hoisted to the first pass
+    CHECK(FindBarrier(graph, 0, 0) && FindBarrier(graph, 0, 1) && FindBarrier(graph, 0, 2));
+
+    // Not hoisted
+    graph.Compile(false);
+
+    barrier = FindBarrier(graph, 3, 0);
+    CHECK(barrier && barrier->consumer == 3);
+    CHECK(!FindBarrier(graph, 1, 0) && !FindBarrier(graph, 2, 0));
+    CHECK(FindBarrier(graph, 1, 1) && !FindBarrier(graph, 0, 1));
+}
+
+static void TestStorageHazards() {
+    // 0: A writes B0, 1: B reads B0 (storage), 2: C reads B0 (storage), 3: D writes B0 (storage)
+    RenderGraph graph;
+    graph.Reset(0, 1);
+    graph.SetPersistent(0);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.AddPass(1, "B", false, true);
+    graph.Read(0, STORAGE, STORAGE_LAYOUT);
+    graph.AddPass(2, "C", false, true);
+    graph.Read(0, STORAGE, STORAGE_LAYOUT);
+    graph.AddPass(3, "D");
+    graph.Write(0);
+
+    graph.Compile(true);
+
+    // Read-after-write
+    const RenderGraphBarrier* barrier = FindBarrier(graph, 1, 0);
+    CHECK(barrier && barrier->consumer == 1 && barrier->isStorageHazard);
+
+    // Read-after-read
+    barrier = FindBarrier(graph, 2, 0);
+    CHECK(barrier && barrier->consumer == 2 && !barrier->isStorageHazard);
+
+    // Write-after-read
+    barrier = FindBarrier(graph, 3, 0);
+    CHECK(barrier && barrier->consumer == 3 && barrier->isStorageHazard);
+
+    // "storage -> storage" transitions are emitted only for hazards
+    std::vector<RenderGraphTransition> transitions = Simulate(graph, {{STORAGE, nri::Layout::UNDEFINED}});
+
+    CHECK(transitions.size() == 3);
+    if (transitions.size() == 3) {
+        CHECK(transitions[0].pass == 0);
+        CHECK(transitions[1].pass == 1);
+        CHECK(transitions[2].pass == 3);
+    }
+}
+
+static void TestWriteAfterWrite() {
+    // 0: A writes T0, 1: B writes T0
+    RenderGraph graph;
+    graph.Reset(1, 0);
+    graph.SetPersistent(0);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.AddPass(1, "B");
+    graph.Write(0);
+
+    graph.Compile(true);
+
+    std::vector<RenderGraphTransition> transitions = Simulate(graph, {{STORAGE, STORAGE_LAYOUT}});
+
+    CHECK(transitions.size() == 2);
+    if (transitions.size() == 2)
+        CHECK(transitions[1].pass == 1);
+}
+
+static void TestCulling() {
+    // 0: A writes T0 (unused), 1: B writes T1, 2: C reads T1 weakly, writes T2 (persistent), 3: D writes T3 (unused)
+    RenderGraph graph;
+    graph.Reset(4, 0);
+    graph.SetPersistent(2);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.AddPass(1, "B");
+    graph.Write(1);
+    graph.AddPass(2, "C");
+    graph.ReadWeak(1);
+    graph.Write(2);
+    graph.AddPass(3, "D");
+    graph.Write(3);
+
+    graph.Compile(true);
+
+    const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+    CHECK(passes[0].isCulled);
+    CHECK(passes[1].isCulled);
+    CHECK(!passes[2].isCulled);
+    CHECK(passes[3].isCulled);
+
+    // A weakly read resource still gets its state
+    CHECK(FindBarrier(graph, 2, 1));
+
+    // Culled passes don't get barriers, the first access is hoisted to the first alive pass
+    CHECK(passes[0].barrierNum == 0 && passes[1].barrierNum == 0 && passes[3].barrierNum == 0);
+    CHECK(passes[2].barrierNum == 2);
+
+    // Culled passes keep their accesses (transient lifetimes are derived from them)
+    CHECK(passes[1].accessNum == 1 && graph.GetAccesses(passes[1])[0].resource == 1 && graph.GetAccesses(passes[1])[0].isWrite);
+    CHECK(passes[3].accessNum == 1 && graph.GetAccesses(passes[3])[0].resource == 3);
+}
+
+static void TestTransient() {
+    // 0: A writes T0, 1: B writes T1 (transient), 2: C reads T1
+    RenderGraph graph;
+    graph.Reset(2, 0);
+    graph.SetPersistent(0);
+    graph.SetTransient(1);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.AddPass(1, "B");
+    graph.Write(1);
+    graph.AddPass(2, "C", false, true);
+    graph.Read(1);
+
+    graph.Compile(true);
+
+    // The first barrier of a transient resource stays in front of the first user
+    CHECK(!FindBarrier(graph, 0, 1));
+    CHECK(FindBarrier(graph, 1, 1));
+    CHECK(FindBarrier(graph, 2, 1));
+}
+
+static void TestQueues() {
+    // Queue 0: 0: A writes T0, queue 1: 1: B writes T1, 2: C reads T0
+    RenderGraph graph;
+    graph.Reset(2, 0);
+    graph.SetPersistent(1);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.SetQueue(1);
+    graph.AddPass(1, "B");
+    graph.Write(1);
+    graph.AddPass(2, "C", false, true);
+    graph.Read(0);
+
+    graph.Compile(true);
+
+    // Hoisted to the next pass on the consumer's queue
+    const RenderGraphBarrier* barrier = FindBarrier(graph, 1, 0);
+    CHECK(barrier && barrier->consumer == 2);
+
+    // The first access of T1 can't go to pass 0, which is on another queue
+    CHECK(!FindBarrier(graph, 0, 1));
+    CHECK(FindBarrier(graph, 1, 1));
+}
+
+static void TestExternal() {
+    // 0: A writes T0, 1: B (external) reads T0 and writes T1, 2: C reads T1
+    RenderGraph graph;
+    graph.Reset(2, 0);
+
+    graph.AddPass(0, "A");
+    graph.Write(0);
+    graph.AddPass(1, "B", true);
+    graph.Read(0);
+    graph.Write(1);
+    graph.AddPass(2, "C", false, true);
+    graph.Read(1);
+
+    graph.Compile(true);
+
+    // External passes manage barriers themselves
+    CHECK(graph.GetPasses()[1].barrierNum == 0);
+
+    // Simulation picks up states left by the external pass
+    std::vector<RenderGraphTransition> transitions = Simulate(graph, {{SR, SR_LAYOUT}, {SR, SR_LAYOUT}});
+
+    CHECK(transitions.size() == 2);
+    if (transitions.size() == 2)
+        CHECK(transitions[1].pass == 2 && transitions[1].resource == 1 && transitions[1].before.access == STORAGE);
+
+    // Partial replay
+    std::vector<RenderGraphState> states = {{SR, SR_LAYOUT}, {SR, SR_LAYOUT}};
+    graph.Simulate(states.data(), 0, 2);
+
+    CHECK(states[0].access == SR && states[1].access == STORAGE && states[1].layout == STORAGE_LAYOUT);
+}
+
+int main() {
+    TestReadAfterWrite();
+    TestStorageHazards();
+    TestWriteAfterWrite();
+    TestCulling();
+    TestTransient();
+    TestQueues();
+    TestExternal();
+
+    if (g_FailedNum) {
+        printf("RenderGraph tests: %u check(s) failed\n", g_FailedNum);
+        return 1;
+    }
+
+    printf("RenderGraph tests: passed\n");
+
+    return 0;
+}